@@ -29,8 +29,8 @@ set chip8_files \
 
 # generate reference output for each test file
 #for file in $chip8_files
-#	./install/bin/chip8-snort rom-suite/tests/chip8/$file.ch8
-#	./install/bin/chip8-reference-1 rom-suite/tests/chip8/$file.ch8
+#	./install/bin/chip8-snort rom-suite/tests/chip8/$file.ch8 --headless
+#	./install/bin/chip8-reference-1 rom-suite/tests/chip8/$file.ch8 --headless
 #end
 
 # validate with comparison tool
@@ -12,8 +12,12 @@ i32 main(i32 argc, char* argv[])
 		return 1;
 	}
 
-	SnortFs::ReplayFile oriReplayFile = SnortFs::replay_open(argv[1]);
-	SnortFs::ReplayFile cmpReplayFile = SnortFs::replay_open(argv[2]);
+	SnortFs::ReplayFile oriReplayFile = SnortFs::replay_open(
+		argv[1], SnortFs::kReplayOpenMode_map
+	);
+	SnortFs::ReplayFile cmpReplayFile = SnortFs::replay_open(
+		argv[2], SnortFs::kReplayOpenMode_map
+	);
 	if (oriReplayFile.handle == 0) {
 		printf("failed to open replay file %s\n", argv[1]);
 		return 1;
@@ -24,6 +28,51 @@ i32 main(i32 argc, char* argv[])
 		return 1;
 	}
 
+	// -- hash-only replays are compared a block of instructions at a time,
+	//    a divergence is reported as a window to re-record in full
+	if (
+		   SnortFs::replay_isHashOnly(oriReplayFile)
+		|| SnortFs::replay_isHashOnly(cmpReplayFile)
+	) {
+		SnortFs::HashDivergence const divergence = (
+			SnortFs::validateHashes(oriReplayFile, cmpReplayFile)
+		);
+		if (!divergence.isComparable) {
+			printf("->%s: FAIL, the replays can't be compared\n", argv[1]);
+			return 1;
+		}
+		if (!divergence.isDiverged) {
+			printf("->%s: PASS\n", argv[1]);
+			return 0;
+		}
+		u64 const instructionOffset = (
+			SnortFs::replay_instructionOffset(oriReplayFile)
+		);
+		// the window is inclusive of its last instruction
+		printf(
+			"->%s: FAIL, diverged within instructions %zu to %zu\n",
+			argv[1],
+			(size_t)(instructionOffset + divergence.firstInstruction),
+			(size_t)(
+				  instructionOffset
+				+ divergence.firstInstruction
+				+ divergence.instructionCount
+				- 1u
+			)
+		);
+		auto const regionInfo = SnortFs::replay_regionInfo(oriReplayFile);
+		for (size_t const regionIndex : divergence.regionIndices) {
+			printf("  region '%s' differs\n", regionInfo[regionIndex].label);
+		}
+		printf(
+			"  re-record it in full with --recording-start-offset %zu "
+			"--target-instruction-count %zu\n",
+			(size_t)(instructionOffset + divergence.firstInstruction),
+			(size_t)divergence.instructionCount
+		);
+		return 1;
+	}
+
 	size_t const fc = SnortFs::validateMemory(oriReplayFile, cmpReplayFile);
 	if (fc == ~0u) {
 		printf("->%s: PASS\n", argv[1]);
@@ -7,6 +7,7 @@
 // -----------------------------------------------------------------------------
 
 struct SnortDevice { u64 handle; };
+struct SnortState { u64 handle; };
 
 // -----------------------------------------------------------------------------
 // -- snort common harness interfaces ------------------------------------------
@@ -27,6 +28,11 @@ SnortDevice snort_deviceCreateFromCommon(
 SnortDevice snort_deviceCreate(SnortDeviceCreateInfo const * ci);
 void snort_deviceDestroy(SnortDevice * device);
 
+// with --headless the harness never opens a window or touches raylib and
+//   imgui, it records straight away and quits once the recording is done.
+//   Emulators should skip their own imgui setup in that case
+bool snort_isHeadless(SnortDevice const device);
+
 // memory region must be in the same order as it appeared in device creation.
 struct SnortMemoryRegion {
 	u8 const * data;
@@ -34,7 +40,9 @@ struct SnortMemoryRegion {
 
 bool snort_shouldQuit(SnortDevice const device);
 
-// returns the number of frames that should be processed.
+// returns the number of frames that should be processed, sized from how long
+//   recent frames took so that emulating fills the frame budget
+//   (--frame-budget-ms, 8 by default) and the display stays responsive.
 // User must call snort_updateFrame for the number of frames returned, followed
 //   by a call to snort_endFrame.
 // The code should look like this:
@@ -56,9 +64,180 @@ void snort_updateFrame(
 
 void snort_endFrame(SnortDevice const device);
 
+// instructions emulated per second of wall time, averaged over the last half
+//   second or so and zero while paused. With snort_run it's only updated on
+//   the emulation thread, so only call it from the step callback
+f64 snort_instructionsPerSecond(SnortDevice const device);
+
+// an alternative to the frame functions above that runs the emulator on its
+//   own thread, so emulation speed isn't tied to the display rate. step is
+//   called once per instruction on that thread, and is the only place the
+//   emulator's memory may be touched until snort_run returns. The calling
+//   thread keeps the window and displays a snapshot of the memory regions
+//   taken between batches of instructions, at most once per display frame.
+// Returns once the window closes, or headless once the recording is done.
+// The code should look like this:
+//   snort_run(device, memoryRegions, &myDeviceStep, &myDevice);
+typedef void (*SnortStepFn)(void * userData);
+
+void snort_run(
+	SnortDevice const device,
+	SnortMemoryRegion const * memoryRegions,
+	SnortStepFn const step,
+	void * userData
+);
+
+// -----------------------------------------------------------------------------
+// -- snort harness multi-core lockstep ----------------------------------------
+// -----------------------------------------------------------------------------
+
+// hosts several emulator cores in one process and steps them in lockstep,
+//   one instruction each, comparing their regions after every step. Nothing
+//   goes through a thread, file or shared memory, so it's the quickest
+//   differential test. For emulators that only run as their own process see
+//   --lockstep and snort-lockstep instead.
+// A core's device is created like any other from the same command line, so
+//   the cores draw the same random numbers and see the same inputs, as long
+//   as their emulators draw through snort_rngU64 and read snort_inputState
+//   rather than their own. It's always headless, never records, and
+//   --flight-recorder is dumped for every core once they diverge.
+// The code should look like this:
+//   SnortCore cores[2] = {
+//     { deviceA, regionsA, &stepA, &coreA },
+//     { deviceB, regionsB, &stepB, &coreB },
+//   };
+//   SnortCoreRunResult result = snort_runCores(cores, 2);
+SnortDevice snort_coreDeviceCreate(SnortDeviceCreateInfo const * ci);
+SnortDevice snort_coreDeviceCreateFromCommon(
+	SnortCommonInterface const type,
+	char const * const customLabel,
+	char const * const romPath,
+	i32 const argc,
+	char const * const * const argv
+);
+
+struct SnortCore {
+	SnortDevice device;
+	SnortMemoryRegion const * memoryRegions;
+	SnortStepFn step;
+	void * userData;
+};
+
+struct SnortCoreRunResult {
+	// instructions every core ran
+	u64 instructionCount;
+	bool isDiverged;
+	// the first core to disagree with the first one, and its first region
+	//   that differs. Cores whose regions don't line up diverge at zero
+	u64 coreIndex;
+	u64 regionIndex;
+};
+
+// runs the cores until the first one's --recording-start-offset plus
+//   --target-instruction-count, or until they diverge
+SnortCoreRunResult snort_runCores(SnortCore const * cores, u64 coreCount);
+
+// -----------------------------------------------------------------------------
+// -- snort harness dirty range reporting --------------------------------------
+// -----------------------------------------------------------------------------
+
+// by default snort_updateFrame finds changes by comparing every byte of every
+//   region. Once dirty tracking is enabled it only looks at the ranges
+//   reported with snort_markDirty since the previous snort_updateFrame, so
+//   every write to a region must be reported. The recorded diffs are the
+//   same either way.
+// Run with --check-dirty-ranges to compare the reported ranges against a
+//   full scan, which reports any missed writes and records the scan instead
+void snort_enableDirtyTracking(SnortDevice const device);
+
+void snort_markDirty(
+	SnortDevice const device,
+	u64 const regionIndex,
+	u64 const byteOffset,
+	u64 const byteCount
+);
+
+// -----------------------------------------------------------------------------
+// -- snort harness save states ------------------------------------------------
+// -----------------------------------------------------------------------------
+
+// the harness only reads memory through the regions passed to the frame
+//   functions, to write states back into the emulator it needs pointers it
+//   may write through. Same order as at device creation, and they have to
+//   stay valid until the device is destroyed. Register them once the
+//   emulator's memory is initialized, --restore-replay is applied then and
+//   a recording requested on the command line only starts after it
+struct SnortWritableMemoryRegion {
+	u8 * data;
+};
+
+void snort_setWritableRegions(
+	SnortDevice const device,
+	SnortWritableMemoryRegion const * memoryRegions
+);
+
+// a state is a copy of every region along with the instruction count and rng
+//   seed, so restoring it replays the same random numbers and inputs.
+//   Anything outside of the regions is up to the emulator. Save and restore
+//   between instructions, with snort_run that's only from the step callback,
+//   which should return without stepping after a restore.
+// Restoring is refused while recording, returns false if it didn't happen.
+//   The state is handle 0 if there are no writable regions
+SnortState snort_saveState(SnortDevice const device);
+bool snort_restoreState(SnortDevice const device, SnortState const state);
+void snort_stateDestroy(SnortState * state);
+
+// restores the memory of a replay's instruction, an index into the replay
+//   rather than an instruction offset, e.g. the last one that validated.
+//   Also see --restore-replay and --input-replay
+bool snort_restoreStateFromReplay(
+	SnortDevice const device,
+	char const * const replayPath,
+	u64 const instructionIndex
+);
+
+// with --step-back the harness keeps the bytes the last instructions
+//   overwrote, and this undoes the newest one by writing them back through
+//   the writable regions. It costs the size of the instruction's changes
+//   with dirty tracking, a copy of the regions without, and never re-runs
+//   anything. Pauses unless headless, and returns false if there's nothing
+//   left to undo or while recording. Call it between instructions like
+//   snort_restoreState
+bool snort_stepBack(SnortDevice const device);
+
+// -----------------------------------------------------------------------------
+// -- snort harness flight recorder --------------------------------------------
+// -----------------------------------------------------------------------------
+
+// with --flight-recorder the harness keeps the last instructions in memory.
+//   Emulators call this when they hit something worth looking at, e.g. a bad
+//   opcode, and the kept instructions are written out as a replay next to the
+//   recording path. Does nothing if the flight recorder is off
+void snort_flightRecorderTrigger(
+	SnortDevice const device,
+	char const * const reason
+);
+
+// -----------------------------------------------------------------------------
+// -- snort harness input ------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+// the buttons held down, bit n for button n, e.g. the chip8 keypad's keys.
+//   Live they're read from the keyboard once per display frame, with
+//   --input-replay they're the ones a recording polled at the same
+//   instruction, and headless otherwise nothing is ever held. The state is
+//   latched the first time an instruction asks and recorded when it changes,
+//   so emulators should read their inputs through this every instruction
+//   rather than keeping their own
+u64 snort_inputState(SnortDevice const device);
+
 // -----------------------------------------------------------------------------
 // -- snort harness deterministic synchronization ------------------------------
 // -----------------------------------------------------------------------------
 
+// counter based, the numbers an instruction draws only depend on the seed
+//   (see --rng-seed), the instruction count and how many the instruction drew
+//   before. Two emulators that draw a different amount at one instruction
+//   agree again from the next one
 u64 snort_rngU64(SnortDevice const device);
 f32 snort_rngF32(SnortDevice const device);
@@ -0,0 +1,75 @@
+#include "device.hpp"
+
+#include <algorithm>
+
+namespace {
+
+// weight of the newest batch in the smoothed cost, low enough that a single
+//   slow batch (e.g. a keyframe being written) doesn't halve the next one
+constexpr f64 kSmoothing { 0.25 };
+
+constexpr auto kRateWindow { std::chrono::milliseconds(500) };
+
+} // namespace
+
+// --
+
+size_t snort::batchTiming_batchSize(
+	snort::BatchTiming const & timing,
+	u64 const budgetNanoseconds
+) {
+	if (timing.nanosecondsPerInstruction <= 0.0) {
+		return snort::kInitialBatchInstructionCount;
+	}
+	f64 const batchSize = (
+		(f64)budgetNanoseconds / timing.nanosecondsPerInstruction
+	);
+	return (size_t)std::clamp(
+		batchSize, 1.0, (f64)snort::kMaxBatchInstructionCount
+	);
+}
+
+// --
+
+void snort::batchTiming_record(
+	snort::BatchTiming & timing,
+	size_t const instructionCount,
+	u64 const elapsedNanoseconds
+) {
+	if (instructionCount == 0u) { return; }
+
+	// -- cost per instruction
+	f64 const sample = (f64)elapsedNanoseconds / (f64)instructionCount;
+	timing.nanosecondsPerInstruction = (
+		timing.nanosecondsPerInstruction <= 0.0
+		? sample
+		: (
+			  timing.nanosecondsPerInstruction
+			+ (sample - timing.nanosecondsPerInstruction) * ::kSmoothing
+		)
+	);
+
+	// -- throughput, over wall time so it includes everything between batches
+	auto const now = std::chrono::steady_clock::now();
+	if (timing.rateWindowInstructionCount == 0u) {
+		// the window opens at the start of this batch
+		timing.rateWindowStart = (
+			now - std::chrono::nanoseconds(elapsedNanoseconds)
+		);
+	}
+	timing.rateWindowInstructionCount += instructionCount;
+	auto const windowDuration = now - timing.rateWindowStart;
+	if (windowDuration < ::kRateWindow) { return; }
+	timing.instructionsPerSecond = (
+		  (f64)timing.rateWindowInstructionCount
+		/ std::chrono::duration<f64>(windowDuration).count()
+	);
+	timing.rateWindowInstructionCount = 0u;
+}
+
+// --
+
+void snort::batchTiming_idle(snort::BatchTiming & timing) {
+	timing.instructionsPerSecond = 0.0;
+	timing.rateWindowInstructionCount = 0u;
+}
@@ -0,0 +1,137 @@
+#include "device.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+snort::Device & deviceOf(SnortCore const & core) {
+	return *(snort::Device *)(uintptr_t)(core.device.handle);
+}
+
+// --
+
+// every core's regions have to be the first core's, byte for byte
+bool isLayoutMatching(
+	SnortCore const * const cores,
+	u64 const coreCount,
+	SnortCoreRunResult & result
+) {
+	auto const & regions = ::deviceOf(cores[0]).currentMemoryRegion;
+	for (u64 coreIt = 1; coreIt < coreCount; ++ coreIt) {
+		auto const & coreRegions = ::deviceOf(cores[coreIt]).currentMemoryRegion;
+		size_t const regionCount = std::min(regions.size(), coreRegions.size());
+		result.coreIndex = coreIt;
+		result.regionIndex = regionCount;
+		for (size_t it = 0; it < regionCount; ++ it) {
+			if (regions[it].byteCount != coreRegions[it].byteCount) {
+				result.regionIndex = it;
+				return false;
+			}
+		}
+		if (regions.size() != coreRegions.size()) { return false; }
+	}
+	return true;
+}
+
+// --
+
+// a plain compare rather than hashes, it's exact and the bytes are read once
+//   either way
+bool isDiverged(
+	SnortCore const * const cores,
+	u64 const coreCount,
+	SnortCoreRunResult & result
+) {
+	auto const & regions = ::deviceOf(cores[0]).currentMemoryRegion;
+	for (u64 coreIt = 1; coreIt < coreCount; ++ coreIt) {
+		for (size_t it = 0; it < regions.size(); ++ it) {
+			bool const isEqual = (
+				memcmp(
+					cores[0].memoryRegions[it].data,
+					cores[coreIt].memoryRegions[it].data,
+					regions[it].byteCount
+				) == 0
+			);
+			if (!isEqual) {
+				result.coreIndex = coreIt;
+				result.regionIndex = it;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+} // namespace
+
+// --
+
+SnortCoreRunResult snort_runCores(
+	SnortCore const * const cores,
+	u64 const coreCount
+) {
+	SnortCoreRunResult result {
+		.instructionCount = 0u,
+		.isDiverged = false,
+		.coreIndex = 0u,
+		.regionIndex = 0u,
+	};
+	if (coreCount < 2u) {
+		printf("snort_runCores: needs at least two cores to compare\n");
+		return result;
+	}
+	snort::Device const & first = ::deviceOf(cores[0]);
+	if (!::isLayoutMatching(cores, coreCount, result)) {
+		printf(
+			"cores '%s' and '%s' don't have the same regions, from region %zu\n",
+			first.name.c_str(),
+			::deviceOf(cores[result.coreIndex]).name.c_str(),
+			(size_t)result.regionIndex
+		);
+		result.isDiverged = true;
+		return result;
+	}
+
+	// -- the memory every instruction starts from is compared, including the
+	//    last one's result
+	size_t const instructionCount = snort::recordingInstructionsLeft(first);
+	for (size_t instruction = 0; ; ++ instruction) {
+		if (::isDiverged(cores, coreCount, result)) {
+			result.instructionCount = instruction;
+			result.isDiverged = true;
+			break;
+		}
+		if (instruction == instructionCount) {
+			result.instructionCount = instruction;
+			break;
+		}
+		for (u64 coreIt = 0; coreIt < coreCount; ++ coreIt) {
+			snort_updateFrame(cores[coreIt].device, cores[coreIt].memoryRegions);
+			cores[coreIt].step(cores[coreIt].userData);
+		}
+	}
+	if (!result.isDiverged) { return result; }
+
+	// -- what led up to it, from every core
+	snort::Device & diverged = ::deviceOf(cores[result.coreIndex]);
+	printf(
+		"cores diverged at instruction offset %zu, '%s' region '%s' differs "
+		"from '%s'\n",
+		diverged.instructionCount,
+		diverged.name.c_str(),
+		diverged.currentMemoryRegion[result.regionIndex].label.c_str(),
+		first.name.c_str()
+	);
+	for (u64 coreIt = 0; coreIt < coreCount; ++ coreIt) {
+		snort::Device & device = ::deviceOf(cores[coreIt]);
+		if (!snort::flightRecorder_isEnabled(device.flightRecorder)) {
+			continue;
+		}
+		// captures the memory that differs, the run is over so the extra
+		//   instruction count doesn't matter
+		snort_updateFrame(cores[coreIt].device, cores[coreIt].memoryRegions);
+		snort::flightRecorder_dump(device, "cores diverged");
+	}
+	return result;
+}
@@ -2,12 +2,13 @@
 
 #include <snort/snort.h>
 
-SnortDevice snort_deviceCreateFromCommon(
+SnortDevice snort::deviceCreateFromCommon(
 	SnortCommonInterface const type,
 	char const * const customLabel,
 	char const * const romPath,
 	i32 const argc,
-	char const * const * const argv
+	char const * const * const argv,
+	bool const isHostedCore
 ) {
 	// get the filepath from rompath. Get just the filename from the path,
 	//   remove the extension, replace non-alphanumeric characters with dashes,
@@ -91,8 +92,40 @@ SnortDevice snort_deviceCreateFromCommon(
 				.memoryRegionCount = 7u,
 				.memoryRegions = &memoryRegions[0],
 			};
-			return snort_deviceCreate(&ci);
+			return snort::deviceCreate(&ci, isHostedCore);
 		}; break;
 	}
 	return SnortDevice { .handle = 0 };
 }
+
+// --
+
+SnortDevice snort_deviceCreateFromCommon(
+	SnortCommonInterface const type,
+	char const * const customLabel,
+	char const * const romPath,
+	i32 const argc,
+	char const * const * const argv
+) {
+	return (
+		snort::deviceCreateFromCommon(
+			type, customLabel, romPath, argc, argv, /*isHostedCore=*/ false
+		)
+	);
+}
+
+// --
+
+SnortDevice snort_coreDeviceCreateFromCommon(
+	SnortCommonInterface const type,
+	char const * const customLabel,
+	char const * const romPath,
+	i32 const argc,
+	char const * const * const argv
+) {
+	return (
+		snort::deviceCreateFromCommon(
+			type, customLabel, romPath, argc, argv, /*isHostedCore=*/ true
+		)
+	);
+}
@@ -2,86 +2,297 @@
 
 #include "cxxopts.hpp"
 
+#include <snort-replay/diff.hpp>
+
 #include <ctime>
 #include <snort/snort-ui.h>
 
+#include <algorithm>
 #include <cstring>
 
 namespace {
 
-void storeFrameDelta(
+// only scans the ranges reported with snort_markDirty, the spans are offset
+//   back into the region so they match what a full scan finds
+void findDirtySpans(
 	snort::Device & device,
-	SnortMemoryRegion const * memoryRegions,
-	size_t const regionIndex
+	u8 const * referenceData,
+	size_t const regionIndex,
+	std::vector<SnortFs::MemoryRegionDiffRecord> & records
 ) {
-	// the recording delta is different since it supports forwarding data,
-	//   the local delta is for rolling back data
-	std::vector<SnortFs::MemoryRegionDiffRecord> recordDelta;
-	std::vector<std::vector<uint8_t>> recordDeltaData;
 	auto & regionInfo = device.currentMemoryRegion[regionIndex];
-	auto & referenceData = memoryRegions[regionIndex].data;
-	size_t startByteDiff = -1u;
-	// look through bytes of memory region, find spans of ranges that are
-	//   different, and store them as deltas. The deltas are based off
-	//   the old data, so that the data can be rewinded
-	for (size_t byteIt = 0; byteIt < regionInfo.byteCount; ++ byteIt) {
-		bool const isDiff = (
-			referenceData[byteIt] != regionInfo.currentData[byteIt]
-		);
-		bool const hasStartedDiff = (startByteDiff != -1u);
-		// if byte isn't different and no previous diff seen, continue search
-		if (!isDiff && !hasStartedDiff) {
-			continue;
+	auto & ranges = device.dirtyRanges[regionIndex];
+	std::sort(
+		ranges.begin(), ranges.end(),
+		[](snort::DirtyRange const & a, snort::DirtyRange const & b) {
+			return a.byteOffset < b.byteOffset;
 		}
-		// if byte isn't different, and previous diff seen, store the diff
-		else if (!isDiff && hasStartedDiff) {
-			recordDelta.emplace_back(
-				SnortFs::MemoryRegionDiffRecord {
-					.byteOffset = startByteDiff,
-					.byteCount = (byteIt - startByteDiff),
-					.data = {},
-				}
-			);
-			recordDeltaData.emplace_back(
-				std::vector<uint8_t>(
-					&referenceData[startByteDiff],
-					&referenceData[byteIt]
-				)
-			);
-			startByteDiff = -1u;
+	);
+	// coalesce overlapping and touching ranges, otherwise a span crossing
+	//   the boundary of two ranges would be split in two
+	size_t it = 0;
+	while (it < ranges.size()) {
+		u64 const rangeBegin = ranges[it].byteOffset;
+		u64 rangeEnd = rangeBegin + ranges[it].byteCount;
+		for (++ it; it < ranges.size() && ranges[it].byteOffset <= rangeEnd; ++ it) {
+			rangeEnd = std::max(rangeEnd, ranges[it].byteOffset + ranges[it].byteCount);
 		}
-		// if byte is different, and no previous diff seen, start diff
-		else if (isDiff && !hasStartedDiff) {
-			startByteDiff = byteIt;
+		size_t const firstRecord = records.size();
+		SnortFs::diff_findSpans(
+			referenceData + rangeBegin,
+			regionInfo.currentData.data() + rangeBegin,
+			rangeEnd - rangeBegin,
+			records
+		);
+		for (size_t rec = firstRecord; rec < records.size(); ++ rec) {
+			records[rec].byteOffset += rangeBegin;
 		}
-		// if byte is different, and previous diff seen, continue diff search
-		else if (isDiff && hasStartedDiff) {
+	}
+	ranges.clear();
+
+	if (!device.checkDirtyRanges) { return; }
+
+	// -- cross-check against a full scan
+	auto & fullScan = device.dirtyCheckScratch;
+	fullScan.clear();
+	SnortFs::diff_findSpans(
+		referenceData,
+		regionInfo.currentData.data(),
+		regionInfo.byteCount,
+		fullScan
+	);
+	for (size_t rec = 0; rec < fullScan.size(); ++ rec) {
+		if (
+			   rec < records.size()
+			&& records[rec].byteOffset == fullScan[rec].byteOffset
+			&& records[rec].byteCount == fullScan[rec].byteCount
+		) {
 			continue;
 		}
-		else {
-			SnortAssert(false && "unreachable");
-		}
+		printf(
+			"error: region '%s' changed at byte offset %zu of instruction %zu "
+			"without a snort_markDirty report\n",
+			regionInfo.label.c_str(),
+			(size_t)fullScan[rec].byteOffset,
+			device.instructionCount
+		);
+		// record the full scan instead, so the replay stays correct
+		records.swap(fullScan);
+		return;
 	}
+}
 
-	// store the data at end to avoid ptr movement from reallocs
-	for (size_t it = 0; it < recordDelta.size(); ++ it) {
-		recordDelta[it].data = recordDeltaData[it].data();
-	}
-	// record delta for current region and current instruction into file
-	SnortFs::replayRecorder_recordInstruction(
-		device.recordingFile,
-		recordDelta.size(),
-		recordDelta.data()
+// --
+
+void storeFrameDelta(
+	snort::Device & device,
+	SnortMemoryRegion const * memoryRegions,
+	size_t const regionIndex,
+	bool const isRecordingDelta,
+	bool const isKeepingStepBack
+) {
+	// the recording delta is different since it supports forwarding data,
+	//   the local delta is for rolling back data, see --step-back.
+	// The records point straight into the emulator's memory, the recorder
+	//   copies them out, so the scratch vector is the only storage and it's
+	//   reused between calls
+	std::vector<SnortFs::MemoryRegionDiffRecord> & recordDelta = (
+		device.recordDeltaScratch
 	);
+	recordDelta.clear();
+	auto & regionInfo = device.currentMemoryRegion[regionIndex];
+	auto & referenceData = memoryRegions[regionIndex].data;
+	// find spans of ranges that are different, and store them as deltas.
+	//   Most instructions leave most regions untouched, which the recorder
+	//   leaves out of the instruction's changed region mask
+	if (device.isDirtyTracking) {
+		::findDirtySpans(device, referenceData, regionIndex, recordDelta);
+	} else {
+		SnortFs::diff_findSpans(
+			referenceData,
+			regionInfo.currentData.data(),
+			regionInfo.byteCount,
+			recordDelta
+		);
+	}
+
+	// record delta for current region and current instruction into file,
+	//   and/or keep it in the flight recorder
+	if (isRecordingDelta) {
+		SnortFs::replayRecorder_recordInstruction(
+			device.recordingFile,
+			recordDelta.size(),
+			recordDelta.data()
+		);
+	}
+	if (snort::flightRecorder_isEnabled(device.flightRecorder)) {
+		snort::flightRecorder_recordRegion(
+			device.flightRecorder, regionIndex, recordDelta
+		);
+	}
+	if (isKeepingStepBack) {
+		snort::stepBack_recordRegion(
+			device.stepBackLog,
+			regionIndex,
+			recordDelta,
+			regionInfo.currentData.data()
+		);
+	}
+	// bring the current data up to date so the next instruction diffs
+	//   against it
+	for (auto const & delta : recordDelta) {
+		memcpy(
+			regionInfo.currentData.data() + delta.byteOffset,
+			delta.data,
+			delta.byteCount
+		);
+	}
 }
 
 } // namespace
 
 // --
 
+bool snort::startRecording(snort::Device & device) {
+	device.recordingFile = (
+		SnortFs::replayRecorder_open(
+			device.recordingFilepath.c_str(),
+			/*commonInterface=*/ device.commonInterface,
+			/*instructionOffset=*/ device.instructionCount,
+			/*regionCount=*/ device.currentMemoryRegion.size(),
+			/*regionCreateInfo=*/ device.memoryRegionCreateInfo.data(),
+			/*options=*/ {
+				.keyframeInterval = device.keyframeInterval,
+				.codec = device.replayCodec,
+				.asyncWriter = device.asyncReplayWriter,
+				.hashOnly = device.hashOnlyRecording,
+				.hashInterval = device.hashInterval,
+				.hasRngSeed = true,
+				.rngSeed = device.rngSeed,
+				.recordInputs = true,
+			}
+		)
+	);
+	if (device.recordingFile.handle == 0) {
+		printf("failed to start recording\n");
+		return false;
+	}
+	device.isRecording = true;
+	device.isRecordingFirstFrame = true;
+	return true;
+}
+
+// --
+
+void snort::requestRecording(snort::Device & device) {
+	size_t const startOffset = std::max(
+		(size_t)std::max(device.recordingStartOffset, 0),
+		device.instructionCount
+	);
+	device.targetInstructionCount = (
+		(i32)startOffset + std::max(device.recordingInstructionCount, 0)
+	);
+	device.paused = false;
+	if (device.instructionCount < startOffset) {
+		// snort_updateFrame starts the recording once it gets there
+		device.isFastForwarding = true;
+		printf("fast-forwarding to instruction offset %zu\n", startOffset);
+		return;
+	}
+	snort::startRecording(device);
+}
+
+// --
+
+void snort::closeFinishedRecording(snort::Device & device) {
+	if (
+		   !device.isRecording
+		|| device.instructionCount < (size_t)device.targetInstructionCount
+	) {
+		return;
+	}
+	SnortFs::replayRecorder_close(device.recordingFile);
+	device.isRecording = false;
+	printf(
+		"stopped recording at instruction offset %zu\n",
+		device.instructionCount
+	);
+	device.paused = true;
+}
+
+// --
+
+size_t snort::recordingInstructionsLeft(snort::Device const & device) {
+	size_t const target = (size_t)device.targetInstructionCount;
+	return (
+		device.instructionCount < target
+		? target - device.instructionCount
+		: 0u
+	);
+}
+
+// --
+
+bool snort::isBatchClamped(snort::Device const & device) {
+	return device.isRecording || device.isFastForwarding || device.isHeadless;
+}
+
+// --
+
+bool snort::isSessionDone(snort::Device const & device) {
+	if (device.isLockstepHalted) { return true; }
+	if (device.isRecording || device.isFastForwarding) { return false; }
+	if (
+		   device.isHeadless
+		&& (
+			   snort::flightRecorder_isEnabled(device.flightRecorder)
+			|| snort::stepBack_isEnabled(device.stepBackLog)
+			|| !device.lockstepName.empty()
+		)
+	) {
+		return snort::recordingInstructionsLeft(device) == 0u;
+	}
+	return true;
+}
+
+// --
+
 namespace {
 
-void parseCommandLineArgs(
+void openInputReplay(
+	snort::Device & device,
+	std::string const & path,
+	bool const useReplaySeed
+) {
+	device.inputReplay = SnortFs::replay_open(path.c_str());
+	if (device.inputReplay.handle == 0u) {
+		printf("failed to open input replay '%s'\n", path.c_str());
+		return;
+	}
+	if (!SnortFs::replay_hasInputs(device.inputReplay)) {
+		printf(
+			"input replay '%s' has no inputs recorded, nothing is held\n",
+			path.c_str()
+		);
+	}
+	u64 rngSeed;
+	if (useReplaySeed && SnortFs::replay_rngSeed(device.inputReplay, rngSeed)) {
+		device.rngSeed = rngSeed;
+	}
+	u64 const offset = SnortFs::replay_instructionOffset(device.inputReplay);
+	printf(
+		"feeding inputs from '%s', instruction offsets %zu to %zu, rng seed "
+		"%zu\n",
+		path.c_str(), (size_t)offset,
+		(size_t)(offset + SnortFs::replay_instructionCount(device.inputReplay)),
+		(size_t)device.rngSeed
+	);
+}
+
+// --
+
+// returns whether recording should start once the device is created
+bool parseCommandLineArgs(
 	snort::Device & device,
 	SnortDeviceCreateInfo const * const ci
 ) {
@@ -92,9 +303,15 @@ void parseCommandLineArgs(
 			"start recording immediately",
 			cxxopts::value<bool>()->default_value("false")
 		)
+		(
+			"recording-start-offset",
+			"instruction offset to start recording at, the emulator runs "
+			"without capturing until then",
+			cxxopts::value<i32>()->default_value("0")
+		)
 		(
 			"target-instruction-count",
-			"number of instructions to record",
+			"number of instructions to record, from the start offset",
 			cxxopts::value<i32>()->default_value("10")
 		)
 		(
@@ -102,6 +319,106 @@ void parseCommandLineArgs(
 			"close emulator once recording finishes",
 			cxxopts::value<bool>()->default_value("false")
 		)
+		(
+			"keyframe-interval",
+			"instructions between replay keyframes, 0 picks it adaptively",
+			cxxopts::value<u64>()->default_value("0")
+		)
+		(
+			"replay-codec",
+			"codec to compress replay blocks with, one of none, rle or lz",
+			cxxopts::value<std::string>()->default_value("lz")
+		)
+		(
+			"async-replay-writer",
+			"encode and write the replay on a separate thread",
+			cxxopts::value<bool>()->default_value("false")
+		)
+		(
+			"rng-seed",
+			"seed of snort_rngU64, recorded in the replay header",
+			cxxopts::value<u64>()->default_value("1234")
+		)
+		(
+			"input-replay",
+			"feed the inputs recorded in a replay to the emulator instead of "
+			"the keyboard, and its rng seed unless --rng-seed is given",
+			cxxopts::value<std::string>()->default_value("")
+		)
+		(
+			"restore-replay",
+			"resume from a replay's memory at --restore-replay-instruction "
+			"once the emulator registers its writable regions",
+			cxxopts::value<std::string>()->default_value("")
+		)
+		(
+			"restore-replay-instruction",
+			"instruction index into the --restore-replay to resume from",
+			cxxopts::value<u64>()->default_value("0")
+		)
+		(
+			"hash-only-recording",
+			"record a hash per region for every --hash-interval instructions "
+			"instead of the diffs, snort-compare narrows a divergence down to "
+			"such a window",
+			cxxopts::value<bool>()->default_value("false")
+		)
+		(
+			"hash-interval",
+			"instructions per hash block of a hash-only recording",
+			cxxopts::value<u64>()->default_value("4096")
+		)
+		(
+			"check-dirty-ranges",
+			"compare ranges reported with snort_markDirty against a full scan",
+			cxxopts::value<bool>()->default_value("false")
+		)
+		(
+			"frame-budget-ms",
+			"time per frame to spend emulating, batch sizes adapt to fill it",
+			cxxopts::value<f64>()->default_value("8")
+		)
+		(
+			"step-back",
+			"keep what the last n instructions overwrote, so they can be "
+			"stepped back over. 0 disables it",
+			cxxopts::value<u64>()->default_value("0")
+		)
+		(
+			"step-back-mib",
+			"memory the step back log keeps the overwritten bytes in",
+			cxxopts::value<u64>()->default_value("16")
+		)
+		(
+			"flight-recorder",
+			"keep the last n instructions in memory, and write them to a "
+			"replay when triggered. 0 disables it",
+			cxxopts::value<u64>()->default_value("0")
+		)
+		(
+			"flight-recorder-mib",
+			"memory the flight recorder keeps the instructions in",
+			cxxopts::value<u64>()->default_value("64")
+		)
+		(
+			"flight-trigger",
+			"write the flight recorder out once a region's first element "
+			"equals a value, e.g. program-counter=0x2a4",
+			cxxopts::value<std::string>()->default_value("")
+		)
+		(
+			"lockstep",
+			"publish hashes of the regions to the snort-lockstep comparator of "
+			"this name, which halts both emulators at their first divergence",
+			cxxopts::value<std::string>()->default_value("")
+		)
+		(
+			"headless",
+			"run without a window, implies --start-recording and "
+			"--close-once-done-recording. With --flight-recorder or --lockstep "
+			"it runs to the target instruction offset without recording",
+			cxxopts::value<bool>()->default_value("false")
+		)
 	;
 	options.allow_unrecognised_options();
 
@@ -109,35 +426,195 @@ void parseCommandLineArgs(
 		options.parse(ci->argc, ci->argv)
 	);
 
-	device.targetInstructionCount = (
+	device.recordingStartOffset = result["recording-start-offset"].as<i32>();
+	device.recordingInstructionCount = (
 		result["target-instruction-count"].as<i32>()
 	);
+	device.targetInstructionCount = (
+		device.recordingStartOffset + device.recordingInstructionCount
+	);
 	device.closeOnceDoneRecording = (
 		result["close-once-done-recording"].as<bool>()
 	);
+	device.keyframeInterval = result["keyframe-interval"].as<u64>();
+	device.rngSeed = result["rng-seed"].as<u64>();
+	{
+		std::string const path = result["input-replay"].as<std::string>();
+		if (!path.empty()) {
+			::openInputReplay(device, path, result.count("rng-seed") == 0u);
+		}
+	}
+	device.restoreReplayFilepath = result["restore-replay"].as<std::string>();
+	device.restoreReplayInstruction = (
+		result["restore-replay-instruction"].as<u64>()
+	);
+	device.hashOnlyRecording = result["hash-only-recording"].as<bool>();
+	device.hashInterval = result["hash-interval"].as<u64>();
+	device.asyncReplayWriter = result["async-replay-writer"].as<bool>();
+	device.checkDirtyRanges = result["check-dirty-ranges"].as<bool>();
+	device.frameBudgetNanoseconds = (
+		(u64)(std::max(result["frame-budget-ms"].as<f64>(), 0.0) * 1e6)
+	);
+	device.isHeadless = result["headless"].as<bool>();
+	if (device.isHeadless) {
+		// nothing could start or stop the recording otherwise
+		device.closeOnceDoneRecording = true;
+	}
+	device.stepBackLog.instructionCapacity = result["step-back"].as<u64>();
+	device.stepBackByteCapacity = (
+		result["step-back-mib"].as<u64>() * 1024u * 1024u
+	);
+	device.flightRecorder.instructionCapacity = (
+		result["flight-recorder"].as<u64>()
+	);
+	device.flightRecorderByteCapacity = (
+		result["flight-recorder-mib"].as<u64>() * 1024u * 1024u
+	);
+	device.lockstepName = result["lockstep"].as<std::string>();
+	{
+		std::string const trigger = result["flight-trigger"].as<std::string>();
+		size_t const separator = trigger.find('=');
+		if (separator != std::string::npos) {
+			device.flightRecorder.triggerLabel = trigger.substr(0, separator);
+			device.flightRecorder.triggerValue = (
+				strtoull(trigger.c_str() + separator + 1u, nullptr, 0)
+			);
+		}
+		else if (!trigger.empty()) {
+			printf("flight trigger '%s' should be label=value\n", trigger.c_str());
+		}
+	}
+	{
+		std::string const codecName = result["replay-codec"].as<std::string>();
+		if (!SnortFs::replayCodec_fromName(codecName.c_str(), device.replayCodec)) {
+			printf(
+				"unknown replay codec '%s', recording uncompressed\n",
+				codecName.c_str()
+			);
+			device.replayCodec = SnortFs::kReplayCodec_none;
+		}
+	}
 
-	if (!result["start-recording"].as<bool>()) { return; }
-
-	device.isRecording = true;
-	device.isRecordingFirstFrame = true;
-	device.paused = false;
-	device.recordingFile = (
-		SnortFs::replayRecorder_open(
-			device.recordingFilepath.c_str(),
-			/*commonInterface=*/ device.commonInterface,
-			/*instructionOffset=*/ device.instructionCount,
-			/*regionCount=*/ device.currentMemoryRegion.size(),
-			/*regionCreateInfo=*/ device.memoryRegionCreateInfo.data()
+	// headless flight recording, step back and lockstep run to the target
+	//   without a recording, stepping back is refused while recording
+	bool const isHeadlessUnrecorded = (
+		   device.isHeadless
+		&& (
+			   device.flightRecorder.instructionCapacity > 0u
+			|| device.stepBackLog.instructionCapacity > 0u
+			|| !device.lockstepName.empty()
 		)
 	);
+	if (isHeadlessUnrecorded) {
+		device.paused = false;
+	}
+	return (
+		   result["start-recording"].as<bool>()
+		|| (device.isHeadless && !isHeadlessUnrecorded)
+	);
+}
+
+// --
+
+void displayConfiguration(snort::Device & device) {
+	ImGui::Begin("configuration");
+	ImGui::Checkbox("pause", &device.paused);
+	ImGui::SameLine();
+	if (ImGui::Button("step")) {
+		device.paused = false;
+		device.step = true;
+	}
+	if (
+		   snort::stepBack_isEnabled(device.stepBackLog)
+		&& !device.isRecording
+	) {
+		ImGui::SameLine();
+		if (ImGui::Button("step back")) {
+			snort::stepBack(device);
+		}
+		ImGui::SameLine();
+		ImGui::Text("(%zu)", device.stepBackLog.entryCount);
+	}
+	if (device.isRecording) {
+		ImGui::Text(
+			"recording, %zu / %d",
+			device.instructionCount,
+			device.targetInstructionCount
+		);
+		ImGui::Text(
+			"%.2f M instructions/s",
+			device.batchTiming.instructionsPerSecond / 1e6
+		);
+		if (device.asyncReplayWriter) {
+			SnortFs::ReplayRecorderStats const stats = (
+				SnortFs::replayRecorder_stats(device.recordingFile)
+			);
+			ImGui::Text(
+				"writer stalls: %zu (%.1f ms)",
+				(size_t)stats.writerStallCount,
+				(double)stats.writerStallNanoseconds / 1e6
+			);
+		}
+	}
+	else if (device.isFastForwarding) {
+		ImGui::Text(
+			"fast-forwarding, %zu / %d",
+			device.instructionCount,
+			device.recordingStartOffset
+		);
+		ImGui::Text(
+			"%.2f M instructions/s",
+			device.batchTiming.instructionsPerSecond / 1e6
+		);
+	}
+	else {
+		// an offset already passed starts recording straight away
+		ImGui::Text("instructions: %zu", device.instructionCount);
+		ImGui::Text("start instruction offset");
+		ImGui::InputInt(
+			"##start instruction offset",
+			&device.recordingStartOffset
+		);
+		ImGui::Text("instruction count");
+		ImGui::InputInt(
+			"##instruction count",
+			&device.recordingInstructionCount
+		);
+		if (ImGui::Button("Record")) {
+			snort::requestRecording(device);
+		}
+	}
+	if (snort::flightRecorder_isEnabled(device.flightRecorder)) {
+		ImGui::Text(
+			"flight recorder: %zu instructions, %.1f MiB",
+			device.flightRecorder.entryCount,
+			(double)device.flightRecorder.usedByteCount / (1024.0 * 1024.0)
+		);
+		if (ImGui::Button("dump flight recorder (F9)") || IsKeyPressed(KEY_F9)) {
+			snort::flightRecorder_dump(device, "key press");
+		}
+	}
+	if (!device.writableRegions.empty()) {
+		if (ImGui::Button("save state")) {
+			device.hasQuickState = snort::saveState(device, device.quickState);
+		}
+		if (device.hasQuickState && !device.isRecording) {
+			ImGui::SameLine();
+			if (ImGui::Button("restore state")) {
+				snort::restoreState(device, device.quickState);
+			}
+		}
+	}
+	ImGui::End();
 }
 
 } // namespace
 
 // --
 
-SnortDevice snort_deviceCreate(
-	SnortDeviceCreateInfo const * const ci
+SnortDevice snort::deviceCreate(
+	SnortDeviceCreateInfo const * const ci,
+	bool const isHostedCore
 ) {
 	printf("recording file path: %s\n", ci->recordingFilepath);
 
@@ -149,8 +626,22 @@ SnortDevice snort_deviceCreate(
 		.currentMemoryRegion = {},
 	};
 
+	// -- parse command line args
+	bool startRecordingRequested = parseCommandLineArgs(device, ci);
+
+	// -- a core under snort_runCores only keeps its own rng, inputs and
+	//    instruction count, the scheduler runs it
+	if (isHostedCore) {
+		device.isHeadless = true;
+		device.paused = false;
+		device.lockstepName.clear();
+		startRecordingRequested = false;
+	}
+
 	// -- initialize raylib + imgui
-	snort_displayInitialize();
+	if (!device.isHeadless) {
+		snort_displayInitialize();
+	}
 
 	// -- register memory regions
 	for (size_t it = 0; it < ci->memoryRegionCount; ++ it) {
@@ -163,7 +654,10 @@ SnortDevice snort_deviceCreate(
 		);
 		Image image {};
 		Texture2D texture {};
-		if (
+		if (device.isHeadless) {
+			// no textures without a window
+		}
+		else if (
 			   regionCi.dataType == kSnortDt_r1
 			|| regionCi.dataType == kSnortDt_r8
 		) {
@@ -201,8 +695,18 @@ SnortDevice snort_deviceCreate(
 		});
 	}
 
-	// -- parse command line args
-	parseCommandLineArgs(device, ci);
+	device.dirtyRanges.resize(ci->memoryRegionCount);
+	snort::flightRecorder_initialize(device);
+	snort::stepBack_initialize(device);
+	snort::lockstep_initialize(device);
+
+	// the recording's offset isn't known until the state is restored
+	if (startRecordingRequested && !device.restoreReplayFilepath.empty()) {
+		device.isRecordingRequestDeferred = true;
+	}
+	else if (startRecordingRequested) {
+		snort::requestRecording(device);
+	}
 
 	return SnortDevice {
 		.handle = (u64)(uintptr_t)(new snort::Device(std::move(device)))
@@ -211,15 +715,41 @@ SnortDevice snort_deviceCreate(
 
 // --
 
+SnortDevice snort_deviceCreate(SnortDeviceCreateInfo const * const ci) {
+	return snort::deviceCreate(ci, /*isHostedCore=*/ false);
+}
+
+// --
+
+SnortDevice snort_coreDeviceCreate(SnortDeviceCreateInfo const * const ci) {
+	return snort::deviceCreate(ci, /*isHostedCore=*/ true);
+}
+
+// --
+
 void snort_deviceDestroy(
 	SnortDevice * device
 ) {
 	if (device == nullptr || device->handle == 0) { return; }
 	snort::Device * devPtr = (snort::Device *)(uintptr_t)(device->handle);
+	bool const isHeadless = devPtr->isHeadless;
+	if (devPtr->inputReplay.handle != 0u) {
+		SnortFs::replay_close(devPtr->inputReplay);
+	}
+	snort::lockstep_destroy(*devPtr);
 	delete devPtr;
 	device->handle = 0;
 
-	snort_displayDestroy();
+	if (!isHeadless) {
+		snort_displayDestroy();
+	}
+}
+
+// --
+
+bool snort_isHeadless(SnortDevice const device) {
+	snort::Device * devPtr = (snort::Device *)(uintptr_t)(device.handle);
+	return devPtr->isHeadless;
 }
 
 // --
@@ -227,9 +757,10 @@ void snort_deviceDestroy(
 bool snort_shouldQuit([[maybe_unused]] SnortDevice const device)
 {
 	snort::Device * devPtr = (snort::Device *)(uintptr_t)(device.handle);
-	if (devPtr->closeOnceDoneRecording && !devPtr->isRecording) {
+	if (devPtr->closeOnceDoneRecording && snort::isSessionDone(*devPtr)) {
 		return true;
 	}
+	if (devPtr->isHeadless) { return false; }
 	return WindowShouldClose();
 }
 
@@ -241,39 +772,48 @@ u64 snort_startFrame(
 )
 {
 	auto & device = *(snort::Device *)(uintptr_t)(deviceHandle.handle);
-	snort_displayFrameBegin();
+	if (!device.isHeadless) {
+		snort_displayFrameBegin();
+		device.liveInputState = snort::input_sampleKeys(device);
+	}
 
-	// -- then store actual frame memory
-	for (size_t it = 0; it < device.currentMemoryRegion.size(); ++ it) {
-		auto & regionInfo = device.currentMemoryRegion[it];
-		auto & referenceData = memoryRegions[it].data;
-		memcpy(
-			regionInfo.currentData.data(),
-			referenceData,
-			regionInfo.byteCount
+	// currentData isn't refreshed here, it's the recording's diff reference
+	//   and snort_updateFrame keeps it in sync. Copying the memory in here
+	//   would also hide the changes of the previous frame's last instruction
+
+	if (!device.isHeadless) {
+		snort_displayMemory(
+			device.commonInterface,
+			device.currentMemoryRegion.size(),
+			device.memoryRegionCreateInfo.data(),
+			(u8 const * const *)memoryRegions,
+			nullptr
 		);
 	}
 
-	snort_displayMemory(
-		device.commonInterface,
-		device.currentMemoryRegion.size(),
-		device.memoryRegionCreateInfo.data(),
-		(u8 const * const *)memoryRegions,
-		nullptr
-	);
-
 	// -- return number of frames to run
+	device.frameBatchInstructionCount = 0u;
 	if (device.paused) {
+		snort::batchTiming_idle(device.batchTiming);
 		return 0u;
 	}
 	if (device.step) {
 		device.step = false;
 		return 1u;
 	}
-	if (device.isRecording) {
-		return 100u;
+	// as many as fit the frame budget, timed until snort_endFrame
+	size_t batchSize = (
+		snort::batchTiming_batchSize(
+			device.batchTiming,
+			device.frameBudgetNanoseconds
+		)
+	);
+	if (snort::isBatchClamped(device)) {
+		batchSize = std::min(batchSize, snort::recordingInstructionsLeft(device));
 	}
-	return 1u;
+	device.frameBatchInstructionCount = batchSize;
+	device.frameBatchStart = std::chrono::steady_clock::now();
+	return batchSize;
 }
 
 // --
@@ -284,23 +824,48 @@ void snort_updateFrame(
 ) {
 	auto & device = *(snort::Device *)(uintptr_t)(deviceHandle.handle);
 
-	// -- recording
-	if (!device.paused && device.isRecording) {
+	bool const isFlightRecording = (
+		snort::flightRecorder_isEnabled(device.flightRecorder)
+	);
+	// fast-forwarding is meant to skip ahead, so nothing is kept for it
+	bool const isKeepingStepBack = (
+		   snort::stepBack_isEnabled(device.stepBackLog)
+		&& !device.isFastForwarding
+	);
+
+	// -- reached the recording's start offset, the previous instructions
+	//   ran without any diffing
+	if (
+		   device.isFastForwarding
+		&& device.instructionCount >= (size_t)device.recordingStartOffset
+	) {
+		device.isFastForwarding = false;
+		snort::startRecording(device);
+	}
+
+	// -- capture, into the recording and/or the flight recorder
+	if (
+		   !device.paused
+		&& (device.isRecording || isFlightRecording || isKeepingStepBack)
+	) {
 		// if reached target instruction offset, return
 		if (
-			device.instructionCount >= (size_t)device.targetInstructionCount
+			   device.isRecording
+			&& device.instructionCount >= (size_t)device.targetInstructionCount
 		) {
 			return;
 		}
-		// -- full frame memory
-		if (device.isRecordingFirstFrame) {
+		// -- full frame memory, the recording's first instruction
+		bool const isRecordingDelta = (
+			device.isRecording && !device.isRecordingFirstFrame
+		);
+		if (device.isRecording && device.isRecordingFirstFrame) {
 			for (size_t it = 0; it < device.currentMemoryRegion.size(); ++ it) {
 				auto & regionInfo = device.currentMemoryRegion[it];
-				auto & referenceData = memoryRegions[it].data;
 				SnortFs::MemoryRegionDiffRecord diffRecord = {
 					.byteOffset = 0u,
 					.byteCount = regionInfo.byteCount,
-					.data = referenceData,
+					.data = memoryRegions[it].data,
 				};
 				SnortFs::replayRecorder_recordInstruction(
 					device.recordingFile,
@@ -308,14 +873,57 @@ void snort_updateFrame(
 					&diffRecord
 				);
 			}
+			device.isRecordingFirstFrame = false;
+		}
+		// -- the diff reference, stale until something captures
+		if (!device.isCurrentDataSynced) {
+			for (size_t it = 0; it < device.currentMemoryRegion.size(); ++ it) {
+				auto & regionInfo = device.currentMemoryRegion[it];
+				memcpy(
+					regionInfo.currentData.data(),
+					memoryRegions[it].data,
+					regionInfo.byteCount
+				);
+			}
+			device.isCurrentDataSynced = true;
+			// the full copy covers anything reported before it
+			for (auto & ranges : device.dirtyRanges) { ranges.clear(); }
+			if (isFlightRecording) {
+				snort::flightRecorder_reset(device, memoryRegions);
+			}
+			snort::stepBack_reset(device.stepBackLog);
 		}
 		// -- local delta frame memory
 		else {
+			if (isFlightRecording) {
+				snort::flightRecorder_beginInstruction(device.flightRecorder);
+			}
+			if (isKeepingStepBack) {
+				snort::stepBack_beginInstruction(device.stepBackLog);
+			}
 			for (size_t it = 0; it < device.currentMemoryRegion.size(); ++ it) {
-				::storeFrameDelta(device, memoryRegions, it);
+				::storeFrameDelta(
+					device, memoryRegions, it, isRecordingDelta, isKeepingStepBack
+				);
+			}
+			if (isKeepingStepBack) {
+				snort::stepBack_endInstruction(device.stepBackLog);
+			}
+			if (isFlightRecording) {
+				snort::flightRecorder_endInstruction(device);
+				snort::flightRecorder_checkTrigger(device, memoryRegions);
 			}
 		}
 	}
+	else {
+		// the emulator runs without anything keeping currentData up to date
+		device.isCurrentDataSynced = false;
+	}
+
+	// -- lockstep, the hashes of the memory the instruction starts from
+	if (device.lockstepChannel.handle != 0u && !device.paused) {
+		snort::lockstep_update(device, memoryRegions);
+	}
 
 	// -- increment instruction count
 	++ device.instructionCount;
@@ -323,80 +931,96 @@ void snort_updateFrame(
 
 // --
 
+f64 snort_instructionsPerSecond(SnortDevice const deviceHandle) {
+	auto & device = *(snort::Device *)(uintptr_t)(deviceHandle.handle);
+	return device.batchTiming.instructionsPerSecond;
+}
+
+// --
+
+void snort_flightRecorderTrigger(
+	SnortDevice const deviceHandle,
+	char const * const reason
+) {
+	auto & device = *(snort::Device *)(uintptr_t)(deviceHandle.handle);
+	snort::flightRecorder_dump(device, reason);
+}
+
+// --
+
+void snort_enableDirtyTracking(SnortDevice const deviceHandle) {
+	auto & device = *(snort::Device *)(uintptr_t)(deviceHandle.handle);
+	device.isDirtyTracking = true;
+}
+
+// --
+
+void snort_markDirty(
+	SnortDevice const deviceHandle,
+	u64 const regionIndex,
+	u64 const byteOffset,
+	u64 const byteCount
+) {
+	auto & device = *(snort::Device *)(uintptr_t)(deviceHandle.handle);
+	if (!device.isDirtyTracking || !device.isCurrentDataSynced) { return; }
+	if (regionIndex >= device.currentMemoryRegion.size()) {
+		printf("snort_markDirty: invalid region index %zu\n", (size_t)regionIndex);
+		return;
+	}
+	// clamp to the region, so the diff never reads past the emulator's memory
+	u64 const regionByteCount = device.currentMemoryRegion[regionIndex].byteCount;
+	if (byteOffset >= regionByteCount || byteCount == 0u) { return; }
+	device.dirtyRanges[regionIndex].push_back(snort::DirtyRange {
+		.byteOffset = byteOffset,
+		.byteCount = std::min(byteCount, regionByteCount - byteOffset),
+	});
+}
+
+// --
+
 void snort_endFrame(SnortDevice const deviceHandle) {
 	auto & device = *(snort::Device *)(uintptr_t)(deviceHandle.handle);
 
+	// -- time the batch handed out by snort_startFrame
+	if (device.frameBatchInstructionCount > 0u) {
+		auto const elapsed = (
+			std::chrono::steady_clock::now() - device.frameBatchStart
+		);
+		snort::batchTiming_record(
+			device.batchTiming,
+			device.frameBatchInstructionCount,
+			(u64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				elapsed
+			).count()
+		);
+		device.frameBatchInstructionCount = 0u;
+	}
+
 	if (device.step) {
 		// if stepping, pause after one frame
 		device.paused = true;
 	}
 	// -- imgui updates
-	{
-		ImGui::Begin("configuration");
-		ImGui::Checkbox("pause", &device.paused);
-		ImGui::SameLine();
-		if (ImGui::Button("step")) {
-			device.paused = false;
-			device.step = true;
-		}
-		if (device.isRecording) {
-			ImGui::Text(
-				"recording, %zu / %d",
-				device.instructionCount,
-				device.targetInstructionCount
-			);
-		}
-		else if (device.instructionCount == 0u) {
-			// allow user to start recording on first frame, for now
-			// in future they can pick an offset and total count
-			ImGui::Text("target instruction offset");
-			ImGui::InputInt(
-				"##target instruction offset",
-				&device.targetInstructionCount
-			);
-			if (ImGui::Button("Record")) {
-				device.recordingFile = (
-					SnortFs::replayRecorder_open(
-						device.recordingFilepath.c_str(),
-						/*commonInterface=*/ device.commonInterface,
-						/*instructionOffset=*/ device.instructionCount,
-						/*regionCount=*/ device.currentMemoryRegion.size(),
-						/*regionCreateInfo=*/ device.memoryRegionCreateInfo.data()
-					)
-				);
-				if (device.recordingFile.handle == 0) {
-					printf("failed to start recording\n");
-				}
-				else {
-					device.isRecording = true;
-					device.isRecordingFirstFrame = true;
-				}
-				device.paused = false;
-			}
-		}
-		ImGui::End();
+	if (!device.isHeadless) {
+		::displayConfiguration(device);
 	}
 
 	// -- pause check
 	if (device.paused) {
-		snort_displayFrameEnd();
+		if (!device.isHeadless) {
+			// nothing will change until the user does something
+			snort_displaySetIdle(true);
+			snort_displayFrameEnd();
+		}
 		return;
 	}
 
 	// -- close if reached target instruction offset
-	if (
-		device.isRecording
-		&& device.instructionCount >= (size_t)device.targetInstructionCount
-	) {
-		SnortFs::replayRecorder_close(device.recordingFile);
-		device.isRecording = false;
-		printf(
-			"stopped recording at instruction offset %zu\n",
-			device.instructionCount
-		);
-		device.paused = true;
-	}
+	snort::closeFinishedRecording(device);
 
 	// -- display
-	snort_displayFrameEnd();
+	if (!device.isHeadless) {
+		snort_displaySetIdle(device.paused);
+		snort_displayFrameEnd();
+	}
 }
@@ -4,7 +4,12 @@
 
 #include <snort/snort.h>
 #include <snort-replay/fs.hpp>
+#include <snort-replay/lockstep.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <vector>
 #include <string>
 
@@ -14,11 +19,45 @@
 
 namespace snort {
 
+// -- batch timing, sizes batches to fill a time budget from how long recent
+//   instructions took to emulate and record
+
+// before anything is measured, and the bounds after
+constexpr size_t kInitialBatchInstructionCount { 100u };
+constexpr size_t kMaxBatchInstructionCount { 1u << 20u };
+
+struct BatchTiming {
+	// smoothed over recent batches, zero until the first one
+	f64 nanosecondsPerInstruction { 0.0 };
+	// wall clock throughput, refreshed about twice a second and zero while
+	//   idle
+	f64 instructionsPerSecond { 0.0 };
+	std::chrono::steady_clock::time_point rateWindowStart {};
+	size_t rateWindowInstructionCount { 0u };
+};
+
+size_t batchTiming_batchSize(
+	BatchTiming const & timing,
+	u64 const budgetNanoseconds
+);
+void batchTiming_record(
+	BatchTiming & timing,
+	size_t const instructionCount,
+	u64 const elapsedNanoseconds
+);
+// nothing ran, e.g. paused, so throughput restarts from zero
+void batchTiming_idle(BatchTiming & timing);
+
 struct MemoryRegionDelta {
 	u64 byteOffset;
 	std::vector<uint8_t> deltaData;
 };
 
+struct DirtyRange {
+	u64 byteOffset;
+	u64 byteCount;
+};
+
 struct MemoryRegionInfo {
 	SnortDt const dataType;
 	size_t const byteCount;
@@ -29,6 +68,143 @@ struct MemoryRegionInfo {
 	std::vector<uint8_t> currentData;
 };
 
+// -- flight recorder, keeps the diffs of the last instructions in memory so
+//   they can be written out as a replay when something goes wrong, without
+//   recording the whole run. See --flight-recorder
+
+struct FlightRecorderEntry {
+	size_t byteOffset;
+	size_t byteCount;
+};
+
+// instructions are stored as the changed region count (u32), then per
+//   changed region its index (u32), diff count (u32) and per diff the byte
+//   offset (u32), byte count (u32) and bytes. Unchanged instructions take
+//   four bytes
+struct FlightRecorder {
+	// instructions kept, zero disables the flight recorder
+	u64 instructionCapacity { 0u };
+	// memory of every region as of baseInstruction, the oldest instruction
+	//   is folded into it whenever one is evicted
+	std::vector<std::vector<u8>> base {};
+	size_t baseInstruction { 0u };
+	// instructions after the base, oldest first, their bytes wrap around
+	//   the byte ring but each instruction is contiguous
+	std::vector<u8> bytes {};
+	std::vector<FlightRecorderEntry> entries {};
+	size_t entryHead { 0u };
+	size_t entryCount { 0u };
+	size_t writeOffset { 0u };
+	size_t usedByteCount { 0u };
+	// the instruction being captured, copied into the ring once complete
+	std::vector<u8> staging {};
+	size_t stagingRegionCount { 0u };
+	// dumps once the region's first element equals the value, one-shot
+	std::string triggerLabel {};
+	u64 triggerValue { 0u };
+	i64 triggerRegionIndex { -1 };
+	size_t dumpCount { 0u };
+};
+
+// -- save states, the memory of every region and what follows from the
+//   instruction count, see snort_saveState
+
+struct SavedState {
+	size_t instructionCount { 0u };
+	u64 rngSeed { 0u };
+	std::vector<std::vector<u8>> regionData {};
+};
+
+// -- step back, keeps the bytes the last instructions overwrote so they can
+//   be undone one at a time without re-running anything. See --step-back
+
+struct StepBackEntry {
+	size_t byteOffset;
+	size_t byteCount;
+};
+
+// instructions are stored in the flight recorder's layout, with the bytes as
+//   they were before the instruction. The oldest are dropped to make room
+struct StepBackLog {
+	// instructions kept, zero disables stepping back
+	u64 instructionCapacity { 0u };
+	std::vector<u8> bytes {};
+	std::vector<StepBackEntry> entries {};
+	size_t entryHead { 0u };
+	size_t entryCount { 0u };
+	size_t writeOffset { 0u };
+	size_t usedByteCount { 0u };
+	std::vector<u8> staging {};
+	size_t stagingRegionCount { 0u };
+};
+
+// -- snort_run state, the emulation thread owns the device while running and
+//   the ui thread only sees the controls and snapshot, under the mutex
+
+// what the ui asks for, applied and cleared by the emulation thread between
+//   batches
+struct RunControls {
+	bool requestPause;
+	bool requestResume;
+	bool requestStep;
+	// starts recording the window below, fast-forwarding to it first
+	bool requestRecording;
+	bool requestFlightDump;
+	// into and out of the device's quick save slot
+	bool requestSaveState;
+	bool requestRestoreState;
+	bool requestStepBack;
+	// the keys held on the ui thread, the emulation thread's live input
+	u64 inputState;
+	i32 recordingStartOffset;
+	i32 recordingInstructionCount;
+	bool quit;
+	// bumped by the ui every time it sends requests
+	u64 generation;
+};
+
+// a consistent copy of the device for the ui to display
+struct RunSnapshot {
+	std::vector<std::vector<u8>> regionData {};
+	size_t instructionCount { 0u };
+	bool paused { true };
+	bool isRecording { false };
+	bool isFastForwarding { false };
+	i32 recordingStartOffset { 0 };
+	i32 targetInstructionCount { 0 };
+	f64 instructionsPerSecond { 0.0 };
+	SnortFs::ReplayRecorderStats recorderStats {};
+	size_t flightInstructionCount { 0u };
+	size_t flightByteCount { 0u };
+	bool hasQuickState { false };
+	size_t stepBackInstructionCount { 0u };
+	// fixed before the run starts, copied so the ui never reads the device
+	bool isAsyncReplayWriter { false };
+	bool isFlightRecorderEnabled { false };
+	bool hasWritableRegions { false };
+	// the controls generation applied before this snapshot, so the ui knows
+	//   its requests have been seen
+	u64 controlsGeneration { 0u };
+};
+
+struct RunState {
+	std::mutex mutex {};
+	std::condition_variable wake {};
+	RunControls controls {};
+	// published by the emulation thread, swapped out by the ui thread
+	RunSnapshot snapshot {};
+	bool isSnapshotFresh { false };
+	// set once the emulation thread returns, e.g. done recording headless
+	bool isFinished { false };
+	// checked every batch without the lock
+	std::atomic<bool> hasControlsChanged { false };
+	std::atomic<bool> isSnapshotRequested { false };
+};
+
+// time the emulation thread runs between checking on the ui, small enough
+//   that pausing and snapshots stay well under a display frame
+constexpr u64 kRunBatchBudgetNanoseconds { 2'000'000u };
+
 struct Device {
 	std::string const name;
 	std::string const recordingFilepath;
@@ -36,19 +212,199 @@ struct Device {
 	std::vector<MemoryRegionInfo> currentMemoryRegion;
 	std::vector<SnortMemoryRegionCreateInfo> memoryRegionCreateInfo;
 
+	// no window, display or imgui, see --headless
+	bool isHeadless { false };
+
 	// -- emulator state
-	u64 rngSeed { 1234u };
 	size_t instructionCount { 0 };
+	// the rng is counter based, see snort::rng_value, so its whole state at
+	//   an instruction boundary is the seed and the instruction count
+	u64 rngSeed { 1234u };
+	size_t rngInstruction { 0 };
+	u64 rngDrawCount { 0 };
+	// latched the first time an instruction polls it, see snort_inputState
+	u64 inputState { 0u };
+	size_t inputInstruction { ~(size_t)0 };
+	// the keys as of the last display frame, what's latched unless the
+	//   inputs come from a replay
+	u64 liveInputState { 0u };
+	// see --input-replay
+	SnortFs::ReplayFile inputReplay { 0 };
 	mutable bool paused { true };
 	mutable bool step { false };
 
+	// -- frame batches, see snort_startFrame
+	// time per frame to spend emulating, see --frame-budget-ms
+	u64 frameBudgetNanoseconds { 8'000'000u };
+	BatchTiming batchTiming {};
+	// the batch handed out by the last snort_startFrame, timed until
+	//   snort_endFrame
+	size_t frameBatchInstructionCount { 0u };
+	std::chrono::steady_clock::time_point frameBatchStart {};
+
 	// -- recording
 	mutable bool isRecording { false };
 	// lets device know to diff everything first frame
 	mutable bool isRecordingFirstFrame { true };
+	// the recording window, see --recording-start-offset and
+	//   --target-instruction-count. Until the start offset the emulator runs
+	//   without capturing anything
+	i32 recordingStartOffset { 0 };
+	i32 recordingInstructionCount { 10 };
+	bool isFastForwarding { false };
+	// currentData matches the emulator's memory as of the last
+	//   snort_updateFrame, false until something captures
+	bool isCurrentDataSynced { false };
 	mutable SnortFs::ReplayFileRecorder recordingFile { 0 };
+	// the instruction offset the recording stops at
 	mutable i32 targetInstructionCount { 10 };
 	mutable bool closeOnceDoneRecording { false };
+	// reused by every storeFrameDelta call, so recording doesn't allocate
+	std::vector<SnortFs::MemoryRegionDiffRecord> recordDeltaScratch {};
+	// instructions between replay keyframes, 0 is adaptive
+	u64 keyframeInterval { 0 };
+	SnortFs::ReplayCodec replayCodec { SnortFs::kReplayCodec_lz };
+	// encode and write the replay on a separate thread
+	bool asyncReplayWriter { false };
+	// only hashes, see --hash-only-recording
+	bool hashOnlyRecording { false };
+	u64 hashInterval { 4096u };
+
+	// -- dirty range tracking
+	bool isDirtyTracking { false };
+	// cross-checks the reported ranges against a full scan
+	bool checkDirtyRanges { false };
+	// ranges reported since the last recorded instruction, per region
+	std::vector<std::vector<DirtyRange>> dirtyRanges {};
+	std::vector<SnortFs::MemoryRegionDiffRecord> dirtyCheckScratch {};
+
+	// -- save states
+	// the emulator's memory, see snort_setWritableRegions. Empty until it's
+	//   registered, states can't be saved or restored before then
+	std::vector<u8 *> writableRegions {};
+	// --restore-replay, it and any recording requested at creation wait for
+	//   the writable regions
+	std::string restoreReplayFilepath {};
+	u64 restoreReplayInstruction { 0u };
+	bool isRecordingRequestDeferred { false };
+	// the ui's save state button
+	SavedState quickState {};
+	bool hasQuickState { false };
+
+	// -- step back
+	StepBackLog stepBackLog {};
+	// the step back log's byte ring, see --step-back-mib
+	size_t stepBackByteCapacity { 16u * 1024u * 1024u };
+
+	// -- flight recorder
+	FlightRecorder flightRecorder {};
+	// the flight recorder's byte ring, see --flight-recorder-mib
+	size_t flightRecorderByteCapacity { 64u * 1024u * 1024u };
+
+	// -- lockstep, see --lockstep
+	std::string lockstepName {};
+	SnortFs::LockstepChannel lockstepChannel { 0 };
+	// the comparator's, instructions between published hashes
+	u64 lockstepInterval { 1u };
+	size_t lockstepPublishCount { 0u };
+	std::vector<u64> lockstepHashes {};
+	// the comparator halted this side, it stays paused
+	bool isLockstepHalted { false };
 };
 
+// the draw'th random number of an instruction, O(1) to skip to any
+//   instruction since there's no state carried between them
+u64 rng_value(u64 const seed, u64 const instruction, u64 const draw);
+
+// the chip8 keypad's keys held down, one bit per key. Only call it from the
+//   thread that owns the window
+u64 input_sampleKeys(Device const & device);
+
+// write the state back through the writable regions, refused while
+//   recording. Restoring from a replay also takes its rng seed
+bool saveState(Device const & device, SavedState & state);
+bool restoreState(Device & device, SavedState const & state);
+bool restoreStateFromReplay(
+	Device & device,
+	char const * const replayPath,
+	u64 const instructionIndex
+);
+
+bool stepBack_isEnabled(StepBackLog const & log);
+// allocates the rings
+void stepBack_initialize(Device & device);
+// forgets every instruction, e.g. once currentData is resynced
+void stepBack_reset(StepBackLog & log);
+void stepBack_beginInstruction(StepBackLog & log);
+// previousData is the region's currentData, before the diffs are applied
+void stepBack_recordRegion(
+	StepBackLog & log,
+	size_t const regionIndex,
+	std::vector<SnortFs::MemoryRegionDiffRecord> const & diffs,
+	u8 const * const previousData
+);
+void stepBack_endInstruction(StepBackLog & log);
+// undoes the newest instruction and pauses, refused while recording
+bool stepBack(Device & device);
+
+// a core hosted by snort_runCores is headless and never records
+SnortDevice deviceCreate(
+	SnortDeviceCreateInfo const * const ci,
+	bool const isHostedCore
+);
+SnortDevice deviceCreateFromCommon(
+	SnortCommonInterface const type,
+	char const * const customLabel,
+	char const * const romPath,
+	i32 const argc,
+	char const * const * const argv,
+	bool const isHostedCore
+);
+
+// shared between the frame api and snort_run
+bool startRecording(Device & device);
+// records the recording window, starting now if the start offset has passed
+//   and fast-forwarding to it otherwise
+void requestRecording(Device & device);
+// closes the recording once it reaches the target instruction count
+void closeFinishedRecording(Device & device);
+// instructions until the recording reaches its target, batches stop there
+size_t recordingInstructionsLeft(Device const & device);
+// whether batches should stop at the recording's target
+bool isBatchClamped(Device const & device);
+// whether --close-once-done-recording should quit, headless flight recording
+//   runs to the target instruction count without a recording
+bool isSessionDone(Device const & device);
+
+bool flightRecorder_isEnabled(FlightRecorder const & recorder);
+// allocates the rings, call once the regions are registered
+void flightRecorder_initialize(Device & device);
+// starts over from the current memory
+void flightRecorder_reset(Device & device, SnortMemoryRegion const * regions);
+void flightRecorder_beginInstruction(FlightRecorder & recorder);
+void flightRecorder_recordRegion(
+	FlightRecorder & recorder,
+	size_t const regionIndex,
+	std::vector<SnortFs::MemoryRegionDiffRecord> const & diffs
+);
+void flightRecorder_endInstruction(Device & device);
+void flightRecorder_checkTrigger(
+	Device & device,
+	SnortMemoryRegion const * regions
+);
+// attaches to --lockstep's channel, if any
+void lockstep_initialize(Device & device);
+void lockstep_destroy(Device & device);
+// publishes the regions' hashes every lockstep interval, and halts once the
+//   comparator says so
+void lockstep_update(Device & device, SnortMemoryRegion const * regions);
+// the comparator pairs records up in order, so once anything is published
+//   the instruction count can't jump
+bool lockstep_isStarted(Device const & device);
+
+// forgets the newest instruction, after it's been stepped back over
+void flightRecorder_dropNewest(Device & device);
+// writes the base and every instruction in the ring to a new replay
+bool flightRecorder_dump(Device & device, char const * const reason);
+
 } // namespace snort
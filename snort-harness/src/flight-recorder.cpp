@@ -0,0 +1,364 @@
+#include "device.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace {
+
+void stagingAppendU32(std::vector<u8> & staging, u32 const value) {
+	size_t const offset = staging.size();
+	staging.resize(offset + sizeof(u32));
+	memcpy(staging.data() + offset, &value, sizeof(u32));
+}
+
+u32 readU32(u8 const * & ptr) {
+	u32 value;
+	memcpy(&value, ptr, sizeof(u32));
+	ptr += sizeof(u32);
+	return value;
+}
+
+// --
+
+// calls onRegion(regionIndex, diffCount, diffBytes) for every changed region
+//   of the instruction, diffBytes points at the first diff's byte offset
+template <typename Fn>
+void forEachChangedRegion(u8 const * ptr, Fn && onRegion) {
+	u32 const changedRegionCount = ::readU32(ptr);
+	for (u32 it = 0; it < changedRegionCount; ++ it) {
+		u32 const regionIndex = ::readU32(ptr);
+		u32 const diffCount = ::readU32(ptr);
+		u8 const * const diffBytes = ptr;
+		for (u32 diff = 0; diff < diffCount; ++ diff) {
+			ptr += sizeof(u32);
+			u32 const byteCount = ::readU32(ptr);
+			ptr += byteCount;
+		}
+		onRegion(regionIndex, diffCount, diffBytes);
+	}
+}
+
+// --
+
+void applyToBase(snort::FlightRecorder & recorder, u8 const * instruction) {
+	::forEachChangedRegion(
+		instruction,
+		[&](u32 const regionIndex, u32 const diffCount, u8 const * ptr) {
+			auto & base = recorder.base[regionIndex];
+			for (u32 diff = 0; diff < diffCount; ++ diff) {
+				u32 const byteOffset = ::readU32(ptr);
+				u32 const byteCount = ::readU32(ptr);
+				memcpy(base.data() + byteOffset, ptr, byteCount);
+				ptr += byteCount;
+			}
+		}
+	);
+	++ recorder.baseInstruction;
+}
+
+// --
+
+// folds the oldest instruction into the base
+void evictOldest(snort::FlightRecorder & recorder) {
+	auto const & entry = recorder.entries[recorder.entryHead];
+	::applyToBase(recorder, recorder.bytes.data() + entry.byteOffset);
+	recorder.usedByteCount -= entry.byteCount;
+	recorder.entryHead = (recorder.entryHead + 1u) % recorder.entries.size();
+	-- recorder.entryCount;
+}
+
+} // namespace
+
+// --
+
+bool snort::flightRecorder_isEnabled(snort::FlightRecorder const & recorder) {
+	return recorder.instructionCapacity > 0u;
+}
+
+// --
+
+void snort::flightRecorder_initialize(snort::Device & device) {
+	auto & recorder = device.flightRecorder;
+	if (!snort::flightRecorder_isEnabled(recorder)) { return; }
+	recorder.base.resize(device.currentMemoryRegion.size());
+	for (size_t it = 0; it < device.currentMemoryRegion.size(); ++ it) {
+		recorder.base[it].resize(device.currentMemoryRegion[it].byteCount);
+	}
+	recorder.bytes.resize(device.flightRecorderByteCapacity);
+	recorder.entries.resize(recorder.instructionCapacity);
+
+	// -- resolve the trigger region
+	if (recorder.triggerLabel.empty()) { return; }
+	for (size_t it = 0; it < device.currentMemoryRegion.size(); ++ it) {
+		if (device.currentMemoryRegion[it].label == recorder.triggerLabel) {
+			recorder.triggerRegionIndex = (i64)it;
+			return;
+		}
+	}
+	printf(
+		"flight recorder trigger region '%s' not found\n",
+		recorder.triggerLabel.c_str()
+	);
+}
+
+// --
+
+void snort::flightRecorder_reset(
+	snort::Device & device,
+	SnortMemoryRegion const * regions
+) {
+	auto & recorder = device.flightRecorder;
+	for (size_t it = 0; it < recorder.base.size(); ++ it) {
+		memcpy(
+			recorder.base[it].data(), regions[it].data, recorder.base[it].size()
+		);
+	}
+	recorder.baseInstruction = device.instructionCount;
+	recorder.entryHead = 0u;
+	recorder.entryCount = 0u;
+	recorder.writeOffset = 0u;
+	recorder.usedByteCount = 0u;
+}
+
+// --
+
+void snort::flightRecorder_beginInstruction(snort::FlightRecorder & recorder) {
+	recorder.staging.clear();
+	recorder.stagingRegionCount = 0u;
+	::stagingAppendU32(recorder.staging, 0u);
+}
+
+// --
+
+void snort::flightRecorder_recordRegion(
+	snort::FlightRecorder & recorder,
+	size_t const regionIndex,
+	std::vector<SnortFs::MemoryRegionDiffRecord> const & diffs
+) {
+	if (diffs.empty()) { return; }
+	++ recorder.stagingRegionCount;
+	::stagingAppendU32(recorder.staging, (u32)regionIndex);
+	::stagingAppendU32(recorder.staging, (u32)diffs.size());
+	for (auto const & diff : diffs) {
+		::stagingAppendU32(recorder.staging, (u32)diff.byteOffset);
+		::stagingAppendU32(recorder.staging, (u32)diff.byteCount);
+		recorder.staging.insert(
+			recorder.staging.end(), diff.data, diff.data + diff.byteCount
+		);
+	}
+}
+
+// --
+
+void snort::flightRecorder_endInstruction(snort::Device & device) {
+	auto & recorder = device.flightRecorder;
+	u32 const changedRegionCount = (u32)recorder.stagingRegionCount;
+	memcpy(recorder.staging.data(), &changedRegionCount, sizeof(u32));
+	size_t const byteCount = recorder.staging.size();
+
+	// -- too big for the ring, nothing older can be kept either
+	if (byteCount > recorder.bytes.size()) {
+		while (recorder.entryCount > 0u) { ::evictOldest(recorder); }
+		::applyToBase(recorder, recorder.staging.data());
+		recorder.writeOffset = 0u;
+		return;
+	}
+
+	// -- make room, for the entry and for the bytes
+	if (recorder.entryCount == recorder.entries.size()) {
+		::evictOldest(recorder);
+	}
+	if (recorder.writeOffset + byteCount > recorder.bytes.size()) {
+		// instructions are contiguous, so wrap instead of splitting it.
+		//   Whatever is left between the write offset and the end is evicted
+		while (
+			   recorder.entryCount > 0u
+			&& (
+				  recorder.entries[recorder.entryHead].byteOffset
+				>= recorder.writeOffset
+			)
+		) {
+			::evictOldest(recorder);
+		}
+		recorder.writeOffset = 0u;
+	}
+	// the oldest instruction is the first live byte after the write offset
+	while (recorder.entryCount > 0u) {
+		size_t const oldestOffset = (
+			recorder.entries[recorder.entryHead].byteOffset
+		);
+		bool const overlaps = (
+			   oldestOffset >= recorder.writeOffset
+			&& oldestOffset < recorder.writeOffset + byteCount
+		);
+		if (!overlaps) { break; }
+		::evictOldest(recorder);
+	}
+
+	// -- append
+	memcpy(
+		recorder.bytes.data() + recorder.writeOffset,
+		recorder.staging.data(),
+		byteCount
+	);
+	size_t const entryIndex = (
+		(recorder.entryHead + recorder.entryCount) % recorder.entries.size()
+	);
+	recorder.entries[entryIndex] = snort::FlightRecorderEntry {
+		.byteOffset = recorder.writeOffset,
+		.byteCount = byteCount,
+	};
+	++ recorder.entryCount;
+	recorder.writeOffset += byteCount;
+	recorder.usedByteCount += byteCount;
+}
+
+// --
+
+void snort::flightRecorder_dropNewest(snort::Device & device) {
+	auto & recorder = device.flightRecorder;
+	// -- everything was folded into the base, which starts over from the
+	//    memory before the instruction. The instruction count is still one
+	//    past the undone instruction's, which currentData is now from before
+	if (recorder.entryCount == 0u) {
+		for (size_t it = 0; it < recorder.base.size(); ++ it) {
+			recorder.base[it] = device.currentMemoryRegion[it].currentData;
+		}
+		recorder.baseInstruction = device.instructionCount - 2u;
+		return;
+	}
+	size_t const entryIndex = (
+		(recorder.entryHead + recorder.entryCount - 1u) % recorder.entries.size()
+	);
+	auto const & entry = recorder.entries[entryIndex];
+	recorder.usedByteCount -= entry.byteCount;
+	recorder.writeOffset = entry.byteOffset;
+	-- recorder.entryCount;
+}
+
+// --
+
+void snort::flightRecorder_checkTrigger(
+	snort::Device & device,
+	SnortMemoryRegion const * regions
+) {
+	auto & recorder = device.flightRecorder;
+	if (recorder.triggerRegionIndex < 0) { return; }
+	size_t const regionIndex = (size_t)recorder.triggerRegionIndex;
+	u64 value = 0u;
+	memcpy(
+		&value,
+		regions[regionIndex].data,
+		std::min(device.currentMemoryRegion[regionIndex].byteStride, sizeof(u64))
+	);
+	if (value != recorder.triggerValue) { return; }
+	recorder.triggerRegionIndex = -1;
+	std::string const reason = (
+		recorder.triggerLabel + " reached " + std::to_string(value)
+	);
+	snort::flightRecorder_dump(device, reason.c_str());
+}
+
+// --
+
+bool snort::flightRecorder_dump(
+	snort::Device & device,
+	char const * const reason
+) {
+	auto & recorder = device.flightRecorder;
+	if (!snort::flightRecorder_isEnabled(recorder)) { return false; }
+	if (!device.isCurrentDataSynced) {
+		printf("flight recorder is empty, nothing has run since it started\n");
+		return false;
+	}
+
+	// -- the recording path, with the last instruction appended
+	size_t const lastInstruction = (
+		recorder.baseInstruction + recorder.entryCount
+	);
+	std::string filepath = device.recordingFilepath;
+	if (filepath.size() > 4u && filepath.ends_with(".rpl")) {
+		filepath.resize(filepath.size() - 4u);
+	}
+	filepath += "-flight-" + std::to_string(lastInstruction) + ".rpl";
+
+	SnortFs::ReplayFileRecorder file = (
+		SnortFs::replayRecorder_open(
+			filepath.c_str(),
+			/*commonInterface=*/ device.commonInterface,
+			/*instructionOffset=*/ recorder.baseInstruction,
+			/*regionCount=*/ device.currentMemoryRegion.size(),
+			/*regionCreateInfo=*/ device.memoryRegionCreateInfo.data(),
+			/*options=*/ {
+				.keyframeInterval = device.keyframeInterval,
+				.codec = device.replayCodec,
+				.hasRngSeed = true,
+				.rngSeed = device.rngSeed,
+			}
+		)
+	);
+	if (file.handle == 0) {
+		printf("failed to dump the flight recorder to '%s'\n", filepath.c_str());
+		return false;
+	}
+
+	// -- the base is the first instruction, like a recording's first frame
+	for (size_t it = 0; it < recorder.base.size(); ++ it) {
+		SnortFs::MemoryRegionDiffRecord const diffRecord = {
+			.byteOffset = 0u,
+			.byteCount = recorder.base[it].size(),
+			.data = recorder.base[it].data(),
+		};
+		SnortFs::replayRecorder_recordInstruction(file, 1u, &diffRecord);
+	}
+
+	// -- then every instruction in the ring, every region in order
+	auto & records = device.recordDeltaScratch;
+	for (size_t entryIt = 0; entryIt < recorder.entryCount; ++ entryIt) {
+		size_t const entryIndex = (
+			(recorder.entryHead + entryIt) % recorder.entries.size()
+		);
+		auto const & entry = recorder.entries[entryIndex];
+		size_t nextRegion = 0u;
+		auto const recordUnchangedUntil = [&](size_t const regionIndex) {
+			for (; nextRegion < regionIndex; ++ nextRegion) {
+				SnortFs::replayRecorder_recordInstruction(file, 0u, nullptr);
+			}
+		};
+		::forEachChangedRegion(
+			recorder.bytes.data() + entry.byteOffset,
+			[&](u32 const regionIndex, u32 const diffCount, u8 const * ptr) {
+				recordUnchangedUntil(regionIndex);
+				records.clear();
+				for (u32 diff = 0; diff < diffCount; ++ diff) {
+					u32 const byteOffset = ::readU32(ptr);
+					u32 const byteCount = ::readU32(ptr);
+					records.emplace_back(SnortFs::MemoryRegionDiffRecord {
+						.byteOffset = byteOffset,
+						.byteCount = byteCount,
+						.data = ptr,
+					});
+					ptr += byteCount;
+				}
+				SnortFs::replayRecorder_recordInstruction(
+					file, records.size(), records.data()
+				);
+				++ nextRegion;
+			}
+		);
+		recordUnchangedUntil(recorder.base.size());
+	}
+	records.clear();
+
+	SnortFs::replayRecorder_close(file);
+	++ recorder.dumpCount;
+	printf(
+		"flight recorder dumped instructions %zu to %zu to '%s', trigger: %s\n",
+		recorder.baseInstruction,
+		lastInstruction,
+		filepath.c_str(),
+		reason
+	);
+	return true;
+}
@@ -0,0 +1,72 @@
+#include "device.hpp"
+
+#include <snort/snort-ui.h>
+
+namespace {
+
+// the usual layout, the keypad's 4x4 grid on the left of the keyboard
+//   1 2 3 C    1 2 3 4
+//   4 5 6 D    q w e r
+//   7 8 9 E    a s d f
+//   A 0 B F    z x c v
+constexpr KeyboardKey kChip8Keymap[16] = {
+	KEY_X,
+	KEY_ONE, KEY_TWO, KEY_THREE,
+	KEY_Q, KEY_W, KEY_E,
+	KEY_A, KEY_S, KEY_D,
+	KEY_Z, KEY_C,
+	KEY_FOUR, KEY_R, KEY_F, KEY_V,
+};
+
+} // namespace
+
+// --
+
+u64 snort::input_sampleKeys(snort::Device const & device) {
+	if (device.commonInterface != kSnortCommonInterface_chip8) { return 0u; }
+	u64 inputState = 0u;
+	for (u64 it = 0; it < 16u; ++ it) {
+		if (IsKeyDown(kChip8Keymap[it])) {
+			inputState |= 1ull << it;
+		}
+	}
+	return inputState;
+}
+
+// --
+
+u64 snort_inputState(SnortDevice const deviceHandle) {
+	auto & device = *(snort::Device *)(uintptr_t)(deviceHandle.handle);
+	// latched, so an instruction sees the same state however often it asks
+	if (device.inputInstruction == device.instructionCount) {
+		return device.inputState;
+	}
+	device.inputInstruction = device.instructionCount;
+
+	// -- from the input replay, its instruction indices are relative to its
+	//    instruction offset
+	if (device.inputReplay.handle != 0u) {
+		u64 const offset = SnortFs::replay_instructionOffset(device.inputReplay);
+		device.inputState = (
+			device.instructionCount < offset
+			? 0u
+			: SnortFs::replay_inputState(
+				device.inputReplay, device.instructionCount - offset
+			)
+		);
+	}
+	else {
+		device.inputState = device.liveInputState;
+	}
+
+	// -- instructions past the target are never recorded
+	if (
+		   device.isRecording
+		&& device.instructionCount < (size_t)device.targetInstructionCount
+	) {
+		SnortFs::replayRecorder_recordInput(
+			device.recordingFile, device.inputState
+		);
+	}
+	return device.inputState;
+}
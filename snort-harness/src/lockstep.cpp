@@ -0,0 +1,105 @@
+#include "device.hpp"
+
+#include <snort-replay/hash.hpp>
+
+namespace {
+
+// the comparator is ahead of or behind this side by up to its ring, so the
+//   emulator is stopped wherever it is and the halt instruction reported
+void halt(snort::Device & device) {
+	u64 haltInstruction = 0u;
+	SnortFs::LockstepHaltReason const reason = (
+		SnortFs::lockstep_haltReason(device.lockstepChannel, haltInstruction)
+	);
+	printf(
+		"lockstep halted at instruction offset %zu, %s. This side stopped at "
+		"instruction offset %zu\n",
+		(size_t)haltInstruction,
+		SnortFs::lockstepHaltReason_name(reason),
+		device.instructionCount
+	);
+	SnortFs::lockstep_detach(device.lockstepChannel);
+	device.isLockstepHalted = true;
+	device.isFastForwarding = false;
+	device.paused = true;
+
+	// -- keep what led up to it, the recording up to here is still valid
+	if (snort::flightRecorder_isEnabled(device.flightRecorder)) {
+		snort::flightRecorder_dump(device, "lockstep");
+	}
+	if (device.isRecording) {
+		SnortFs::replayRecorder_close(device.recordingFile);
+		device.isRecording = false;
+		printf(
+			"stopped recording at instruction offset %zu\n",
+			device.instructionCount
+		);
+	}
+}
+
+} // namespace
+
+// --
+
+void snort::lockstep_initialize(snort::Device & device) {
+	if (device.lockstepName.empty()) { return; }
+	device.lockstepChannel = (
+		SnortFs::lockstep_attach(
+			device.lockstepName.c_str(),
+			device.memoryRegionCreateInfo.size(),
+			device.memoryRegionCreateInfo.data()
+		)
+	);
+	if (device.lockstepChannel.handle == 0u) { return; }
+	device.lockstepInterval = SnortFs::lockstep_interval(device.lockstepChannel);
+	device.lockstepHashes.resize(device.currentMemoryRegion.size());
+	printf(
+		"lockstep '%s' attached as side %zu, every %zu instructions\n",
+		device.lockstepName.c_str(),
+		SnortFs::lockstep_side(device.lockstepChannel),
+		(size_t)device.lockstepInterval
+	);
+}
+
+// --
+
+void snort::lockstep_destroy(snort::Device & device) {
+	SnortFs::lockstep_detach(device.lockstepChannel);
+}
+
+// --
+
+void snort::lockstep_update(
+	snort::Device & device,
+	SnortMemoryRegion const * regions
+) {
+	if (device.instructionCount % device.lockstepInterval != 0u) { return; }
+	for (size_t it = 0; it < device.currentMemoryRegion.size(); ++ it) {
+		device.lockstepHashes[it] = (
+			SnortFs::hash64(
+				regions[it].data, device.currentMemoryRegion[it].byteCount
+			)
+		);
+	}
+	bool const isPublished = (
+		SnortFs::lockstep_publish(
+			device.lockstepChannel,
+			device.instructionCount,
+			device.lockstepHashes.data()
+		)
+	);
+	if (!isPublished) {
+		::halt(device);
+		return;
+	}
+	++ device.lockstepPublishCount;
+}
+
+// --
+
+bool snort::lockstep_isStarted(snort::Device const & device) {
+	return (
+		   device.lockstepChannel.handle != 0u
+		&& device.lockstepPublishCount > 0u
+	);
+}
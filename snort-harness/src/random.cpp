@@ -1,15 +1,39 @@
 #include "device.hpp"
 
+namespace {
+
+constexpr u64 kGolden { 0x9E3779B97F4A7C15ull };
+
+// splitmix64's finalizer
+u64 mix(u64 z) {
+	z = (z ^ (z >> 30u)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27u)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31u);
+}
+
+} // namespace
+
+// --
+
+u64 snort::rng_value(u64 const seed, u64 const instruction, u64 const draw) {
+	// each instruction gets its own splitmix stream, keyed off the seed
+	u64 const stream = ::mix(seed + kGolden * (instruction + 1u));
+	return ::mix(stream + kGolden * (draw + 1u));
+}
+
 // --
 
 u64 snort_rngU64(SnortDevice const deviceHandle) {
 	auto & device = *(snort::Device *)(uintptr_t)(deviceHandle.handle);
-	// simple xorshift rng
-	u64 const x = device.rngSeed;
-	device.rngSeed = x ^ (x << 13);
-	device.rngSeed = device.rngSeed ^ (device.rngSeed >> 7);
-	device.rngSeed = device.rngSeed ^ (device.rngSeed << 17);
-	return device.rngSeed;
+	// the draw counter restarts every instruction, so an instruction's draws
+	//   don't depend on how many numbers earlier instructions drew
+	if (device.rngInstruction != device.instructionCount) {
+		device.rngInstruction = device.instructionCount;
+		device.rngDrawCount = 0u;
+	}
+	return snort::rng_value(
+		device.rngSeed, device.rngInstruction, device.rngDrawCount ++
+	);
 }
 
 // --
@@ -0,0 +1,448 @@
+#include "device.hpp"
+
+#include <snort/snort-ui.h>
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+// snort_run splits the frame loop across two threads. The emulation thread
+//   owns the device and the emulator's memory, and runs instructions in
+//   batches. Between batches it applies whatever the ui asked for and, if
+//   requested, copies the memory regions into a snapshot. The ui thread only
+//   ever touches the controls and the snapshot, under the run mutex. Of the
+//   device it only reads what's fixed at creation, the common interface and
+//   the region layout
+
+namespace {
+
+// the caller holds the run mutex
+void publishSnapshot(
+	snort::Device const & device,
+	SnortMemoryRegion const * memoryRegions,
+	u64 const controlsGeneration,
+	snort::RunSnapshot & snapshot
+) {
+	snapshot.regionData.resize(device.currentMemoryRegion.size());
+	for (size_t it = 0; it < device.currentMemoryRegion.size(); ++ it) {
+		auto const & regionInfo = device.currentMemoryRegion[it];
+		snapshot.regionData[it].resize(regionInfo.byteCount);
+		memcpy(
+			snapshot.regionData[it].data(),
+			memoryRegions[it].data,
+			regionInfo.byteCount
+		);
+	}
+	snapshot.instructionCount = device.instructionCount;
+	snapshot.paused = device.paused;
+	snapshot.isRecording = device.isRecording;
+	snapshot.isFastForwarding = device.isFastForwarding;
+	snapshot.recordingStartOffset = device.recordingStartOffset;
+	snapshot.targetInstructionCount = device.targetInstructionCount;
+	snapshot.controlsGeneration = controlsGeneration;
+	snapshot.instructionsPerSecond = device.batchTiming.instructionsPerSecond;
+	snapshot.flightInstructionCount = device.flightRecorder.entryCount;
+	snapshot.flightByteCount = device.flightRecorder.usedByteCount;
+	snapshot.hasQuickState = device.hasQuickState;
+	snapshot.stepBackInstructionCount = device.stepBackLog.entryCount;
+	snapshot.isAsyncReplayWriter = device.asyncReplayWriter;
+	snapshot.isFlightRecorderEnabled = (
+		snort::flightRecorder_isEnabled(device.flightRecorder)
+	);
+	snapshot.hasWritableRegions = !device.writableRegions.empty();
+	snapshot.recorderStats = (
+		device.isRecording
+		? SnortFs::replayRecorder_stats(device.recordingFile)
+		: SnortFs::ReplayRecorderStats {}
+	);
+}
+
+// --
+
+// the caller holds the run mutex, returns whether anything was requested
+bool applyControls(snort::Device & device, snort::RunControls & controls) {
+	bool const hasRequests = (
+		   controls.requestPause
+		|| controls.requestResume
+		|| controls.requestStep
+		|| controls.requestStepBack
+		|| controls.requestRecording
+		|| controls.requestFlightDump
+		|| controls.requestSaveState
+		|| controls.requestRestoreState
+		|| controls.inputState != device.liveInputState
+	);
+	if (controls.requestPause) {
+		device.paused = true;
+	}
+	if (controls.requestResume) {
+		device.paused = false;
+	}
+	if (controls.requestStep) {
+		device.paused = false;
+		device.step = true;
+	}
+	if (controls.requestStepBack) {
+		snort::stepBack(device);
+	}
+	if (
+		   controls.requestRecording
+		&& !device.isRecording
+		&& !device.isFastForwarding
+	) {
+		device.recordingStartOffset = controls.recordingStartOffset;
+		device.recordingInstructionCount = controls.recordingInstructionCount;
+		snort::requestRecording(device);
+	}
+	if (controls.requestFlightDump) {
+		snort::flightRecorder_dump(device, "requested");
+	}
+	if (controls.requestSaveState) {
+		device.hasQuickState = snort::saveState(device, device.quickState);
+	}
+	if (controls.requestRestoreState && device.hasQuickState) {
+		snort::restoreState(device, device.quickState);
+	}
+	device.liveInputState = controls.inputState;
+	controls.requestPause = false;
+	controls.requestResume = false;
+	controls.requestStep = false;
+	controls.requestStepBack = false;
+	controls.requestRecording = false;
+	controls.requestFlightDump = false;
+	controls.requestSaveState = false;
+	controls.requestRestoreState = false;
+	return hasRequests;
+}
+
+// --
+
+void runEmulation(
+	SnortDevice const deviceHandle,
+	snort::Device & device,
+	snort::RunState & run,
+	SnortMemoryRegion const * memoryRegions,
+	SnortStepFn const step,
+	void * userData
+) {
+	// snapshots are only copied if something could have changed since the
+	//   last one, otherwise the ui keeps the one it has
+	bool hasChangedSinceSnapshot = true;
+	while (true) {
+		if (device.closeOnceDoneRecording && snort::isSessionDone(device)) {
+			break;
+		}
+
+		// -- sync with the ui, only takes the lock when there's something to do
+		if (
+			   device.paused
+			|| run.hasControlsChanged.load(std::memory_order_relaxed)
+			|| run.isSnapshotRequested.load(std::memory_order_relaxed)
+		) {
+			std::unique_lock<std::mutex> lock(run.mutex);
+			run.hasControlsChanged = false;
+			if (run.controls.quit) { break; }
+			if (::applyControls(device, run.controls)) {
+				hasChangedSinceSnapshot = true;
+			}
+			if (run.isSnapshotRequested && hasChangedSinceSnapshot) {
+				::publishSnapshot(
+					device, memoryRegions, run.controls.generation, run.snapshot
+				);
+				run.isSnapshotFresh = true;
+				hasChangedSinceSnapshot = false;
+			}
+			run.isSnapshotRequested = false;
+			if (device.paused) {
+				// headless there's no ui that could ever resume it
+				if (device.isHeadless) {
+					printf(
+						"paused headless at instruction offset %zu, nothing can "
+						"resume it so the run stops\n",
+						device.instructionCount
+					);
+					break;
+				}
+				snort::batchTiming_idle(device.batchTiming);
+				// nothing to run until the ui asks for something
+				run.wake.wait(lock, [&run]() {
+					return (
+						   run.hasControlsChanged.load()
+						|| run.isSnapshotRequested.load()
+					);
+				});
+				continue;
+			}
+		}
+
+		// -- run a batch, stopping exactly at the recording target
+		size_t instructionsToRun = (
+			device.step
+			? 1u
+			: snort::batchTiming_batchSize(
+				device.batchTiming,
+				snort::kRunBatchBudgetNanoseconds
+			)
+		);
+		if (snort::isBatchClamped(device)) {
+			instructionsToRun = std::min(
+				instructionsToRun,
+				snort::recordingInstructionsLeft(device)
+			);
+		}
+		auto const batchStart = std::chrono::steady_clock::now();
+		for (size_t it = 0; it < instructionsToRun; ++ it) {
+			snort_updateFrame(deviceHandle, memoryRegions);
+			step(userData);
+		}
+		if (device.step) {
+			device.step = false;
+			device.paused = true;
+		}
+		else {
+			auto const elapsed = std::chrono::steady_clock::now() - batchStart;
+			snort::batchTiming_record(
+				device.batchTiming,
+				instructionsToRun,
+				(u64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+					elapsed
+				).count()
+			);
+		}
+		snort::closeFinishedRecording(device);
+		hasChangedSinceSnapshot = true;
+	}
+
+	// -- let the ui see the final state
+	std::lock_guard<std::mutex> lock(run.mutex);
+	::publishSnapshot(
+		device, memoryRegions, run.controls.generation, run.snapshot
+	);
+	run.isSnapshotFresh = true;
+	run.isFinished = true;
+}
+
+// --
+
+// returns the requests the user made this frame, if any
+bool displayRunConfiguration(
+	snort::RunSnapshot const & snapshot,
+	snort::RunControls & requests
+) {
+	bool hasRequests = false;
+	ImGui::Begin("configuration");
+	bool paused = snapshot.paused;
+	if (ImGui::Checkbox("pause", &paused)) {
+		(paused ? requests.requestPause : requests.requestResume) = true;
+		hasRequests = true;
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("step")) {
+		requests.requestStep = true;
+		hasRequests = true;
+	}
+	if (snapshot.stepBackInstructionCount > 0u && !snapshot.isRecording) {
+		ImGui::SameLine();
+		if (ImGui::Button("step back")) {
+			requests.requestStepBack = true;
+			hasRequests = true;
+		}
+		ImGui::SameLine();
+		ImGui::Text("(%zu)", snapshot.stepBackInstructionCount);
+	}
+	if (snapshot.isRecording) {
+		ImGui::Text(
+			"recording, %zu / %d",
+			snapshot.instructionCount,
+			snapshot.targetInstructionCount
+		);
+		ImGui::Text(
+			"%.2f M instructions/s",
+			snapshot.instructionsPerSecond / 1e6
+		);
+		if (snapshot.isAsyncReplayWriter) {
+			ImGui::Text(
+				"writer stalls: %zu (%.1f ms)",
+				(size_t)snapshot.recorderStats.writerStallCount,
+				(double)snapshot.recorderStats.writerStallNanoseconds / 1e6
+			);
+		}
+	}
+	else if (snapshot.isFastForwarding) {
+		ImGui::Text(
+			"fast-forwarding, %zu / %d",
+			snapshot.instructionCount,
+			snapshot.recordingStartOffset
+		);
+		ImGui::Text(
+			"%.2f M instructions/s",
+			snapshot.instructionsPerSecond / 1e6
+		);
+	}
+	else {
+		// an offset already passed starts recording straight away
+		ImGui::Text("instructions: %zu", snapshot.instructionCount);
+		ImGui::Text(
+			"%.2f M instructions/s",
+			snapshot.instructionsPerSecond / 1e6
+		);
+		ImGui::Text("start instruction offset");
+		ImGui::InputInt(
+			"##start instruction offset",
+			&requests.recordingStartOffset
+		);
+		ImGui::Text("instruction count");
+		ImGui::InputInt(
+			"##instruction count",
+			&requests.recordingInstructionCount
+		);
+		if (ImGui::Button("Record")) {
+			requests.requestRecording = true;
+			hasRequests = true;
+		}
+	}
+	if (snapshot.isFlightRecorderEnabled) {
+		ImGui::Text(
+			"flight recorder: %zu instructions, %.1f MiB",
+			snapshot.flightInstructionCount,
+			(double)snapshot.flightByteCount / (1024.0 * 1024.0)
+		);
+		if (ImGui::Button("dump flight recorder (F9)") || IsKeyPressed(KEY_F9)) {
+			requests.requestFlightDump = true;
+			hasRequests = true;
+		}
+	}
+	if (snapshot.hasWritableRegions) {
+		if (ImGui::Button("save state")) {
+			requests.requestSaveState = true;
+			hasRequests = true;
+		}
+		if (snapshot.hasQuickState && !snapshot.isRecording) {
+			ImGui::SameLine();
+			if (ImGui::Button("restore state")) {
+				requests.requestRestoreState = true;
+				hasRequests = true;
+			}
+		}
+	}
+	ImGui::End();
+	return hasRequests;
+}
+
+} // namespace
+
+// --
+
+void snort_run(
+	SnortDevice const deviceHandle,
+	SnortMemoryRegion const * memoryRegions,
+	SnortStepFn const step,
+	void * userData
+) {
+	auto & device = *(snort::Device *)(uintptr_t)(deviceHandle.handle);
+	snort::RunState run {};
+
+	// -- headless there's no ui, so emulate on the calling thread
+	if (device.isHeadless) {
+		::runEmulation(deviceHandle, device, run, memoryRegions, step, userData);
+		return;
+	}
+
+	// the ui's copy, the first one is taken before the emulation thread starts
+	snort::RunSnapshot snapshot {};
+	::publishSnapshot(device, memoryRegions, 0u, snapshot);
+	std::vector<u8 const *> snapshotRegions(device.currentMemoryRegion.size());
+	// edited by the ui, only the recording window persists between frames
+	snort::RunControls requests {
+		.recordingStartOffset = device.recordingStartOffset,
+		.recordingInstructionCount = device.recordingInstructionCount,
+	};
+	u64 requestGeneration = 0u;
+
+	std::thread emulationThread(
+		::runEmulation,
+		deviceHandle,
+		std::ref(device),
+		std::ref(run),
+		memoryRegions,
+		step,
+		userData
+	);
+
+	bool isFinished = false;
+	while (!isFinished && !WindowShouldClose()) {
+		// -- take the latest snapshot and ask for the next one
+		{
+			std::lock_guard<std::mutex> lock(run.mutex);
+			if (run.isSnapshotFresh) {
+				std::swap(run.snapshot, snapshot);
+				run.isSnapshotFresh = false;
+			}
+			isFinished = run.isFinished;
+			run.isSnapshotRequested = true;
+		}
+		run.wake.notify_one();
+
+		// -- display
+		snort_displayFrameBegin();
+		for (size_t it = 0; it < snapshotRegions.size(); ++ it) {
+			snapshotRegions[it] = snapshot.regionData[it].data();
+		}
+		snort_displayMemory(
+			device.commonInterface,
+			snapshotRegions.size(),
+			device.memoryRegionCreateInfo.data(),
+			snapshotRegions.data(),
+			nullptr
+		);
+		bool hasRequests = ::displayRunConfiguration(snapshot, requests);
+		// held keys only go out when they change
+		u64 const inputState = snort::input_sampleKeys(device);
+		if (inputState != requests.inputState) {
+			requests.inputState = inputState;
+			hasRequests = true;
+		}
+		if (hasRequests) {
+			{
+				std::lock_guard<std::mutex> lock(run.mutex);
+				// merge, the previous requests may not have been applied yet
+				run.controls.requestPause |= requests.requestPause;
+				run.controls.requestResume |= requests.requestResume;
+				run.controls.requestStep |= requests.requestStep;
+				run.controls.requestStepBack |= requests.requestStepBack;
+				run.controls.requestRecording |= requests.requestRecording;
+				run.controls.requestFlightDump |= requests.requestFlightDump;
+				run.controls.requestSaveState |= requests.requestSaveState;
+				run.controls.requestRestoreState |= requests.requestRestoreState;
+				run.controls.inputState = requests.inputState;
+				run.controls.recordingStartOffset = requests.recordingStartOffset;
+				run.controls.recordingInstructionCount = (
+					requests.recordingInstructionCount
+				);
+				run.controls.generation = ++ requestGeneration;
+				run.hasControlsChanged = true;
+			}
+			run.wake.notify_one();
+			requests = snort::RunControls {
+				.inputState = requests.inputState,
+				.recordingStartOffset = requests.recordingStartOffset,
+				.recordingInstructionCount = requests.recordingInstructionCount,
+			};
+		}
+		// paused, and no requests in flight that could unpause it
+		snort_displaySetIdle(
+			   snapshot.paused
+			&& snapshot.controlsGeneration == requestGeneration
+		);
+		snort_displayFrameEnd();
+	}
+
+	// -- stop the emulation thread
+	{
+		std::lock_guard<std::mutex> lock(run.mutex);
+		run.controls.quit = true;
+		run.hasControlsChanged = true;
+	}
+	run.wake.notify_one();
+	emulationThread.join();
+}
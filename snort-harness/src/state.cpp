@@ -0,0 +1,220 @@
+#include "device.hpp"
+
+#include <cstring>
+
+namespace {
+
+bool hasWritableRegions(snort::Device const & device, char const * const what) {
+	if (device.writableRegions.empty()) {
+		printf(
+			"cannot %s, the emulator hasn't called snort_setWritableRegions\n",
+			what
+		);
+		return false;
+	}
+	return true;
+}
+
+// --
+
+// everything that follows from the instruction count starts over from it,
+//   and the next snort_updateFrame diffs against the restored memory
+void resumeAt(snort::Device & device, size_t const instructionCount) {
+	device.instructionCount = instructionCount;
+	device.rngInstruction = ~(size_t)0;
+	device.rngDrawCount = 0u;
+	device.inputInstruction = ~(size_t)0;
+	device.isCurrentDataSynced = false;
+	printf("restored state at instruction offset %zu\n", instructionCount);
+}
+
+} // namespace
+
+// --
+
+bool snort::saveState(snort::Device const & device, snort::SavedState & state) {
+	if (!::hasWritableRegions(device, "save state")) { return false; }
+	state.instructionCount = device.instructionCount;
+	state.rngSeed = device.rngSeed;
+	state.regionData.resize(device.currentMemoryRegion.size());
+	for (size_t it = 0; it < device.currentMemoryRegion.size(); ++ it) {
+		size_t const byteCount = device.currentMemoryRegion[it].byteCount;
+		state.regionData[it].resize(byteCount);
+		memcpy(state.regionData[it].data(), device.writableRegions[it], byteCount);
+	}
+	return true;
+}
+
+// --
+
+bool snort::restoreState(
+	snort::Device & device,
+	snort::SavedState const & state
+) {
+	if (!::hasWritableRegions(device, "restore state")) { return false; }
+	// the recording would jump, its diffs only ever run forwards
+	if (device.isRecording) {
+		printf("cannot restore state while recording\n");
+		return false;
+	}
+	if (snort::lockstep_isStarted(device)) {
+		printf("cannot restore state while in lockstep\n");
+		return false;
+	}
+	if (state.regionData.size() != device.currentMemoryRegion.size()) {
+		printf("cannot restore state, it was saved from a different device\n");
+		return false;
+	}
+	for (size_t it = 0; it < device.currentMemoryRegion.size(); ++ it) {
+		size_t const byteCount = device.currentMemoryRegion[it].byteCount;
+		if (state.regionData[it].size() != byteCount) {
+			printf("cannot restore state, region %zu changed size\n", it);
+			return false;
+		}
+		memcpy(device.writableRegions[it], state.regionData[it].data(), byteCount);
+	}
+	device.rngSeed = state.rngSeed;
+	::resumeAt(device, state.instructionCount);
+	return true;
+}
+
+// --
+
+bool snort::restoreStateFromReplay(
+	snort::Device & device,
+	char const * const replayPath,
+	u64 const instructionIndex
+) {
+	SnortFs::ReplayFile replay = SnortFs::replay_open(replayPath);
+	if (replay.handle == 0u) { return false; }
+	// -- the regions have to line up with the device's
+	bool isCompatible = (
+		SnortFs::replay_regionCount(replay) == device.currentMemoryRegion.size()
+	);
+	for (
+		size_t it = 0;
+		isCompatible && it < device.currentMemoryRegion.size();
+		++ it
+	) {
+		auto const & regionInfo = SnortFs::replay_regionInfo(replay)[it];
+		isCompatible = (
+			   regionInfo.elementCount * snort_dtByteCount(regionInfo.dataType)
+			== device.currentMemoryRegion[it].byteCount
+		);
+	}
+	if (!isCompatible) {
+		printf(
+			"cannot restore from '%s', its regions don't match the device's\n",
+			replayPath
+		);
+		SnortFs::replay_close(replay);
+		return false;
+	}
+	if (SnortFs::replay_isHashOnly(replay)) {
+		printf("cannot restore from '%s', it's a hash-only replay\n", replayPath);
+		SnortFs::replay_close(replay);
+		return false;
+	}
+	if (instructionIndex >= SnortFs::replay_instructionCount(replay)) {
+		printf(
+			"cannot restore from '%s' at instruction %zu, it only has %zu\n",
+			replayPath, (size_t)instructionIndex,
+			(size_t)SnortFs::replay_instructionCount(replay)
+		);
+		SnortFs::replay_close(replay);
+		return false;
+	}
+
+	// -- the replay's instruction is the memory a snort_updateFrame saw at
+	//    its offset plus the index, so resuming from there redoes the same
+	//    instructions with the same random numbers
+	snort::SavedState state {
+		.instructionCount = (size_t)(
+			SnortFs::replay_instructionOffset(replay) + instructionIndex
+		),
+		.rngSeed = device.rngSeed,
+		.regionData = std::vector<std::vector<u8>>(
+			device.currentMemoryRegion.size()
+		),
+	};
+	SnortFs::replay_rngSeed(replay, state.rngSeed);
+	std::vector<u8 *> regionData(state.regionData.size());
+	for (size_t it = 0; it < state.regionData.size(); ++ it) {
+		state.regionData[it].resize(device.currentMemoryRegion[it].byteCount);
+		regionData[it] = state.regionData[it].data();
+	}
+	SnortFs::replay_materializeState(replay, instructionIndex, regionData.data());
+	SnortFs::replay_close(replay);
+	return snort::restoreState(device, state);
+}
+
+// --
+
+void snort_setWritableRegions(
+	SnortDevice const deviceHandle,
+	SnortWritableMemoryRegion const * const memoryRegions
+) {
+	auto & device = *(snort::Device *)(uintptr_t)(deviceHandle.handle);
+	device.writableRegions.resize(device.currentMemoryRegion.size());
+	for (size_t it = 0; it < device.currentMemoryRegion.size(); ++ it) {
+		device.writableRegions[it] = memoryRegions[it].data;
+	}
+
+	// -- --restore-replay waited for the regions, and the recording for it
+	if (!device.restoreReplayFilepath.empty()) {
+		snort::restoreStateFromReplay(
+			device,
+			device.restoreReplayFilepath.c_str(),
+			device.restoreReplayInstruction
+		);
+		device.restoreReplayFilepath.clear();
+	}
+	if (device.isRecordingRequestDeferred) {
+		device.isRecordingRequestDeferred = false;
+		snort::requestRecording(device);
+	}
+}
+
+// --
+
+SnortState snort_saveState(SnortDevice const deviceHandle) {
+	auto & device = *(snort::Device *)(uintptr_t)(deviceHandle.handle);
+	snort::SavedState * const state = new snort::SavedState {};
+	if (!snort::saveState(device, *state)) {
+		delete state;
+		return SnortState { 0 };
+	}
+	return SnortState { .handle = (u64)(uintptr_t)(state) };
+}
+
+// --
+
+bool snort_restoreState(
+	SnortDevice const deviceHandle,
+	SnortState const stateHandle
+) {
+	if (stateHandle.handle == 0u) { return false; }
+	auto & device = *(snort::Device *)(uintptr_t)(deviceHandle.handle);
+	return snort::restoreState(
+		device, *(snort::SavedState const *)(uintptr_t)(stateHandle.handle)
+	);
+}
+
+// --
+
+bool snort_restoreStateFromReplay(
+	SnortDevice const deviceHandle,
+	char const * const replayPath,
+	u64 const instructionIndex
+) {
+	auto & device = *(snort::Device *)(uintptr_t)(deviceHandle.handle);
+	return snort::restoreStateFromReplay(device, replayPath, instructionIndex);
+}
+
+// --
+
+void snort_stateDestroy(SnortState * const state) {
+	if (state == nullptr || state->handle == 0u) { return; }
+	delete (snort::SavedState *)(uintptr_t)(state->handle);
+	state->handle = 0u;
+}
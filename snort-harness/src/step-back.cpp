@@ -0,0 +1,235 @@
+#include "device.hpp"
+
+#include <cstring>
+
+namespace {
+
+void stagingAppendU32(std::vector<u8> & staging, u32 const value) {
+	size_t const offset = staging.size();
+	staging.resize(offset + sizeof(u32));
+	memcpy(staging.data() + offset, &value, sizeof(u32));
+}
+
+u32 readU32(u8 const * & ptr) {
+	u32 value;
+	memcpy(&value, ptr, sizeof(u32));
+	ptr += sizeof(u32);
+	return value;
+}
+
+// --
+
+void dropOldest(snort::StepBackLog & log) {
+	log.usedByteCount -= log.entries[log.entryHead].byteCount;
+	log.entryHead = (log.entryHead + 1u) % log.entries.size();
+	-- log.entryCount;
+}
+
+} // namespace
+
+// --
+
+bool snort::stepBack_isEnabled(snort::StepBackLog const & log) {
+	return log.instructionCapacity > 0u;
+}
+
+// --
+
+void snort::stepBack_initialize(snort::Device & device) {
+	auto & log = device.stepBackLog;
+	if (!snort::stepBack_isEnabled(log)) { return; }
+	log.bytes.resize(device.stepBackByteCapacity);
+	log.entries.resize(log.instructionCapacity);
+}
+
+// --
+
+void snort::stepBack_reset(snort::StepBackLog & log) {
+	log.entryHead = 0u;
+	log.entryCount = 0u;
+	log.writeOffset = 0u;
+	log.usedByteCount = 0u;
+}
+
+// --
+
+void snort::stepBack_beginInstruction(snort::StepBackLog & log) {
+	log.staging.clear();
+	log.stagingRegionCount = 0u;
+	::stagingAppendU32(log.staging, 0u);
+}
+
+// --
+
+void snort::stepBack_recordRegion(
+	snort::StepBackLog & log,
+	size_t const regionIndex,
+	std::vector<SnortFs::MemoryRegionDiffRecord> const & diffs,
+	u8 const * const previousData
+) {
+	if (diffs.empty()) { return; }
+	++ log.stagingRegionCount;
+	::stagingAppendU32(log.staging, (u32)regionIndex);
+	::stagingAppendU32(log.staging, (u32)diffs.size());
+	for (auto const & diff : diffs) {
+		::stagingAppendU32(log.staging, (u32)diff.byteOffset);
+		::stagingAppendU32(log.staging, (u32)diff.byteCount);
+		log.staging.insert(
+			log.staging.end(),
+			previousData + diff.byteOffset,
+			previousData + diff.byteOffset + diff.byteCount
+		);
+	}
+}
+
+// --
+
+void snort::stepBack_endInstruction(snort::StepBackLog & log) {
+	u32 const changedRegionCount = (u32)log.stagingRegionCount;
+	memcpy(log.staging.data(), &changedRegionCount, sizeof(u32));
+	size_t const byteCount = log.staging.size();
+
+	// -- too big to keep, and nothing before it can be undone either
+	if (byteCount > log.bytes.size()) {
+		snort::stepBack_reset(log);
+		return;
+	}
+
+	// -- make room, the same way the flight recorder does but the oldest
+	//    instructions are simply forgotten
+	if (log.entryCount == log.entries.size()) {
+		::dropOldest(log);
+	}
+	if (log.writeOffset + byteCount > log.bytes.size()) {
+		while (
+			   log.entryCount > 0u
+			&& log.entries[log.entryHead].byteOffset >= log.writeOffset
+		) {
+			::dropOldest(log);
+		}
+		log.writeOffset = 0u;
+	}
+	while (log.entryCount > 0u) {
+		size_t const oldestOffset = log.entries[log.entryHead].byteOffset;
+		bool const overlaps = (
+			   oldestOffset >= log.writeOffset
+			&& oldestOffset < log.writeOffset + byteCount
+		);
+		if (!overlaps) { break; }
+		::dropOldest(log);
+	}
+
+	// -- append
+	memcpy(log.bytes.data() + log.writeOffset, log.staging.data(), byteCount);
+	size_t const entryIndex = (
+		(log.entryHead + log.entryCount) % log.entries.size()
+	);
+	log.entries[entryIndex] = snort::StepBackEntry {
+		.byteOffset = log.writeOffset,
+		.byteCount = byteCount,
+	};
+	++ log.entryCount;
+	log.writeOffset += byteCount;
+	log.usedByteCount += byteCount;
+}
+
+// --
+
+bool snort::stepBack(snort::Device & device) {
+	auto & log = device.stepBackLog;
+	if (!snort::stepBack_isEnabled(log)) { return false; }
+	if (device.writableRegions.empty()) {
+		printf(
+			"cannot step back, the emulator hasn't called "
+			"snort_setWritableRegions\n"
+		);
+		return false;
+	}
+	// the recording's diffs only run forwards
+	if (device.isRecording) {
+		printf("cannot step back while recording\n");
+		return false;
+	}
+	if (snort::lockstep_isStarted(device)) {
+		printf("cannot step back while in lockstep\n");
+		return false;
+	}
+	if (!device.isCurrentDataSynced || log.entryCount == 0u) {
+		printf("nothing to step back to\n");
+		return false;
+	}
+
+	// -- the instruction that ran since the last snort_updateFrame hasn't been
+	//    captured, currentData still has the memory from before it. With
+	//    dirty tracking only the ranges it touched are copied back
+	for (size_t it = 0; it < device.currentMemoryRegion.size(); ++ it) {
+		auto const & regionInfo = device.currentMemoryRegion[it];
+		if (!device.isDirtyTracking) {
+			memcpy(
+				device.writableRegions[it],
+				regionInfo.currentData.data(),
+				regionInfo.byteCount
+			);
+			continue;
+		}
+		for (auto const & range : device.dirtyRanges[it]) {
+			memcpy(
+				device.writableRegions[it] + range.byteOffset,
+				regionInfo.currentData.data() + range.byteOffset,
+				range.byteCount
+			);
+		}
+		device.dirtyRanges[it].clear();
+	}
+
+	// -- then the newest captured instruction is undone in currentData, so
+	//    the next snort_updateFrame captures it again. Its bytes are the
+	//    only ones where the memory and currentData now differ
+	size_t const entryIndex = (
+		(log.entryHead + log.entryCount - 1u) % log.entries.size()
+	);
+	auto const & entry = log.entries[entryIndex];
+	u8 const * ptr = log.bytes.data() + entry.byteOffset;
+	u32 const changedRegionCount = ::readU32(ptr);
+	for (u32 regionIt = 0; regionIt < changedRegionCount; ++ regionIt) {
+		u32 const regionIndex = ::readU32(ptr);
+		u32 const diffCount = ::readU32(ptr);
+		auto & currentData = device.currentMemoryRegion[regionIndex].currentData;
+		for (u32 diff = 0; diff < diffCount; ++ diff) {
+			u32 const byteOffset = ::readU32(ptr);
+			u32 const byteCount = ::readU32(ptr);
+			memcpy(currentData.data() + byteOffset, ptr, byteCount);
+			ptr += byteCount;
+			if (device.isDirtyTracking) {
+				device.dirtyRanges[regionIndex].push_back(snort::DirtyRange {
+					.byteOffset = byteOffset,
+					.byteCount = byteCount,
+				});
+			}
+		}
+	}
+	log.usedByteCount -= entry.byteCount;
+	log.writeOffset = entry.byteOffset;
+	-- log.entryCount;
+	if (snort::flightRecorder_isEnabled(device.flightRecorder)) {
+		snort::flightRecorder_dropNewest(device);
+	}
+
+	// -- the instruction count, and what's keyed on it
+	-- device.instructionCount;
+	device.rngInstruction = ~(size_t)0;
+	device.rngDrawCount = 0u;
+	device.inputInstruction = ~(size_t)0;
+	// headless nothing could resume it, the emulator carries on from here
+	if (!device.isHeadless) {
+		device.paused = true;
+	}
+	return true;
+}
+
+// --
+
+bool snort_stepBack(SnortDevice const deviceHandle) {
+	auto & device = *(snort::Device *)(uintptr_t)(deviceHandle.handle);
+	return snort::stepBack(device);
+}
@@ -0,0 +1,100 @@
+#include <snort/snort.h>
+
+#include <snort-replay/lockstep.hpp>
+
+#include <atomic>
+#include <cstdlib>
+
+#include <signal.h>
+#include <stdio.h>
+
+namespace {
+
+std::atomic<bool> isCancelled { false };
+
+void onSignal(int) {
+	isCancelled.store(true);
+}
+
+} // namespace
+
+i32 main(i32 argc, char* argv[])
+{
+	if (argc <= 1) {
+		printf(
+			"usage: %s <channel name> [interval] [ring capacity]\n"
+			"  then run both emulators with --lockstep <channel name>\n",
+			argv[0]
+		);
+		return 1;
+	}
+	char const * const name = argv[1];
+	SnortFs::LockstepOptions options {};
+	if (argc > 2) { options.interval = strtoull(argv[2], nullptr, 0); }
+	if (argc > 3) { options.ringCapacity = strtoull(argv[3], nullptr, 0); }
+	if (options.interval == 0u) { options.interval = 1u; }
+
+	SnortFs::LockstepChannel channel = SnortFs::lockstep_create(name, options);
+	if (channel.handle == 0) {
+		return 1;
+	}
+	// the sides are halted and the channel removed on the way out
+	signal(SIGINT, ::onSignal);
+	signal(SIGTERM, ::onSignal);
+	printf("waiting for two emulators with --lockstep %s\n", name);
+
+	SnortFs::LockstepResult const result = (
+		SnortFs::lockstep_compare(channel, isCancelled)
+	);
+	i32 exitCode = 1;
+	if (result.isCancelled) {
+		printf(
+			"->%s: cancelled after %zu records\n",
+			name, (size_t)result.comparedRecordCount
+		);
+	}
+	else if (result.haltReason == SnortFs::kLockstepHalt_none) {
+		printf(
+			"->%s: PASS, %zu records compared\n",
+			name, (size_t)result.comparedRecordCount
+		);
+		exitCode = 0;
+	}
+	else if (result.haltReason == SnortFs::kLockstepHalt_diverged) {
+		printf(
+			"->%s: FAIL, diverged at instruction offset %zu\n",
+			name, (size_t)result.instruction
+		);
+		for (size_t const regionIndex : result.regionIndices) {
+			printf(
+				"  region '%s' differs\n",
+				SnortFs::lockstep_regionLabel(channel, 0u, regionIndex)
+			);
+		}
+		// -- the memory matched one record earlier, so one of the
+		//    instructions in between is the culprit
+		size_t const interval = (size_t)options.interval;
+		size_t const startOffset = (
+			result.comparedRecordCount == 0u || result.instruction < interval
+			? 0u
+			: (size_t)result.instruction - interval
+		);
+		printf(
+			"  re-record both in full with --recording-start-offset %zu "
+			"--target-instruction-count %zu\n",
+			startOffset,
+			(size_t)result.instruction - startOffset + 1u
+		);
+	}
+	else {
+		printf(
+			"->%s: FAIL, %s at instruction offset %zu after %zu records\n",
+			name,
+			SnortFs::lockstepHaltReason_name(result.haltReason),
+			(size_t)result.instruction,
+			(size_t)result.comparedRecordCount
+		);
+	}
+	SnortFs::lockstep_destroy(channel);
+	return exitCode;
+}
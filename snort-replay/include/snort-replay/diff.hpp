@@ -0,0 +1,39 @@
+#pragma once
+
+#include <snort-replay/fs.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// finds the spans of bytes that changed between two copies of a memory
+//   region, which is what gets recorded for every region of every
+//   instruction. The vectorized kernels compare 16 or 32 bytes at a time,
+//   the kernel is picked at runtime from what the cpu supports
+
+namespace SnortFs {
+
+	enum DiffKernel {
+		// the fastest kernel the cpu supports, picked once at runtime
+		kDiffKernel_best,
+		// 8 bytes at a time in general purpose registers, runs anywhere
+		kDiffKernel_scalar,
+		kDiffKernel_sse2,
+		kDiffKernel_avx2,
+	};
+
+	bool diffKernel_isSupported(DiffKernel const kernel);
+	char const * diffKernel_name(DiffKernel const kernel);
+
+	// appends a record for every maximal span of bytes where data differs
+	//   from reference, in order. The records point into data. Every kernel
+	//   produces the same records
+	void diff_findSpans(
+		uint8_t const * const data,
+		uint8_t const * const reference,
+		size_t const byteCount,
+		std::vector<MemoryRegionDiffRecord> & records,
+		DiffKernel const kernel = kDiffKernel_best
+	);
+
+}
@@ -8,8 +8,11 @@
 // a simple file system that reads/writes replays into binary files
 // The file just stores diffs of memory between each instruction
 /*
-	Format:
-	- magic number (8 bytes)
+	Format (version 2):
+	- magic number "SNORTRP2" (8 bytes)
+	- flags (8 bytes)
+	- block codec (8 bytes, only if the block codec flag is set)
+	- rng seed (8 bytes, only if the rng seed flag is set)
 	- common interface (8 bytes)
 	- instruction offset (8 bytes)
 	- instruction count (8 bytes)
@@ -18,33 +21,132 @@
 		- data-type (8 bytes)
 		- element count (8 bytes)
 		- element display row stride (8 bytes)
-		- label length (8 bytes)
-		- label (label length bytes)
+		- label (null-terminated)
+	- per-chunk: (implicit)
+		- chunk type (8 bytes)
+		- first instruction index (8 bytes)
+		- instruction count (8 bytes)
+		- payload byte count (8 bytes)
+		- payload (payload byte count bytes)
+	- magic number "SNORTRP2" (8 bytes, marks the end of the chunks)
+	- index footer: (optional)
+		- per-chunk:
+			- chunk type (8 bytes)
+			- first instruction index (8 bytes)
+			- instruction count (8 bytes)
+			- byte offset of the chunk header (8 bytes)
+			- payload byte count (8 bytes)
+			- payload checksum, hash64 (8 bytes)
+		- chunk count (8 bytes)
+		- magic number "SNORTIDX" (8 bytes)
+
+	Chunk types:
+	- 1, instructions, payload described below
+	- 2, keyframe, the full memory of every region after applying the diffs
+	  of its first instruction index. Payload is each region's bytes back to
+	  back, instruction count is zero
+	- 3, hashes, only in hash-only files. Payload is one hash per region
+	  (8 bytes each). Each starts at zero and, after every instruction of
+	  the chunk, the hash64 of the region's memory is folded into it with
+	  hash64_fold
+	- 4, inputs, only in files with the inputs flag. Covers the same
+	  instructions as the instruction or hash chunk that follows it, and is
+	  left out if the input state didn't change over them. Payload is
+	  per-change: (implicit)
+		- instruction index, minus the previous change's or for the first
+		  change the chunk's first instruction index (varint)
+		- input state from that instruction on (varint)
+
+	Instruction chunk payload:
 	- per-instruction: (implicit)
-		- per memory region: (implicit)
-			- diff count (8 bytes)
+		- changed region mask (region count / 8 bytes, rounded up), bit
+		  (index % 8) of byte (index / 8) is set if the region has diffs
+		- per changed memory region: (implicit)
+			- diff count (varint)
 			- per diff:
-				- byte offset (8 bytes)
-				- byte count (8 bytes)
+				- byte offset (varint)
+				- byte count (varint)
 				- memory region data (byte count bytes)
-	- magic number (8 bytes, to verify instructions were read correctly)
+
+	Flags:
+	- bit 0, block codec, every chunk payload is encoded with the codec
+	  that follows the flags. The stored payload is then the decoded byte
+	  count (8 bytes) followed by the encoded bytes, the payload byte count
+	  and checksum cover the stored bytes
+	- bit 1, varint diffs, the varint fields of the instruction chunk payload
+	  are unsigned LEB128, 7 bits per byte from the least significant
+	  group, with the high bit set on every byte but the last. Without this
+	  flag they are 8 bytes each, as in version 1
+	- bit 2, region mask, without this flag there is no changed region mask
+	  and every region stores a diff count, even when it's zero
+	- bit 3, hash-only, the file stores hash chunks in place of instruction
+	  chunks, plus sparse keyframes. It's only proof that two recordings
+	  agree, where they don't it narrows the divergence down to a chunk
+	- bit 4, rng seed, the seed of the harness' counter based rng follows
+	  the codec. Its counter is the instruction count, so keyframes carry it
+	  implicitly: instruction offset + keyframe instruction index
+	- bit 5, inputs, the input state the emulator polled is recorded in
+	  input chunks. The state is zero until the first change
+
+	With the footer a reader can jump to any instruction block and verify it
+	  without touching the rest of the file. Without it, e.g. if the recording
+	  never closed, the chunk headers are walked instead.
+
+	Version 1 files start with "SNORTRPL", have no flags, and store the
+	  per-instruction diffs directly after the region info with 8-byte
+	  fields, followed by the "SNORTRPL" magic number.
 */
 
 namespace SnortFs {
 
 	// -- replay ----------------------------------------------------------------
 
+	// data points into the replay file's bytes, or into the decoded block for
+	//   compressed replays. It stays valid until the replay is closed
 	struct MemoryRegionDiff {
 		uint64_t byteOffset;
 		uint64_t byteCount;
-		uint8_t * data;
+		uint8_t const * data;
 	};
 
 	struct ReplayFile { uint64_t handle; };
 
-	ReplayFile replay_open(char const * const filepath);
+	// codecs the recorder can compress chunk payloads with, the id is stored
+	//   in the replay header
+	enum ReplayCodec : uint64_t {
+		kReplayCodec_none,
+		// run-length, cheap and good enough for mostly constant memory
+		kReplayCodec_rle,
+		// LZ77 with an LZ4-style byte layout, also catches repeated patterns
+		kReplayCodec_lz,
+	};
+
+	// returns false for an unknown name, names are "none", "rle" and "lz"
+	bool replayCodec_fromName(char const * const name, ReplayCodec & codec);
+	char const * replayCodec_name(ReplayCodec const codec);
+
+	// load reads the whole file into memory with a single read, map
+	//   memory-maps it instead so opening only touches the header. Either
+	//   way diffs are parsed lazily as they are requested, compressed blocks
+	//   are decoded the first time one of their instructions is accessed
+	enum ReplayOpenMode {
+		kReplayOpenMode_load,
+		kReplayOpenMode_map,
+	};
+
+	ReplayFile replay_open(
+		char const * const filepath,
+		ReplayOpenMode const mode = kReplayOpenMode_load
+	);
 	void replay_close(ReplayFile & file);
 
+	uint64_t replay_version(ReplayFile const file);
+	// whether the file has an index footer with block checksums
+	bool replay_hasIndex(ReplayFile const file);
+	ReplayCodec replay_codec(ReplayFile const file);
+	// returns false if the recording didn't store the seed
+	bool replay_rngSeed(ReplayFile const file, uint64_t & seed);
+
 	SnortCommonInterface replay_commonInterface(ReplayFile const file);
 	uint64_t replay_instructionOffset(ReplayFile const file);
 	uint64_t replay_instructionCount(ReplayFile const file);
@@ -54,31 +156,122 @@ namespace SnortFs {
 		ReplayFile const file
 	);
 
+	// instructions in a block that fails its checksum have no diffs, see
+	//   validateMemory
 	size_t replay_instructionDiffCount(
 		ReplayFile const file,
 		size_t const instructionIndex,
 		size_t const regionIndex
 	);
 
-	MemoryRegionDiff * replay_instructionDiff(
+	MemoryRegionDiff const * replay_instructionDiff(
 		ReplayFile const file,
 		size_t const instructionIndex,
 		size_t const regionIndex
 	);
 
+	uint64_t replay_keyframeCount(ReplayFile const file);
+
+	// hash-only replays have no diffs, the diff queries return nothing and
+	//   only keyframes can be materialized. See ReplayRecorderOptions
+	bool replay_isHashOnly(ReplayFile const file);
+
+	struct ReplayHashBlock {
+		uint64_t firstInstruction;
+		uint64_t instructionCount;
+	};
+
+	size_t replay_hashBlockCount(ReplayFile const file);
+
+	// writes one hash per region into regionHashes, returns false if the
+	//   block fails its checksum or doesn't decode
+	bool replay_hashBlock(
+		ReplayFile const file,
+		size_t const blockIndex,
+		ReplayHashBlock & block,
+		uint64_t * const regionHashes
+	);
+
+	// whether the recording has an input stream, see
+	//   replayRecorder_recordInput
+	bool replay_hasInputs(ReplayFile const file);
+
+	// the input state the emulator polled while running the instruction whose
+	//   diffs are stored at the given index, zero without an input stream.
+	//   Re-running the emulator with these inputs and the recorded rng seed
+	//   reproduces the recording
+	uint64_t replay_inputState(
+		ReplayFile const file,
+		size_t const instructionIndex
+	);
+
+	// writes the memory of every region as it is after applying the diffs of
+	//   the given instruction. It starts from the closest keyframe at or
+	//   before the instruction, so the cost is bounded by the keyframe
+	//   interval instead of the length of the replay. regionData holds one
+	//   buffer per region of elementCount * snort_dtByteCount(dataType) bytes
+	void replay_materializeState(
+		ReplayFile const file,
+		size_t const instructionIndex,
+		uint8_t * const * regionData
+	);
+
 	// -- recording -------------------------------------------------------------
 
 	struct ReplayFileRecorder { uint64_t handle; };
 
+	struct ReplayRecorderOptions {
+		// instructions between keyframes, zero picks the interval adaptively
+		//   from how much memory has changed since the last keyframe
+		uint64_t keyframeInterval { 0u };
+		bool keyframes { true };
+		ReplayCodec codec { kReplayCodec_none };
+		// hands the diffs to a writer thread through a ring buffer, so that
+		//   encoding, compression and file writes happen off the calling
+		//   thread. If the ring is full, recording blocks until there's room
+		bool asyncWriter { false };
+		size_t asyncRingByteCount { 4u * 1024u * 1024u };
+		// records a hash per region for every block of hashInterval
+		//   instructions instead of the diffs, a few bytes per block. The
+		//   adaptive keyframe interval becomes kHashOnlyKeyframeInterval
+		bool hashOnly { false };
+		uint64_t hashInterval { 4096u };
+		// the seed the emulator's random numbers derive from, stored in the
+		//   header so a replay can be resumed with the same numbers
+		bool hasRngSeed { false };
+		uint64_t rngSeed { 0u };
+		// records the input stream, see replayRecorder_recordInput
+		bool recordInputs { false };
+	};
+
+	// sparse, hash-only recordings are meant for long runs
+	constexpr uint64_t kHashOnlyKeyframeInterval { 1u << 20u };
+
+	struct ReplayRecorderStats {
+		// times recording blocked on a full async writer ring, and for how
+		//   long in total. Always zero without the async writer
+		uint64_t writerStallCount;
+		uint64_t writerStallNanoseconds;
+		// times the recorder's staging buffers grew, these are reused so it
+		//   levels off once they fit the largest block
+		uint64_t allocationCount;
+	};
+
+	// the recorder streams diffs to the file as they are recorded, only a
+	//   small staging buffer is kept in memory. Closing writes the trailing
+	//   magic number and patches the instruction count into the header
 	ReplayFileRecorder replayRecorder_open(
 		char const * const filepath,
 		SnortCommonInterface const commonInterface,
 		uint64_t const instructionOffset,
 		uint64_t const regionCount,
-		SnortMemoryRegionCreateInfo const * regionCreateInfo
+		SnortMemoryRegionCreateInfo const * regionCreateInfo,
+		ReplayRecorderOptions const & options = {}
 	);
 	void replayRecorder_close(ReplayFileRecorder & recorder);
 
+	ReplayRecorderStats replayRecorder_stats(ReplayFileRecorder const recorder);
+
 	struct MemoryRegionDiffRecord {
 		uint64_t byteOffset;
 		uint64_t byteCount;
@@ -87,7 +280,8 @@ namespace SnortFs {
 
 	// records the memory region diffs, sequentially. so start at first
 	//   instruction, first region, then second region, etc until second instr
-	//   and first region, etc.
+	//   and first region, etc. The diffs are copied, so they only have to stay
+	//   valid for the call
 	// The first frame should probably capture the entire memory region as
 	//   a single diff so that it's all populated with data
 	void replayRecorder_recordInstruction(
@@ -95,4 +289,12 @@ namespace SnortFs {
 		size_t const diffCount,
 		MemoryRegionDiffRecord const * diffs
 	);
+
+	// the input state polled by the next instruction to be recorded, call it
+	//   between instructions. Only changes are stored, a few bytes each.
+	//   Does nothing unless the recorder was opened with recordInputs
+	void replayRecorder_recordInput(
+		ReplayFileRecorder & recorder,
+		uint64_t const inputState
+	);
 }
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace SnortFs {
+
+	// fast non-cryptographic 64-bit hash (XXH64), used for replay block
+	//   checksums
+	uint64_t hash64(
+		void const * const data,
+		size_t const byteCount,
+		uint64_t const seed = 0u
+	);
+
+	// folds a value into a running hash, order dependent so a sequence of
+	//   values hashes differently from any reordering of it
+	uint64_t hash64_fold(uint64_t const hash, uint64_t const value);
+
+}
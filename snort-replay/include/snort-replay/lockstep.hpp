@@ -0,0 +1,132 @@
+#pragma once
+
+#include <snort/snort.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// compares two emulators while they run, instead of recording both and
+//   comparing the replays afterwards. The comparator creates a POSIX shared
+//   memory channel, each emulator attaches to one of its two sides and
+//   publishes a hash per region every interval instructions into that
+//   side's ring. The comparator checks the rings against each other and
+//   halts both sides at the first instruction they disagree on
+/*
+	Shared memory layout, "/snort-lockstep-<name>":
+	- header
+		- magic number "SNORTLS1" (8 bytes)
+		- ring capacity, in records (8 bytes)
+		- interval, instructions between records (8 bytes)
+		- attached side count (8 bytes, atomic)
+		- halt reason (4 bytes, atomic) and halt instruction (8 bytes)
+	- per-side: (2)
+		- head and tail record counts (8 bytes each, atomic)
+		- state (4 bytes, atomic), free, attached or detached
+		- process id (4 bytes)
+		- region count, and per-region byte count and label
+	- per-side ring: (2)
+		- ring capacity records of:
+			- instruction count (8 bytes)
+			- per-region hash64 (kLockstepMaxRegionCount * 8 bytes)
+
+	The sides only write their own head and the comparator their tails, a
+	  side blocks once its ring is full, so it runs at most ring capacity
+	  records ahead of the comparator and the other side.
+*/
+
+namespace SnortFs {
+
+	struct LockstepChannel { uint64_t handle; };
+
+	constexpr size_t kLockstepMaxRegionCount { 16u };
+
+	enum LockstepHaltReason : uint32_t {
+		kLockstepHalt_none,
+		// the hashes of one or more regions differ
+		kLockstepHalt_diverged,
+		// the sides published different instruction counts at the same spot
+		//   of their rings, e.g. one of them restored a state
+		kLockstepHalt_outOfStep,
+		// the sides registered different regions
+		kLockstepHalt_layoutMismatch,
+		// one side detached, or its process exited, before the other
+		kLockstepHalt_sideStopped,
+		kLockstepHalt_comparatorExited,
+	};
+
+	char const * lockstepHaltReason_name(LockstepHaltReason const reason);
+
+	// -- comparator ------------------------------------------------------------
+
+	struct LockstepOptions {
+		// records each side may run ahead of the comparator
+		uint64_t ringCapacity { 4096u };
+		// instructions between records, both sides use the comparator's
+		uint64_t interval { 1u };
+	};
+
+	// replaces a stale channel of the same name, returns a zero handle on
+	//   failure
+	LockstepChannel lockstep_create(
+		char const * const name,
+		LockstepOptions const & options = {}
+	);
+	// halts any side still attached and removes the channel
+	void lockstep_destroy(LockstepChannel & channel);
+
+	struct LockstepResult {
+		// none if both sides detached after publishing the same records
+		LockstepHaltReason haltReason;
+		bool isCancelled;
+		// the instruction count of the halting record, or the last one
+		//   compared
+		uint64_t instruction;
+		uint64_t comparedRecordCount;
+		// for kLockstepHalt_diverged, the regions whose hashes differ
+		std::vector<size_t> regionIndices;
+	};
+
+	// compares records as they arrive until the sides diverge, both detach or
+	//   cancel is set. The sides are halted with the result's reason
+	LockstepResult lockstep_compare(
+		LockstepChannel const channel,
+		std::atomic<bool> const & cancel
+	);
+
+	// the label a side registered, for reports
+	char const * lockstep_regionLabel(
+		LockstepChannel const channel,
+		size_t const side,
+		size_t const regionIndex
+	);
+
+	// -- emulator side ---------------------------------------------------------
+
+	// attaches to the first free side of an existing channel, returns a zero
+	//   handle if there's no such channel or both sides are taken
+	LockstepChannel lockstep_attach(
+		char const * const name,
+		uint64_t const regionCount,
+		SnortMemoryRegionCreateInfo const * regionCreateInfo
+	);
+	void lockstep_detach(LockstepChannel & channel);
+
+	size_t lockstep_side(LockstepChannel const channel);
+	uint64_t lockstep_interval(LockstepChannel const channel);
+
+	// publishes one hash per region, blocking while the ring is full. Returns
+	//   false once the channel is halted, the record is dropped then
+	bool lockstep_publish(
+		LockstepChannel const channel,
+		uint64_t const instruction,
+		uint64_t const * const regionHashes
+	);
+
+	// the halt reason, and the instruction the comparator halted at
+	LockstepHaltReason lockstep_haltReason(
+		LockstepChannel const channel,
+		uint64_t & instruction
+	);
+}
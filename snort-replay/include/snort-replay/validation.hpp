@@ -1,5 +1,40 @@
+#pragma once
+
 #include <snort-replay/fs.hpp>
 
+#include <vector>
+
 namespace SnortFs {
-	size_t validateMemory(ReplayFile const & replay, ReplayFile & replayCmp);
+	// the first instruction whose diffs differ, ~0u if none do. The
+	//   instructions are split into blocks that workerCount threads check
+	//   concurrently, zero uses every hardware thread. Blocks after the
+	//   earliest divergence found so far are skipped, so an early divergence
+	//   doesn't scan the rest of the replay. Version 1 replays can only be
+	//   parsed in order and are checked on the calling thread. Every
+	//   instruction of a block that fails its checksum counts as diverged
+	size_t validateMemory(
+		ReplayFile const & replay,
+		ReplayFile & replayCmp,
+		size_t const workerCount = 0u
+	);
+
+	// the first hash block two hash-only replays disagree on, instructions
+	//   are relative to the replay's instruction offset
+	struct HashDivergence {
+		// false if the replays can't be compared at all, e.g. one isn't
+		//   hash-only or they start at different instruction offsets. Nothing
+		//   else is set then
+		bool isComparable;
+		bool isDiverged;
+		uint64_t firstInstruction;
+		uint64_t instructionCount;
+		// regions whose hashes differ, empty if the blocks themselves don't
+		//   line up, e.g. different hash intervals
+		std::vector<size_t> regionIndices;
+	};
+
+	HashDivergence validateHashes(
+		ReplayFile const & replay,
+		ReplayFile const & replayCmp
+	);
 }
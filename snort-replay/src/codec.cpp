@@ -0,0 +1,306 @@
+#include "codec.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace {
+
+// -----------------------------------------------------------------------------
+// -- none ---------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+size_t noneEncodeBound(size_t const byteCount) { return byteCount; }
+
+size_t noneEncode(
+	uint8_t const * const src, size_t const srcByteCount, uint8_t * const dst
+) {
+	memcpy(dst, src, srcByteCount);
+	return srcByteCount;
+}
+
+bool noneDecode(
+	uint8_t const * const src, size_t const srcByteCount,
+	uint8_t * const dst, size_t const dstByteCount
+) {
+	if (srcByteCount != dstByteCount) { return false; }
+	memcpy(dst, src, srcByteCount);
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// -- rle ----------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+// control byte < 128 is followed by (control + 1) literal bytes, otherwise
+//   the next byte repeats (control - 128 + kRleMinRun) times
+constexpr size_t kRleMinRun { 3u };
+constexpr size_t kRleMaxRun { 127u + kRleMinRun };
+constexpr size_t kRleMaxLiterals { 128u };
+
+size_t rleEncodeBound(size_t const byteCount) {
+	return byteCount + (byteCount + kRleMaxLiterals - 1u) / kRleMaxLiterals;
+}
+
+size_t rleEncode(
+	uint8_t const * const src, size_t const srcByteCount, uint8_t * const dst
+) {
+	size_t op = 0u;
+	size_t literalStart = 0u;
+	auto const flushLiterals = [&](size_t const literalEnd) {
+		while (literalStart < literalEnd) {
+			size_t const count = std::min(kRleMaxLiterals, literalEnd - literalStart);
+			dst[op ++] = (uint8_t)(count - 1u);
+			memcpy(dst + op, src + literalStart, count);
+			op += count;
+			literalStart += count;
+		}
+	};
+	size_t ip = 0u;
+	while (ip < srcByteCount) {
+		size_t run = 1u;
+		while (
+			   ip + run < srcByteCount
+			&& run < kRleMaxRun
+			&& src[ip + run] == src[ip]
+		) {
+			++ run;
+		}
+		if (run < kRleMinRun) {
+			ip += run;
+			continue;
+		}
+		flushLiterals(ip);
+		dst[op ++] = (uint8_t)(128u + run - kRleMinRun);
+		dst[op ++] = src[ip];
+		ip += run;
+		literalStart = ip;
+	}
+	flushLiterals(srcByteCount);
+	return op;
+}
+
+bool rleDecode(
+	uint8_t const * const src, size_t const srcByteCount,
+	uint8_t * const dst, size_t const dstByteCount
+) {
+	size_t ip = 0u;
+	size_t op = 0u;
+	while (ip < srcByteCount) {
+		uint8_t const control = src[ip ++];
+		if (control < 128u) {
+			size_t const count = control + 1u;
+			if (count > srcByteCount - ip || count > dstByteCount - op) {
+				return false;
+			}
+			memcpy(dst + op, src + ip, count);
+			ip += count;
+			op += count;
+			continue;
+		}
+		size_t const count = control - 128u + kRleMinRun;
+		if (ip >= srcByteCount || count > dstByteCount - op) { return false; }
+		memset(dst + op, src[ip ++], count);
+		op += count;
+	}
+	return op == dstByteCount;
+}
+
+// -----------------------------------------------------------------------------
+// -- lz -----------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+// LZ4-style sequences: a token with the literal count in the high nibble and
+//   the match length (minus kLzMinMatch) in the low nibble, a nibble of 15
+//   continues in following bytes that are summed until one isn't 255. The
+//   literals follow the token, then a 2-byte match offset. The last sequence
+//   only has literals
+constexpr size_t kLzMinMatch { 4u };
+constexpr size_t kLzMaxOffset { 65535u };
+// the last bytes are always literals, so the match finder can read ahead
+constexpr size_t kLzLastLiterals { 5u };
+constexpr uint32_t kLzHashBits { 12u };
+
+uint32_t read32(uint8_t const * const ptr) {
+	uint32_t value;
+	memcpy(&value, ptr, 4);
+	return value;
+}
+
+uint32_t lzHash(uint32_t const sequence) {
+	return (sequence * 2654435761u) >> (32u - kLzHashBits);
+}
+
+size_t lzEncodeBound(size_t const byteCount) {
+	return byteCount + byteCount / 255u + 16u;
+}
+
+uint8_t * lzWriteLength(uint8_t * op, size_t length) {
+	for (; length >= 255u; length -= 255u) {
+		*op ++ = 255u;
+	}
+	*op ++ = (uint8_t)length;
+	return op;
+}
+
+size_t lzEncode(
+	uint8_t const * const src, size_t const srcByteCount, uint8_t * const dst
+) {
+	std::array<uint32_t, 1u << kLzHashBits> table {};
+	uint8_t * op = dst;
+	size_t anchor = 0u;
+	size_t ip = 0u;
+
+	auto const writeSequence = [&](
+		size_t const literalCount, size_t const offset, size_t const matchLength
+	) {
+		uint8_t * const token = op ++;
+		size_t const literalNibble = std::min<size_t>(literalCount, 15u);
+		if (literalCount >= 15u) { op = lzWriteLength(op, literalCount - 15u); }
+		memcpy(op, src + anchor, literalCount);
+		op += literalCount;
+		*token = (uint8_t)(literalNibble << 4u);
+		if (matchLength == 0u) { return; }
+		*op ++ = (uint8_t)(offset & 0xFFu);
+		*op ++ = (uint8_t)(offset >> 8u);
+		size_t const matchCode = matchLength - kLzMinMatch;
+		*token |= (uint8_t)std::min<size_t>(matchCode, 15u);
+		if (matchCode >= 15u) { op = lzWriteLength(op, matchCode - 15u); }
+	};
+
+	if (srcByteCount > kLzLastLiterals + kLzMinMatch) {
+		size_t const matchLimit = srcByteCount - kLzLastLiterals;
+		while (ip + kLzMinMatch <= matchLimit) {
+			uint32_t const sequence = read32(src + ip);
+			uint32_t & slot = table[lzHash(sequence)];
+			size_t const ref = slot;
+			slot = (uint32_t)ip;
+			if (
+				   ref >= ip
+				|| ip - ref > kLzMaxOffset
+				|| read32(src + ref) != sequence
+			) {
+				++ ip;
+				continue;
+			}
+			size_t matchLength = kLzMinMatch;
+			while (
+				   ip + matchLength < matchLimit
+				&& src[ref + matchLength] == src[ip + matchLength]
+			) {
+				++ matchLength;
+			}
+			writeSequence(ip - anchor, ip - ref, matchLength);
+			ip += matchLength;
+			anchor = ip;
+		}
+	}
+	writeSequence(srcByteCount - anchor, 0u, 0u);
+	return (size_t)(op - dst);
+}
+
+bool lzReadLength(
+	uint8_t const * const src, size_t const srcByteCount, size_t & ip,
+	size_t & length
+) {
+	uint8_t byte;
+	do {
+		if (ip >= srcByteCount) { return false; }
+		byte = src[ip ++];
+		length += byte;
+	} while (byte == 255u);
+	return true;
+}
+
+bool lzDecode(
+	uint8_t const * const src, size_t const srcByteCount,
+	uint8_t * const dst, size_t const dstByteCount
+) {
+	size_t ip = 0u;
+	size_t op = 0u;
+	while (ip < srcByteCount) {
+		uint8_t const token = src[ip ++];
+		// -- literals
+		size_t literalCount = token >> 4u;
+		if (literalCount == 15u && !lzReadLength(src, srcByteCount, ip, literalCount)) {
+			return false;
+		}
+		if (
+			   literalCount > srcByteCount - ip
+			|| literalCount > dstByteCount - op
+		) {
+			return false;
+		}
+		memcpy(dst + op, src + ip, literalCount);
+		ip += literalCount;
+		op += literalCount;
+		if (ip == srcByteCount) { break; }
+
+		// -- match
+		if (srcByteCount - ip < 2u) { return false; }
+		size_t const offset = (size_t)src[ip] | ((size_t)src[ip + 1u] << 8u);
+		ip += 2u;
+		size_t matchLength = token & 0xFu;
+		if (matchLength == 15u && !lzReadLength(src, srcByteCount, ip, matchLength)) {
+			return false;
+		}
+		matchLength += kLzMinMatch;
+		if (offset == 0u || offset > op || matchLength > dstByteCount - op) {
+			return false;
+		}
+		uint8_t const * ref = dst + op - offset;
+		if (offset >= matchLength) {
+			memcpy(dst + op, ref, matchLength);
+		}
+		else {
+			// overlapping match repeats the last offset bytes
+			for (size_t it = 0; it < matchLength; ++ it) {
+				dst[op + it] = ref[it];
+			}
+		}
+		op += matchLength;
+	}
+	return op == dstByteCount;
+}
+
+// -----------------------------------------------------------------------------
+
+// indexed by SnortFs::ReplayCodec
+constexpr SnortFs::codec::Codec kReplayCodecs[] = {
+	{ "none", noneEncodeBound, noneEncode, noneDecode },
+	{ "rle", rleEncodeBound, rleEncode, rleDecode },
+	{ "lz", lzEncodeBound, lzEncode, lzDecode },
+};
+
+} // namespace
+
+// --
+
+SnortFs::codec::Codec const * SnortFs::codec::find(uint64_t const codecId) {
+	if (codecId >= sizeof(kReplayCodecs) / sizeof(kReplayCodecs[0])) {
+		return nullptr;
+	}
+	return &kReplayCodecs[codecId];
+}
+
+// --
+
+bool SnortFs::replayCodec_fromName(
+	char const * const name,
+	ReplayCodec & codec
+) {
+	for (size_t it = 0; it < sizeof(kReplayCodecs) / sizeof(kReplayCodecs[0]); ++ it) {
+		if (strcmp(kReplayCodecs[it].name, name) == 0) {
+			codec = (ReplayCodec)it;
+			return true;
+		}
+	}
+	return false;
+}
+
+// --
+
+char const * SnortFs::replayCodec_name(ReplayCodec const codec) {
+	SnortFs::codec::Codec const * const codecPtr = SnortFs::codec::find(codec);
+	return codecPtr == nullptr ? "unknown" : codecPtr->name;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <snort-replay/fs.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+// block codecs used for replay chunk payloads. A codec is a table entry, to
+//   add one append it to kReplayCodecs in codec.cpp and to SnortFs::ReplayCodec
+
+namespace SnortFs::codec {
+
+	struct Codec {
+		char const * name;
+		// worst case encoded size for the given decoded size
+		size_t (*encodeBound)(size_t const byteCount);
+		// returns the encoded byte count, dst holds at least encodeBound bytes
+		size_t (*encode)(
+			uint8_t const * const src, size_t const srcByteCount,
+			uint8_t * const dst
+		);
+		// returns false if the encoded data is malformed or doesn't decode to
+		//   exactly dstByteCount bytes
+		bool (*decode)(
+			uint8_t const * const src, size_t const srcByteCount,
+			uint8_t * const dst, size_t const dstByteCount
+		);
+	};
+
+	// nullptr for an unknown codec id
+	Codec const * find(uint64_t const codecId);
+
+}
@@ -0,0 +1,239 @@
+#include <snort-replay/diff.hpp>
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SNORT_DIFF_X86 1
+#include <immintrin.h>
+#else
+#define SNORT_DIFF_X86 0
+#endif
+
+namespace {
+
+// the region is walked 64 bytes at a time, a kernel returns a mask with bit i
+//   set if byte (offset + i) differs. Span boundaries are then found from the
+//   mask's bit transitions, so the cost is per chunk plus per span rather
+//   than per byte
+constexpr size_t kChunkByteCount { 64u };
+
+struct Kernel {
+	char const * name;
+	uint64_t (*differentMask)(
+		uint8_t const * data, uint8_t const * reference, size_t offset
+	);
+};
+
+// -----------------------------------------------------------------------------
+// -- scalar -------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+constexpr uint64_t kLowSevenBits { 0x7F7F7F7F7F7F7F7Full };
+constexpr uint64_t kHighBits { 0x8080808080808080ull };
+// gathers the lowest bit of each byte into the top byte, byte i to bit i
+constexpr uint64_t kGatherBits { 0x0102040810204080ull };
+
+uint64_t scalarDifferentMask(
+	uint8_t const * const data,
+	uint8_t const * const reference,
+	size_t const offset
+) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t mask = 0u;
+	for (size_t wordIt = 0; wordIt < kChunkByteCount / 8u; ++ wordIt) {
+		uint64_t dataWord, referenceWord;
+		memcpy(&dataWord, data + offset + wordIt * 8u, 8);
+		memcpy(&referenceWord, reference + offset + wordIt * 8u, 8);
+		uint64_t const word = dataWord ^ referenceWord;
+		// high bit of every non-zero byte, without carries between bytes
+		uint64_t const nonZeroBytes = (
+			(((word & kLowSevenBits) + kLowSevenBits) | word) & kHighBits
+		);
+		mask |= (((nonZeroBytes >> 7u) * kGatherBits) >> 56u) << (wordIt * 8u);
+	}
+	return mask;
+#else
+	uint64_t mask = 0u;
+	for (size_t it = 0; it < kChunkByteCount; ++ it) {
+		mask |= (uint64_t)(data[offset + it] != reference[offset + it]) << it;
+	}
+	return mask;
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// -- sse2 / avx2 --------------------------------------------------------------
+// -----------------------------------------------------------------------------
+
+#if SNORT_DIFF_X86
+
+__attribute__((target("sse2")))
+uint64_t sse2DifferentMask(
+	uint8_t const * const data,
+	uint8_t const * const reference,
+	size_t const offset
+) {
+	uint64_t equalMask = 0u;
+	for (size_t laneIt = 0; laneIt < kChunkByteCount / 16u; ++ laneIt) {
+		__m128i const dataLane = (
+			_mm_loadu_si128((__m128i const *)(data + offset + laneIt * 16u))
+		);
+		__m128i const referenceLane = (
+			_mm_loadu_si128((__m128i const *)(reference + offset + laneIt * 16u))
+		);
+		equalMask |= (
+			  (uint64_t)(uint32_t)_mm_movemask_epi8(
+				_mm_cmpeq_epi8(dataLane, referenceLane)
+			)
+			<< (laneIt * 16u)
+		);
+	}
+	return ~equalMask;
+}
+
+__attribute__((target("avx2")))
+uint64_t avx2DifferentMask(
+	uint8_t const * const data,
+	uint8_t const * const reference,
+	size_t const offset
+) {
+	uint64_t equalMask = 0u;
+	for (size_t laneIt = 0; laneIt < kChunkByteCount / 32u; ++ laneIt) {
+		__m256i const dataLane = (
+			_mm256_loadu_si256((__m256i const *)(data + offset + laneIt * 32u))
+		);
+		__m256i const referenceLane = (
+			_mm256_loadu_si256(
+				(__m256i const *)(reference + offset + laneIt * 32u)
+			)
+		);
+		equalMask |= (
+			  (uint64_t)(uint32_t)_mm256_movemask_epi8(
+				_mm256_cmpeq_epi8(dataLane, referenceLane)
+			)
+			<< (laneIt * 32u)
+		);
+	}
+	return ~equalMask;
+}
+
+#endif
+
+// -----------------------------------------------------------------------------
+
+// indexed by SnortFs::DiffKernel, the best entry is resolved on first use
+constexpr Kernel kKernels[] = {
+	{ "best", nullptr },
+	{ "scalar", scalarDifferentMask },
+#if SNORT_DIFF_X86
+	{ "sse2", sse2DifferentMask },
+	{ "avx2", avx2DifferentMask },
+#else
+	{ "sse2", nullptr },
+	{ "avx2", nullptr },
+#endif
+};
+
+Kernel const & bestKernel() {
+	static Kernel const & kernel = []() -> Kernel const & {
+		for (
+			SnortFs::DiffKernel const kernel : {
+				SnortFs::kDiffKernel_avx2, SnortFs::kDiffKernel_sse2,
+			}
+		) {
+			if (SnortFs::diffKernel_isSupported(kernel)) {
+				return kKernels[kernel];
+			}
+		}
+		return kKernels[SnortFs::kDiffKernel_scalar];
+	}();
+	return kernel;
+}
+
+} // namespace
+
+// --
+
+bool SnortFs::diffKernel_isSupported(DiffKernel const kernel) {
+	switch (kernel) {
+		case kDiffKernel_best: return true;
+		case kDiffKernel_scalar: return true;
+#if SNORT_DIFF_X86
+		case kDiffKernel_sse2: return __builtin_cpu_supports("sse2");
+		case kDiffKernel_avx2: return __builtin_cpu_supports("avx2");
+#endif
+		default: return false;
+	}
+}
+
+// --
+
+char const * SnortFs::diffKernel_name(DiffKernel const kernel) {
+	if (kernel == kDiffKernel_best) { return ::bestKernel().name; }
+	return kKernels[kernel].name;
+}
+
+// --
+
+void SnortFs::diff_findSpans(
+	uint8_t const * const data,
+	uint8_t const * const reference,
+	size_t const byteCount,
+	std::vector<MemoryRegionDiffRecord> & records,
+	DiffKernel const kernel
+) {
+	Kernel const & kernelImpl = (
+		(kernel == kDiffKernel_best || !diffKernel_isSupported(kernel))
+		? ::bestKernel()
+		: kKernels[kernel]
+	);
+	bool isInSpan = false;
+	size_t spanStart = 0u;
+	auto const endSpan = [&](size_t const spanEnd) {
+		records.emplace_back(MemoryRegionDiffRecord {
+			.byteOffset = spanStart,
+			.byteCount = spanEnd - spanStart,
+			.data = data + spanStart,
+		});
+		isInSpan = false;
+	};
+
+	// -- whole chunks, each step finds the next bit that flips the span state
+	size_t offset = 0u;
+	for (; offset + kChunkByteCount <= byteCount; offset += kChunkByteCount) {
+		uint64_t const different = (
+			kernelImpl.differentMask(data, reference, offset)
+		);
+		for (uint64_t remaining = ~0ull;;) {
+			uint64_t const candidates = (
+				(isInSpan ? ~different : different) & remaining
+			);
+			if (candidates == 0u) { break; }
+			size_t const bit = (size_t)__builtin_ctzll(candidates);
+			if (isInSpan) {
+				endSpan(offset + bit);
+			}
+			else {
+				spanStart = offset + bit;
+				isInSpan = true;
+			}
+			// the flipped bit doesn't match the new state, so it can stay
+			remaining = ~0ull << bit;
+		}
+	}
+
+	// -- remaining bytes
+	for (; offset < byteCount; ++ offset) {
+		bool const isDifferent = (data[offset] != reference[offset]);
+		if (isDifferent && !isInSpan) {
+			spanStart = offset;
+			isInSpan = true;
+		}
+		else if (!isDifferent && isInSpan) {
+			endSpan(offset);
+		}
+	}
+	if (isInSpan) {
+		endSpan(byteCount);
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// constants shared between the replay reader and recorder, the layout itself
+//   is documented in snort-replay/fs.hpp
+
+namespace SnortFs::format {
+
+	constexpr char kMagicV1[8] = { 'S', 'N', 'O', 'R', 'T', 'R', 'P', 'L' };
+	constexpr char kMagicV2[8] = { 'S', 'N', 'O', 'R', 'T', 'R', 'P', '2' };
+	constexpr char kMagicIndex[8] = { 'S', 'N', 'O', 'R', 'T', 'I', 'D', 'X' };
+
+	enum HeaderFlag : uint64_t {
+		// the header has a codec id after the flags, chunk payloads are encoded
+		kHeaderFlag_blockCodec = 1u << 0u,
+		// diff counts, byte offsets and byte counts are LEB128 varints
+		kHeaderFlag_varintDiffs = 1u << 1u,
+		// instructions start with a mask of the regions that have diffs, and
+		//   only those regions store a diff count
+		kHeaderFlag_regionMask = 1u << 2u,
+		// hash chunks instead of instruction chunks, there are no diffs
+		kHeaderFlag_hashOnly = 1u << 3u,
+		// the header has the rng seed after the codec id
+		kHeaderFlag_rngSeed = 1u << 4u,
+		// the emulator's inputs are recorded in input chunks
+		kHeaderFlag_inputs = 1u << 5u,
+	};
+	constexpr uint64_t kHeaderFlagsKnown {
+		  kHeaderFlag_blockCodec
+		| kHeaderFlag_varintDiffs
+		| kHeaderFlag_regionMask
+		| kHeaderFlag_hashOnly
+		| kHeaderFlag_rngSeed
+		| kHeaderFlag_inputs
+	};
+
+	constexpr size_t regionMaskByteCount(size_t const regionCount) {
+		return (regionCount + 7u) / 8u;
+	}
+
+	// a u64 takes at most 10 bytes as a LEB128 varint
+	constexpr size_t kVarintMaxByteCount { 10u };
+
+	// encoded chunk payloads start with the decoded byte count
+	constexpr size_t kEncodedPayloadHeaderByteCount { 8u };
+
+	enum ChunkType : uint64_t {
+		kChunkType_instructions = 1u,
+		// full memory of every region after the chunk's first instruction,
+		//   the instruction count is always zero
+		kChunkType_keyframe = 2u,
+		// one hash per region, folded over every instruction of the chunk
+		kChunkType_hashes = 3u,
+		// input state changes of the instruction or hash chunk that follows
+		kChunkType_inputs = 4u,
+	};
+
+	// type, first instruction, instruction count, payload byte count
+	constexpr size_t kChunkHeaderByteCount { 32u };
+
+	struct ChunkIndexEntry {
+		uint64_t type;
+		uint64_t firstInstruction;
+		uint64_t instructionCount;
+		// byte offset of the chunk header in the file
+		uint64_t byteOffset;
+		uint64_t payloadByteCount;
+		uint64_t checksum;
+	};
+	constexpr size_t kIndexEntryByteCount { sizeof(ChunkIndexEntry) };
+	static_assert(kIndexEntryByteCount == 48u);
+
+	// the recorder closes an instruction block once it holds this many
+	//   instructions, or once its payload grows past the flush byte count
+	constexpr uint64_t kBlockInstructionCount { 1024u };
+	constexpr size_t kBlockFlushByteCount { 1024ull * 1024ull };
+
+}
@@ -0,0 +1,107 @@
+#include <snort-replay/hash.hpp>
+
+#include <cstring>
+
+namespace {
+
+constexpr uint64_t kPrime1 { 0x9E3779B185EBCA87ull };
+constexpr uint64_t kPrime2 { 0xC2B2AE3D27D4EB4Full };
+constexpr uint64_t kPrime3 { 0x165667B19E3779F9ull };
+constexpr uint64_t kPrime4 { 0x85EBCA77C2B2AE63ull };
+constexpr uint64_t kPrime5 { 0x27D4EB2F165667C5ull };
+
+uint64_t rotl(uint64_t const x, int const r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+uint64_t read64(uint8_t const * const ptr) {
+	uint64_t value;
+	memcpy(&value, ptr, 8);
+	return value;
+}
+
+uint32_t read32(uint8_t const * const ptr) {
+	uint32_t value;
+	memcpy(&value, ptr, 4);
+	return value;
+}
+
+uint64_t round(uint64_t acc, uint64_t const input) {
+	acc += input * kPrime2;
+	acc = rotl(acc, 31);
+	return acc * kPrime1;
+}
+
+uint64_t mergeRound(uint64_t acc, uint64_t const value) {
+	acc ^= round(0u, value);
+	return acc * kPrime1 + kPrime4;
+}
+
+} // namespace
+
+// --
+
+uint64_t SnortFs::hash64(
+	void const * const data,
+	size_t const byteCount,
+	uint64_t const seed
+) {
+	uint8_t const * ptr = (uint8_t const *)data;
+	uint8_t const * const end = ptr + byteCount;
+	uint64_t hash;
+
+	// -- consume 32-byte stripes over four independent lanes
+	if (byteCount >= 32u) {
+		uint64_t v0 = seed + kPrime1 + kPrime2;
+		uint64_t v1 = seed + kPrime2;
+		uint64_t v2 = seed;
+		uint64_t v3 = seed - kPrime1;
+		uint8_t const * const stripeEnd = end - 32u;
+		do {
+			v0 = ::round(v0, read64(ptr +  0u));
+			v1 = ::round(v1, read64(ptr +  8u));
+			v2 = ::round(v2, read64(ptr + 16u));
+			v3 = ::round(v3, read64(ptr + 24u));
+			ptr += 32u;
+		} while (ptr <= stripeEnd);
+		hash = rotl(v0, 1) + rotl(v1, 7) + rotl(v2, 12) + rotl(v3, 18);
+		hash = mergeRound(hash, v0);
+		hash = mergeRound(hash, v1);
+		hash = mergeRound(hash, v2);
+		hash = mergeRound(hash, v3);
+	}
+	else {
+		hash = seed + kPrime5;
+	}
+	hash += (uint64_t)byteCount;
+
+	// -- consume the tail
+	for (; ptr + 8u <= end; ptr += 8u) {
+		hash ^= ::round(0u, read64(ptr));
+		hash = rotl(hash, 27) * kPrime1 + kPrime4;
+	}
+	if (ptr + 4u <= end) {
+		hash ^= (uint64_t)read32(ptr) * kPrime1;
+		hash = rotl(hash, 23) * kPrime2 + kPrime3;
+		ptr += 4u;
+	}
+	for (; ptr < end; ++ ptr) {
+		hash ^= (uint64_t)(*ptr) * kPrime5;
+		hash = rotl(hash, 11) * kPrime1;
+	}
+
+	// -- avalanche
+	hash ^= hash >> 33;
+	hash *= kPrime2;
+	hash ^= hash >> 29;
+	hash *= kPrime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+// --
+
+uint64_t SnortFs::hash64_fold(uint64_t const hash, uint64_t const value) {
+	// the same step hash64 consumes each 8 bytes of its tail with
+	return rotl(hash ^ ::round(0u, value), 27) * kPrime1 + kPrime4;
+}
@@ -0,0 +1,510 @@
+#include <snort-replay/lockstep.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[8] = { 'S', 'N', 'O', 'R', 'T', 'L', 'S', '1' };
+constexpr size_t kRegionLabelByteCount { 32u };
+// the sides and the comparator share it across processes, so no futexes
+//   through std::atomic::wait, which may be process local
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+enum SideState : uint32_t {
+	kSideState_free,
+	// claimed, the region layout is being written
+	kSideState_claiming,
+	kSideState_attached,
+	kSideState_detached,
+};
+
+// head and tail on their own cache lines, one is written by the side and
+//   the other by the comparator
+struct SideHeader {
+	alignas(64) std::atomic<uint64_t> head;
+	alignas(64) std::atomic<uint64_t> tail;
+	alignas(64) std::atomic<uint32_t> state;
+	int32_t processId;
+	uint64_t regionCount;
+	uint64_t regionByteCounts[SnortFs::kLockstepMaxRegionCount];
+	char regionLabels[SnortFs::kLockstepMaxRegionCount][kRegionLabelByteCount];
+};
+
+struct ChannelHeader {
+	char magic[8];
+	uint64_t ringCapacity;
+	uint64_t interval;
+	std::atomic<uint64_t> attachedCount;
+	std::atomic<uint32_t> haltReason;
+	uint64_t haltInstruction;
+	SideHeader sides[2];
+};
+
+struct Record {
+	uint64_t instruction;
+	uint64_t regionHashes[SnortFs::kLockstepMaxRegionCount];
+};
+
+struct Channel {
+	std::string shmName;
+	ChannelHeader * header { nullptr };
+	size_t byteCount { 0u };
+	bool isCreator { false };
+	size_t side { 0u };
+	// the side's head, only it writes the shared one
+	uint64_t head { 0u };
+};
+
+// --
+
+std::string shmName(char const * const name) {
+	return std::string("/snort-lockstep-") + name;
+}
+
+size_t channelByteCount(uint64_t const ringCapacity) {
+	return sizeof(ChannelHeader) + 2u * ringCapacity * sizeof(Record);
+}
+
+Record * ring(ChannelHeader * const header, size_t const side) {
+	return (
+		  (Record *)((uint8_t *)header + sizeof(ChannelHeader))
+		+ side * header->ringCapacity
+	);
+}
+
+Channel & channelFromHandle(SnortFs::LockstepChannel const channel) {
+	return *(Channel *)(uintptr_t)(channel.handle);
+}
+
+// spins briefly, then yields, then sleeps. Waits are either on the other
+//   process or on a human, so there's nothing to wake up on
+void backoff(uint32_t & idleCount) {
+	++ idleCount;
+	if (idleCount < 64u) { return; }
+	if (idleCount < 1024u) {
+		std::this_thread::yield();
+		return;
+	}
+	std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+bool isProcessAlive(int32_t const processId) {
+	return !(kill((pid_t)processId, 0) == -1 && errno == ESRCH);
+}
+
+// the first halt wins, the sides only ever see one reason
+void halt(
+	ChannelHeader & header,
+	SnortFs::LockstepHaltReason const reason,
+	uint64_t const instruction
+) {
+	uint32_t expected = SnortFs::kLockstepHalt_none;
+	if (header.haltReason.load(std::memory_order_acquire) != expected) {
+		return;
+	}
+	header.haltInstruction = instruction;
+	header.haltReason.compare_exchange_strong(
+		expected, (uint32_t)reason, std::memory_order_release
+	);
+}
+
+bool isLayoutMatching(ChannelHeader const & header) {
+	SideHeader const & side0 = header.sides[0];
+	SideHeader const & side1 = header.sides[1];
+	if (side0.regionCount != side1.regionCount) { return false; }
+	for (size_t it = 0; it < side0.regionCount; ++ it) {
+		if (side0.regionByteCounts[it] != side1.regionByteCounts[it]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+} // namespace
+
+// --
+
+char const * SnortFs::lockstepHaltReason_name(
+	SnortFs::LockstepHaltReason const reason
+) {
+	switch (reason) {
+		case kLockstepHalt_none: return "none";
+		case kLockstepHalt_diverged: return "diverged";
+		case kLockstepHalt_outOfStep: return "out of step";
+		case kLockstepHalt_layoutMismatch: return "region layout mismatch";
+		case kLockstepHalt_sideStopped: return "a side stopped early";
+		case kLockstepHalt_comparatorExited: return "comparator exited";
+	}
+	return "unknown";
+}
+
+// --
+
+SnortFs::LockstepChannel SnortFs::lockstep_create(
+	char const * const name,
+	SnortFs::LockstepOptions const & options
+) {
+	uint64_t const ringCapacity = std::max<uint64_t>(options.ringCapacity, 1u);
+	Channel * const channel = new Channel {
+		.shmName = ::shmName(name),
+		.byteCount = ::channelByteCount(ringCapacity),
+		.isCreator = true,
+	};
+	// a channel left behind by a comparator that didn't exit cleanly
+	shm_unlink(channel->shmName.c_str());
+	int const fd = (
+		shm_open(channel->shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600)
+	);
+	if (fd < 0 || ftruncate(fd, (off_t)channel->byteCount) != 0) {
+		printf(
+			"failed to create lockstep channel %s\n", channel->shmName.c_str()
+		);
+		if (fd >= 0) {
+			close(fd);
+			shm_unlink(channel->shmName.c_str());
+		}
+		delete channel;
+		return SnortFs::LockstepChannel { 0 };
+	}
+	void * const bytes = (
+		mmap(
+			nullptr, channel->byteCount, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0
+		)
+	);
+	close(fd);
+	if (bytes == MAP_FAILED) {
+		printf("failed to map lockstep channel %s\n", channel->shmName.c_str());
+		shm_unlink(channel->shmName.c_str());
+		delete channel;
+		return SnortFs::LockstepChannel { 0 };
+	}
+
+	// -- the mapping is zeroed, the header only needs its fields. The magic
+	//    number goes last, attaching checks it
+	channel->header = new (bytes) ChannelHeader {};
+	channel->header->ringCapacity = ringCapacity;
+	channel->header->interval = std::max<uint64_t>(options.interval, 1u);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(channel->header->magic, kMagic, sizeof(kMagic));
+	return SnortFs::LockstepChannel { .handle = (uint64_t)(uintptr_t)channel };
+}
+
+// --
+
+void SnortFs::lockstep_destroy(SnortFs::LockstepChannel & channelHandle) {
+	if (channelHandle.handle == 0u) { return; }
+	Channel * const channel = &::channelFromHandle(channelHandle);
+	::halt(*channel->header, kLockstepHalt_comparatorExited, 0u);
+	munmap(channel->header, channel->byteCount);
+	shm_unlink(channel->shmName.c_str());
+	delete channel;
+	channelHandle.handle = 0u;
+}
+
+// --
+
+SnortFs::LockstepResult SnortFs::lockstep_compare(
+	SnortFs::LockstepChannel const channelHandle,
+	std::atomic<bool> const & cancel
+) {
+	ChannelHeader & header = *::channelFromHandle(channelHandle).header;
+	SideHeader & side0 = header.sides[0];
+	SideHeader & side1 = header.sides[1];
+	Record const * const ring0 = ::ring(&header, 0u);
+	Record const * const ring1 = ::ring(&header, 1u);
+
+	SnortFs::LockstepResult result {
+		.haltReason = kLockstepHalt_none,
+		.isCancelled = false,
+		.instruction = 0u,
+		.comparedRecordCount = 0u,
+		.regionIndices = {},
+	};
+	auto const haltWith = [&](SnortFs::LockstepHaltReason const reason) {
+		result.haltReason = reason;
+		::halt(header, reason, result.instruction);
+		return result;
+	};
+
+	uint64_t tail = 0u;
+	bool isLayoutChecked = false;
+	uint32_t idleCount = 0u;
+	while (true) {
+		if (cancel.load(std::memory_order_relaxed)) {
+			result.isCancelled = true;
+			return haltWith(kLockstepHalt_comparatorExited);
+		}
+
+		// -- the states before the heads, a side publishes everything before
+		//    it detaches
+		uint32_t const state0 = side0.state.load(std::memory_order_acquire);
+		uint32_t const state1 = side1.state.load(std::memory_order_acquire);
+		if (
+			   !isLayoutChecked
+			&& state0 >= kSideState_attached
+			&& state1 >= kSideState_attached
+		) {
+			if (!::isLayoutMatching(header)) {
+				return haltWith(kLockstepHalt_layoutMismatch);
+			}
+			isLayoutChecked = true;
+		}
+		uint64_t const head0 = side0.head.load(std::memory_order_acquire);
+		uint64_t const head1 = side1.head.load(std::memory_order_acquire);
+
+		// -- compare whatever both sides have published
+		uint64_t const available = (
+			isLayoutChecked ? std::min(head0, head1) - tail : 0u
+		);
+		for (uint64_t it = 0; it < available; ++ it) {
+			Record const & record0 = ring0[(tail + it) % header.ringCapacity];
+			Record const & record1 = ring1[(tail + it) % header.ringCapacity];
+			result.instruction = record0.instruction;
+			if (record0.instruction != record1.instruction) {
+				return haltWith(kLockstepHalt_outOfStep);
+			}
+			for (size_t region = 0; region < side0.regionCount; ++ region) {
+				if (record0.regionHashes[region] != record1.regionHashes[region]) {
+					result.regionIndices.push_back(region);
+				}
+			}
+			if (!result.regionIndices.empty()) {
+				return haltWith(kLockstepHalt_diverged);
+			}
+			++ result.comparedRecordCount;
+		}
+		if (available > 0u) {
+			tail += available;
+			side0.tail.store(tail, std::memory_order_release);
+			side1.tail.store(tail, std::memory_order_release);
+			idleCount = 0u;
+			continue;
+		}
+
+		// -- nothing to compare, one of the sides may be gone. The process
+		//    checks are syscalls, so only once the wait has gone on a bit
+		bool const isChecking = (idleCount % 1024u) == 1023u;
+		bool const isStopped0 = (
+			   state0 == kSideState_detached
+			|| (
+				   isChecking
+				&& state0 == kSideState_attached
+				&& !::isProcessAlive(side0.processId)
+			)
+		);
+		bool const isStopped1 = (
+			   state1 == kSideState_detached
+			|| (
+				   isChecking
+				&& state1 == kSideState_attached
+				&& !::isProcessAlive(side1.processId)
+			)
+		);
+		if (isStopped0 && isStopped1 && head0 == head1) {
+			return result;
+		}
+		if ((isStopped0 && head0 == tail) || (isStopped1 && head1 == tail)) {
+			return haltWith(kLockstepHalt_sideStopped);
+		}
+		::backoff(idleCount);
+	}
+}
+
+// --
+
+char const * SnortFs::lockstep_regionLabel(
+	SnortFs::LockstepChannel const channelHandle,
+	size_t const side,
+	size_t const regionIndex
+) {
+	ChannelHeader const & header = *::channelFromHandle(channelHandle).header;
+	return header.sides[side].regionLabels[regionIndex];
+}
+
+// --
+
+SnortFs::LockstepChannel SnortFs::lockstep_attach(
+	char const * const name,
+	uint64_t const regionCount,
+	SnortMemoryRegionCreateInfo const * regionCreateInfo
+) {
+	if (regionCount > kLockstepMaxRegionCount) {
+		printf(
+			"cannot lockstep %zu regions, at most %zu are supported\n",
+			(size_t)regionCount, kLockstepMaxRegionCount
+		);
+		return SnortFs::LockstepChannel { 0 };
+	}
+	std::string const channelName = ::shmName(name);
+	int const fd = shm_open(channelName.c_str(), O_RDWR, 0600);
+	struct stat fileStat;
+	if (fd < 0 || fstat(fd, &fileStat) != 0) {
+		printf(
+			"failed to open lockstep channel %s, is snort-lockstep %s running?\n",
+			channelName.c_str(), name
+		);
+		if (fd >= 0) { close(fd); }
+		return SnortFs::LockstepChannel { 0 };
+	}
+	size_t const byteCount = (size_t)fileStat.st_size;
+	void * const bytes = (
+		byteCount < sizeof(ChannelHeader)
+		? MAP_FAILED
+		: mmap(nullptr, byteCount, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+	);
+	close(fd);
+	if (bytes == MAP_FAILED) {
+		printf("failed to map lockstep channel %s\n", channelName.c_str());
+		return SnortFs::LockstepChannel { 0 };
+	}
+	ChannelHeader * const header = (ChannelHeader *)bytes;
+	auto const fail = [&](char const * const why) {
+		printf(
+			"cannot attach to lockstep channel %s, %s\n", channelName.c_str(), why
+		);
+		munmap(bytes, byteCount);
+		return SnortFs::LockstepChannel { 0 };
+	};
+	if (
+		   memcmp(header->magic, kMagic, sizeof(kMagic)) != 0
+		|| byteCount < ::channelByteCount(header->ringCapacity)
+	) {
+		return fail("it isn't a lockstep channel");
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (header->haltReason.load(std::memory_order_acquire) != kLockstepHalt_none) {
+		return fail("it has already halted");
+	}
+
+	// -- claim a side, the layout is written before the comparator may
+	//    look at it
+	size_t side = 0u;
+	for (; side < 2u; ++ side) {
+		uint32_t expected = kSideState_free;
+		bool const isClaimed = (
+			header->sides[side].state.compare_exchange_strong(
+				expected, kSideState_claiming, std::memory_order_acq_rel
+			)
+		);
+		if (isClaimed) { break; }
+	}
+	if (side == 2u) {
+		return fail("both sides are taken");
+	}
+	SideHeader & sideHeader = header->sides[side];
+	sideHeader.processId = (int32_t)getpid();
+	sideHeader.regionCount = regionCount;
+	for (size_t it = 0; it < regionCount; ++ it) {
+		sideHeader.regionByteCounts[it] = (
+			  regionCreateInfo[it].elementCount
+			* snort_dtByteCount(regionCreateInfo[it].dataType)
+		);
+		strncpy(
+			sideHeader.regionLabels[it],
+			regionCreateInfo[it].label,
+			kRegionLabelByteCount - 1u
+		);
+	}
+	sideHeader.state.store(kSideState_attached, std::memory_order_release);
+	header->attachedCount.fetch_add(1u, std::memory_order_relaxed);
+
+	Channel * const channel = new Channel {
+		.shmName = channelName,
+		.header = header,
+		.byteCount = byteCount,
+		.isCreator = false,
+		.side = side,
+	};
+	return SnortFs::LockstepChannel { .handle = (uint64_t)(uintptr_t)channel };
+}
+
+// --
+
+void SnortFs::lockstep_detach(SnortFs::LockstepChannel & channelHandle) {
+	if (channelHandle.handle == 0u) { return; }
+	Channel * const channel = &::channelFromHandle(channelHandle);
+	channel->header->sides[channel->side].state.store(
+		kSideState_detached, std::memory_order_release
+	);
+	munmap(channel->header, channel->byteCount);
+	delete channel;
+	channelHandle.handle = 0u;
+}
+
+// --
+
+size_t SnortFs::lockstep_side(SnortFs::LockstepChannel const channel) {
+	return ::channelFromHandle(channel).side;
+}
+
+// --
+
+uint64_t SnortFs::lockstep_interval(SnortFs::LockstepChannel const channel) {
+	return ::channelFromHandle(channel).header->interval;
+}
+
+// --
+
+bool SnortFs::lockstep_publish(
+	SnortFs::LockstepChannel const channelHandle,
+	uint64_t const instruction,
+	uint64_t const * const regionHashes
+) {
+	Channel & channel = ::channelFromHandle(channelHandle);
+	ChannelHeader & header = *channel.header;
+	SideHeader & side = header.sides[channel.side];
+
+	// -- backpressure, wait for the comparator to catch up
+	uint32_t idleCount = 0u;
+	while (
+		  channel.head - side.tail.load(std::memory_order_acquire)
+		>= header.ringCapacity
+	) {
+		if (header.haltReason.load(std::memory_order_relaxed) != 0u) {
+			return false;
+		}
+		::backoff(idleCount);
+	}
+	if (header.haltReason.load(std::memory_order_relaxed) != 0u) {
+		return false;
+	}
+
+	Record & record = (
+		::ring(&header, channel.side)[channel.head % header.ringCapacity]
+	);
+	record.instruction = instruction;
+	memcpy(
+		record.regionHashes, regionHashes, side.regionCount * sizeof(uint64_t)
+	);
+	++ channel.head;
+	side.head.store(channel.head, std::memory_order_release);
+	return true;
+}
+
+// --
+
+SnortFs::LockstepHaltReason SnortFs::lockstep_haltReason(
+	SnortFs::LockstepChannel const channelHandle,
+	uint64_t & instruction
+) {
+	ChannelHeader const & header = *::channelFromHandle(channelHandle).header;
+	auto const reason = (SnortFs::LockstepHaltReason)(
+		header.haltReason.load(std::memory_order_acquire)
+	);
+	instruction = header.haltInstruction;
+	return reason;
+}
@@ -1,84 +1,828 @@
 #include <snort-replay/fs.hpp>
 
+#include <snort-replay/hash.hpp>
 #include <snort-replay/validation.hpp>
 
-#include <array>
+#include "codec.hpp"
+#include "format.hpp"
+
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <cstring>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace format = SnortFs::format;
+
 namespace {
 
-struct MemoryRegionDiff {
+// version 1 files have no chunks, so they are split into blocks of this many
+//   instructions which are parsed in order
+constexpr uint64_t kReaderBlockInstructionCountV1 { 1024u };
+
+// instructions are parsed lazily, a block at a time, the first time any of
+//   their diffs are requested
+struct InstructionBlock {
+	uint64_t firstInstruction { 0 };
+	uint64_t instructionCount { 0 };
+	// byte range of the block's instruction data
+	uint64_t byteOffset { 0 };
+	uint64_t byteEnd { 0 };
+	uint64_t checksum { 0 };
+	bool hasChecksum { false };
+	bool isParsed { false };
+	// a block that fails its checksum is parsed without any diffs, rather
+	//   than serving corrupt ones
+	bool hasChecksumError { false };
+	// payload of a compressed block, decoded when the block is parsed
+	std::vector<uint8_t> decodedBytes {};
+	// diffs point straight into the file bytes, or into decodedBytes for
+	//   compressed blocks. regionDiffOffsets holds the
+	//   index of the first diff of each (instruction, region) pair, plus one
+	//   trailing entry so that the diff count is the distance to the next
+	std::vector<SnortFs::MemoryRegionDiff> diffs {};
+	std::vector<uint32_t> regionDiffOffsets {};
+};
+
+struct Keyframe {
+	uint64_t instructionIndex;
+	uint64_t byteOffset;
+	uint64_t byteEnd;
+	uint64_t checksum;
+	bool hasChecksum;
+	bool isVerified { false };
+	bool isCorrupt { false };
+};
+
+// hash-only files, the region hashes are read when the block is requested
+struct HashBlock {
+	uint64_t firstInstruction;
+	uint64_t instructionCount;
+	uint64_t byteOffset;
+	uint64_t byteEnd;
+	uint64_t checksum;
+	bool hasChecksum;
+};
+
+// input chunks are parsed together, the first time an input is requested
+struct InputChunk {
+	uint64_t firstInstruction;
 	uint64_t byteOffset;
-	uint64_t byteCount;
-	std::vector<uint8_t> data;
+	uint64_t byteEnd;
+	uint64_t checksum;
+	bool hasChecksum;
 };
 
-struct FileInstruction {
-	std::vector<std::vector<MemoryRegionDiff>> regionDiffs;
-	std::vector<std::vector<SnortFs::MemoryRegionDiff>> regionDiffRaw;
+struct InputChange {
+	uint64_t instructionIndex;
+	uint64_t inputState;
 };
 
 struct FileData {
+	uint64_t version;
+	uint64_t flags;
+	SnortFs::ReplayCodec codecId { SnortFs::kReplayCodec_none };
+	uint64_t rngSeed { 0 };
+	// nullptr if the chunk payloads are stored as is
+	SnortFs::codec::Codec const * codec { nullptr };
 	SnortCommonInterface commonInterface;
 	uint64_t instructionOffset;
+	uint64_t instructionCount;
 	std::vector<SnortMemoryRegionCreateInfo> regionCreateInfo;
 	std::vector<std::string> regionLabels;
-	std::vector<FileInstruction> instructions;
 
-	std::string recordingFilepath;
-	uint64_t recordingRegionOffset {0};
-	uint64_t recordingInstructionIndex {0};
-	uint64_t recordingByteCount {0};
+	std::string filepath;
+	// either the memory-mapping of the file, or loadedBytes
+	uint8_t const * bytes { nullptr };
+	size_t byteCount { 0 };
+	bool isMapped { false };
+	std::vector<uint8_t> loadedBytes {};
+
+	bool hasIndex { false };
+	std::vector<InstructionBlock> blocks {};
+	std::vector<Keyframe> keyframes {};
+	std::vector<HashBlock> hashBlocks {};
+	std::vector<InputChunk> inputChunks {};
+	std::vector<InputChange> inputChanges {};
+	bool areInputsParsed { false };
+};
+
+bool isHashOnly(FileData const & fileData) {
+	return (fileData.flags & format::kHeaderFlag_hashOnly) != 0u;
+}
+
+// bounds-checked sequential reads over the file bytes, reading past the end
+//   yields zeroes and flags the cursor as overrun
+struct FileCursor {
+	uint8_t const * bytes;
+	size_t byteCount;
+	size_t offset;
+	bool overrun { false };
+
+	uint8_t const * take(size_t const takeByteCount) {
+		if (overrun || takeByteCount > byteCount - offset) {
+			overrun = true;
+			return nullptr;
+		}
+		uint8_t const * const ptr = bytes + offset;
+		offset += takeByteCount;
+		return ptr;
+	}
+
+	uint64_t u64() {
+		uint64_t value = 0u;
+		if (uint8_t const * const ptr = take(8); ptr != nullptr) {
+			memcpy(&value, ptr, 8);
+		}
+		return value;
+	}
+
+	// unsigned LEB128, a varint longer than a u64 flags the cursor as overrun
+	uint64_t varint() {
+		uint64_t value = 0u;
+		for (size_t it = 0; it < format::kVarintMaxByteCount; ++ it) {
+			uint8_t const * const ptr = take(1);
+			if (ptr == nullptr) { return 0u; }
+			value |= (uint64_t)(*ptr & 0x7Fu) << (it * 7u);
+			if ((*ptr & 0x80u) == 0u) { return value; }
+		}
+		overrun = true;
+		return 0u;
+	}
+};
+
+bool mapFile(FileData & fileData, char const * const filepath) {
+	int const fd = open(filepath, O_RDONLY);
+	if (fd < 0) { return false; }
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void * const mapping = (
+		mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0)
+	);
+	close(fd);
+	if (mapping == MAP_FAILED) { return false; }
+	fileData.bytes = (uint8_t const *)mapping;
+	fileData.byteCount = (size_t)fileStat.st_size;
+	fileData.isMapped = true;
+	return true;
+}
+
+bool loadFile(FileData & fileData, char const * const filepath) {
+	FILE * filePtr = fopen(filepath, "rb");
+	if (filePtr == nullptr) { return false; }
+	fseek(filePtr, 0, SEEK_END);
+	long const byteCount = ftell(filePtr);
+	fseek(filePtr, 0, SEEK_SET);
+	if (byteCount <= 0) {
+		fclose(filePtr);
+		return false;
+	}
+	fileData.loadedBytes.resize((size_t)byteCount);
+	size_t const readCount = (
+		fread(fileData.loadedBytes.data(), 1, (size_t)byteCount, filePtr)
+	);
+	fclose(filePtr);
+	if (readCount != (size_t)byteCount) { return false; }
+	fileData.bytes = fileData.loadedBytes.data();
+	fileData.byteCount = fileData.loadedBytes.size();
+	return true;
+}
+
+void unmapFile(FileData & fileData) {
+	if (!fileData.isMapped) { return; }
+	munmap((void *)fileData.bytes, fileData.byteCount);
+	fileData.bytes = nullptr;
+	fileData.isMapped = false;
+}
+
+// version 1 files, the instructions follow the region info until the
+//   trailing magic number. Only the first block's offset is known up front
+bool readBlocksV1(FileData & fileData, size_t const instructionsByteOffset) {
+	if (
+		   fileData.byteCount < instructionsByteOffset + 8u
+		|| memcmp(
+			fileData.bytes + fileData.byteCount - 8u, format::kMagicV1, 8
+		) != 0
+	) {
+		printf("failed to readback magic number %s\n", fileData.filepath.c_str());
+		return false;
+	}
+	uint64_t const blockCount = (
+		(fileData.instructionCount + kReaderBlockInstructionCountV1 - 1u)
+		/ kReaderBlockInstructionCountV1
+	);
+	// each instruction takes at least 8 bytes per region
+	if (blockCount > fileData.byteCount) {
+		printf("invalid instruction count in %s\n", fileData.filepath.c_str());
+		return false;
+	}
+	fileData.blocks.resize(blockCount);
+	for (size_t it = 0; it < blockCount; ++ it) {
+		auto & block = fileData.blocks[it];
+		block.firstInstruction = it * kReaderBlockInstructionCountV1;
+		block.instructionCount = std::min(
+			kReaderBlockInstructionCountV1,
+			fileData.instructionCount - block.firstInstruction
+		);
+		block.byteEnd = fileData.byteCount - 8u;
+	}
+	if (!fileData.blocks.empty()) {
+		fileData.blocks[0].byteOffset = instructionsByteOffset;
+	}
+	return true;
+}
+
+size_t regionByteCount(SnortMemoryRegionCreateInfo const & regionInfo) {
+	return regionInfo.elementCount * snort_dtByteCount(regionInfo.dataType);
+}
+
+void appendChunk(FileData & fileData, format::ChunkIndexEntry const & entry) {
+	uint64_t const payloadOffset = entry.byteOffset + format::kChunkHeaderByteCount;
+	switch (entry.type) {
+		case format::kChunkType_instructions:
+			fileData.blocks.emplace_back(InstructionBlock {
+				.firstInstruction = entry.firstInstruction,
+				.instructionCount = entry.instructionCount,
+				.byteOffset = payloadOffset,
+				.byteEnd = payloadOffset + entry.payloadByteCount,
+				.checksum = entry.checksum,
+				.hasChecksum = fileData.hasIndex,
+			});
+		break;
+		case format::kChunkType_keyframe: {
+			size_t memoryByteCount = 0u;
+			for (auto const & regionInfo : fileData.regionCreateInfo) {
+				memoryByteCount += ::regionByteCount(regionInfo);
+			}
+			// encoded keyframes are only checked once they're decoded
+			if (
+				   fileData.codec == nullptr
+				&& entry.payloadByteCount != memoryByteCount
+			) {
+				printf(
+					"warning: ignoring keyframe at instruction %zu of '%s', its "
+					"size doesn't match the regions\n",
+					(size_t)entry.firstInstruction, fileData.filepath.c_str()
+				);
+				break;
+			}
+			fileData.keyframes.emplace_back(Keyframe {
+				.instructionIndex = entry.firstInstruction,
+				.byteOffset = payloadOffset,
+				.byteEnd = payloadOffset + entry.payloadByteCount,
+				.checksum = entry.checksum,
+				.hasChecksum = fileData.hasIndex,
+			});
+		} break;
+		case format::kChunkType_hashes:
+			fileData.hashBlocks.emplace_back(HashBlock {
+				.firstInstruction = entry.firstInstruction,
+				.instructionCount = entry.instructionCount,
+				.byteOffset = payloadOffset,
+				.byteEnd = payloadOffset + entry.payloadByteCount,
+				.checksum = entry.checksum,
+				.hasChecksum = fileData.hasIndex,
+			});
+		break;
+		case format::kChunkType_inputs:
+			fileData.inputChunks.emplace_back(InputChunk {
+				.firstInstruction = entry.firstInstruction,
+				.byteOffset = payloadOffset,
+				.byteEnd = payloadOffset + entry.payloadByteCount,
+				.checksum = entry.checksum,
+				.hasChecksum = fileData.hasIndex,
+			});
+		break;
+		// unknown chunks are skipped, so newer optional chunks don't break
+		//   older readers
+		default: break;
+	}
+}
+
+// version 2 files, the chunk table comes from the index footer if there is
+//   one, otherwise the chunk headers are walked. Without a footer the file
+//   may be a recording that never closed, so walking stops at the first
+//   incomplete chunk
+bool readBlocksV2(FileData & fileData, size_t const chunksByteOffset) {
+	// -- index footer
+	size_t const byteCount = fileData.byteCount;
+	if (
+		   byteCount >= chunksByteOffset + 16u
+		&& memcmp(fileData.bytes + byteCount - 8u, format::kMagicIndex, 8) == 0
+	) {
+		FileCursor cursor {
+			.bytes = fileData.bytes,
+			.byteCount = byteCount,
+			.offset = byteCount - 16u,
+		};
+		uint64_t const chunkCount = cursor.u64();
+		uint64_t const indexByteCount = chunkCount * format::kIndexEntryByteCount;
+		if (
+			   chunkCount > byteCount / format::kIndexEntryByteCount
+			|| indexByteCount + 24u + chunksByteOffset > byteCount
+		) {
+			printf("invalid index footer in %s\n", fileData.filepath.c_str());
+			return false;
+		}
+		// the chunk magic number sits just before the footer
+		size_t const chunksEnd = byteCount - 24u - indexByteCount;
+		cursor.offset = chunksEnd + 8u;
+		fileData.hasIndex = true;
+		for (size_t it = 0; it < chunkCount; ++ it) {
+			format::ChunkIndexEntry entry;
+			entry.type = cursor.u64();
+			entry.firstInstruction = cursor.u64();
+			entry.instructionCount = cursor.u64();
+			entry.byteOffset = cursor.u64();
+			entry.payloadByteCount = cursor.u64();
+			entry.checksum = cursor.u64();
+			if (
+				   entry.byteOffset < chunksByteOffset
+				|| entry.byteOffset > chunksEnd
+				|| (
+					entry.payloadByteCount
+					> chunksEnd - entry.byteOffset - format::kChunkHeaderByteCount
+				)
+			) {
+				printf(
+					"invalid index entry %zu in %s\n", it, fileData.filepath.c_str()
+				);
+				return false;
+			}
+			::appendChunk(fileData, entry);
+		}
+		return true;
+	}
+
+	// -- no footer, walk the chunk headers
+	FileCursor cursor {
+		.bytes = fileData.bytes,
+		.byteCount = byteCount,
+		.offset = chunksByteOffset,
+	};
+	while (true) {
+		if (
+			   byteCount - cursor.offset >= 8u
+			&& memcmp(fileData.bytes + cursor.offset, format::kMagicV2, 8) == 0
+		) {
+			break;
+		}
+		format::ChunkIndexEntry entry {};
+		entry.byteOffset = cursor.offset;
+		entry.type = cursor.u64();
+		entry.firstInstruction = cursor.u64();
+		entry.instructionCount = cursor.u64();
+		entry.payloadByteCount = cursor.u64();
+		if (cursor.take(entry.payloadByteCount) == nullptr) {
+			printf(
+				"warning: replay file '%s' ends with an incomplete chunk, it "
+				"was likely not closed\n",
+				fileData.filepath.c_str()
+			);
+			break;
+		}
+		::appendChunk(fileData, entry);
+	}
+	return true;
+}
+
+// decodes an encoded chunk payload, which starts with its decoded byte count
+bool decodePayload(
+	FileData const & fileData,
+	uint64_t const byteOffset,
+	uint64_t const byteEnd,
+	std::vector<uint8_t> & decodedBytes
+) {
+	FileCursor cursor {
+		.bytes = fileData.bytes,
+		.byteCount = byteEnd,
+		.offset = byteOffset,
+	};
+	uint64_t const decodedByteCount = cursor.u64();
+	size_t const encodedByteCount = byteEnd - cursor.offset;
+	// no codec expands data by more than its longest run, this keeps a
+	//   corrupt byte count from allocating arbitrary amounts of memory
+	if (cursor.overrun || decodedByteCount / 256u > encodedByteCount) {
+		return false;
+	}
+	decodedBytes.resize(decodedByteCount);
+	return fileData.codec->decode(
+		fileData.bytes + cursor.offset, encodedByteCount,
+		decodedBytes.data(), decodedBytes.size()
+	);
+}
+
+// parses the diffs of a block, the block's byte offset must be known, which
+//   for version 1 files means every previous block has been parsed
+void parseInstructionBlock(FileData & fileData, size_t const blockIndex) {
+	InstructionBlock & block = fileData.blocks[blockIndex];
+	uint64_t const regionCount = fileData.regionCreateInfo.size();
+	if (block.hasChecksum) {
+		uint64_t const checksum = (
+			SnortFs::hash64(
+				fileData.bytes + block.byteOffset,
+				block.byteEnd - block.byteOffset
+			)
+		);
+		if (checksum != block.checksum) {
+			printf(
+				"error: replay file '%s' checksum mismatch in instruction block "
+				"%zu (instructions %zu to %zu)\n",
+				fileData.filepath.c_str(), blockIndex,
+				(size_t)block.firstInstruction,
+				(size_t)(block.firstInstruction + block.instructionCount)
+			);
+			block.hasChecksumError = true;
+			block.regionDiffOffsets.assign(
+				block.instructionCount * regionCount + 1u, 0u
+			);
+			block.isParsed = true;
+			return;
+		}
+	}
+	FileCursor cursor {
+		.bytes = fileData.bytes,
+		.byteCount = block.byteEnd,
+		.offset = block.byteOffset,
+	};
+	if (fileData.codec != nullptr) {
+		bool const isDecoded = (
+			::decodePayload(
+				fileData, block.byteOffset, block.byteEnd, block.decodedBytes
+			)
+		);
+		if (!isDecoded) {
+			printf(
+				"error: replay file '%s' failed to decode instruction block %zu\n",
+				fileData.filepath.c_str(), blockIndex
+			);
+			block.decodedBytes.clear();
+		}
+		cursor = FileCursor {
+			.bytes = block.decodedBytes.data(),
+			.byteCount = block.decodedBytes.size(),
+			.offset = 0u,
+		};
+	}
+	bool const isVarint = (fileData.flags & format::kHeaderFlag_varintDiffs);
+	bool const hasRegionMask = (fileData.flags & format::kHeaderFlag_regionMask);
+	auto const readField = [&cursor, isVarint]() {
+		return isVarint ? cursor.varint() : cursor.u64();
+	};
+	size_t const maskByteCount = (
+		hasRegionMask ? format::regionMaskByteCount(regionCount) : 0u
+	);
+	block.regionDiffOffsets.reserve(block.instructionCount * regionCount + 1u);
+	for (size_t instrIt = 0; instrIt < block.instructionCount; ++ instrIt) {
+		uint8_t const * const regionMask = cursor.take(maskByteCount);
+		for (size_t regionIt = 0; regionIt < regionCount; ++ regionIt) {
+			block.regionDiffOffsets.emplace_back((uint32_t)block.diffs.size());
+			// untouched regions have nothing stored
+			if (
+				   hasRegionMask
+				&& (
+					   regionMask == nullptr
+					|| (regionMask[regionIt / 8u] & (1u << (regionIt % 8u))) == 0u
+				)
+			) {
+				continue;
+			}
+			uint64_t const diffCount = readField();
+			for (size_t diffIt = 0; diffIt < diffCount && !cursor.overrun; ++ diffIt) {
+				uint64_t const byteOffset = readField();
+				uint64_t const byteCount = readField();
+				uint8_t const * const data = cursor.take(byteCount);
+				if (cursor.overrun) { break; }
+				block.diffs.emplace_back(SnortFs::MemoryRegionDiff {
+					.byteOffset = byteOffset,
+					.byteCount = byteCount,
+					.data = data,
+				});
+			}
+		}
+	}
+	block.regionDiffOffsets.emplace_back((uint32_t)block.diffs.size());
+	block.isParsed = true;
+
+	if (cursor.overrun) {
+		printf(
+			"error: replay file '%s' is truncated, instruction block %zu is "
+			"incomplete\n",
+			fileData.filepath.c_str(), blockIndex
+		);
+	}
+	// version 1 blocks are back to back, a truncated block leaves the
+	//   following blocks empty
+	if (fileData.version == 1u && blockIndex + 1u < fileData.blocks.size()) {
+		fileData.blocks[blockIndex + 1u].byteOffset = (
+			cursor.overrun ? cursor.byteCount : cursor.offset
+		);
+	}
+}
+
+// version 2 only, version 1 blocks are found by their index
+size_t instructionBlockIndex(
+	FileData const & fileData,
+	size_t const instructionIndex
+) {
+	auto const blockIt = std::upper_bound(
+		fileData.blocks.begin(), fileData.blocks.end(), instructionIndex,
+		[](size_t const index, InstructionBlock const & block) {
+			return index < block.firstInstruction;
+		}
+	) - 1;
+	return (size_t)(blockIt - fileData.blocks.begin());
+}
+
+InstructionBlock const & fetchInstructionBlock(
+	FileData & fileData,
+	size_t const instructionIndex
+) {
+	// version 1 blocks are sequential, so every block up to this one must be
+	//   parsed first
+	if (fileData.version == 1u) {
+		size_t const blockIndex = instructionIndex / kReaderBlockInstructionCountV1;
+		for (size_t it = 0; it <= blockIndex; ++ it) {
+			if (!fileData.blocks[it].isParsed) {
+				::parseInstructionBlock(fileData, it);
+			}
+		}
+		return fileData.blocks[blockIndex];
+	}
+	size_t const blockIndex = ::instructionBlockIndex(fileData, instructionIndex);
+	InstructionBlock & block = fileData.blocks[blockIndex];
+	if (!block.isParsed) {
+		::parseInstructionBlock(fileData, blockIndex);
+	}
+	return block;
+}
+
+// version 2 blocks don't depend on each other, so threads only have to agree
+//   on who parses a block, not on the order. Version 1 files have to be
+//   fetched from a single thread
+InstructionBlock const & fetchInstructionBlockShared(
+	FileData & fileData,
+	std::vector<std::once_flag> & parseFlags,
+	size_t const instructionIndex
+) {
+	if (fileData.version == 1u) {
+		return ::fetchInstructionBlock(fileData, instructionIndex);
+	}
+	size_t const blockIndex = ::instructionBlockIndex(fileData, instructionIndex);
+	InstructionBlock & block = fileData.blocks[blockIndex];
+	std::call_once(parseFlags[blockIndex], [&fileData, &block, blockIndex]() {
+		if (!block.isParsed) {
+			::parseInstructionBlock(fileData, blockIndex);
+		}
+	});
+	return block;
+}
+
+// a corrupt chunk drops its changes, the state carries over from the
+//   previous chunk instead
+void parseInputs(FileData & fileData) {
+	fileData.areInputsParsed = true;
+	std::vector<uint8_t> decodedBytes;
+	for (size_t chunkIt = 0; chunkIt < fileData.inputChunks.size(); ++ chunkIt) {
+		InputChunk const & chunk = fileData.inputChunks[chunkIt];
+		if (chunk.hasChecksum) {
+			uint64_t const checksum = (
+				SnortFs::hash64(
+					fileData.bytes + chunk.byteOffset,
+					chunk.byteEnd - chunk.byteOffset
+				)
+			);
+			if (checksum != chunk.checksum) {
+				printf(
+					"error: replay file '%s' checksum mismatch in input chunk at "
+					"instruction %zu\n",
+					fileData.filepath.c_str(), (size_t)chunk.firstInstruction
+				);
+				continue;
+			}
+		}
+		FileCursor cursor {
+			.bytes = fileData.bytes,
+			.byteCount = chunk.byteEnd,
+			.offset = chunk.byteOffset,
+		};
+		if (fileData.codec != nullptr) {
+			bool const isDecoded = (
+				::decodePayload(
+					fileData, chunk.byteOffset, chunk.byteEnd, decodedBytes
+				)
+			);
+			if (!isDecoded) {
+				printf(
+					"error: replay file '%s' failed to decode input chunk at "
+					"instruction %zu\n",
+					fileData.filepath.c_str(), (size_t)chunk.firstInstruction
+				);
+				continue;
+			}
+			cursor = FileCursor {
+				.bytes = decodedBytes.data(),
+				.byteCount = decodedBytes.size(),
+				.offset = 0u,
+			};
+		}
+		size_t const firstChange = fileData.inputChanges.size();
+		uint64_t instructionIndex = chunk.firstInstruction;
+		while (cursor.offset < cursor.byteCount) {
+			instructionIndex += cursor.varint();
+			uint64_t const inputState = cursor.varint();
+			if (cursor.overrun) { break; }
+			fileData.inputChanges.emplace_back(InputChange {
+				.instructionIndex = instructionIndex,
+				.inputState = inputState,
+			});
+		}
+		if (cursor.overrun) {
+			printf(
+				"error: replay file '%s' has a truncated input chunk at "
+				"instruction %zu\n",
+				fileData.filepath.c_str(), (size_t)chunk.firstInstruction
+			);
+			fileData.inputChanges.resize(firstChange);
+		}
+	}
+}
+
+size_t regionPairIndex(
+	FileData const & fileData,
+	InstructionBlock const & block,
+	size_t const instructionIndex,
+	size_t const regionIndex
+) {
+	return (
+		  (instructionIndex - block.firstInstruction)
+		* fileData.regionCreateInfo.size()
+		+ regionIndex
+	);
+}
+
+// validateMemory hands out instructions in chunks of this many, the same as
+//   the recorder's blocks so that a chunk usually parses one block per file
+constexpr size_t kValidateChunkInstructionCount {
+	format::kBlockInstructionCount
 };
 
+// works on the parsed blocks directly, regions neither file touched are
+//   skipped
+bool isInstructionDiverged(
+	FileData const & fileData,
+	InstructionBlock const & block,
+	FileData const & fileDataCmp,
+	InstructionBlock const & blockCmp,
+	size_t const instructionIndex
+) {
+	// a corrupt block can't be trusted to match, its first instruction is
+	//   the first one found diverged
+	if (block.hasChecksumError || blockCmp.hasChecksumError) {
+		return true;
+	}
+	size_t const regionCount = fileData.regionCreateInfo.size();
+	uint32_t const * const offsets = (
+		  block.regionDiffOffsets.data()
+		+ ::regionPairIndex(fileData, block, instructionIndex, 0u)
+	);
+	uint32_t const * const offsetsCmp = (
+		  blockCmp.regionDiffOffsets.data()
+		+ ::regionPairIndex(fileDataCmp, blockCmp, instructionIndex, 0u)
+	);
+	// no diffs at all in either file for this instruction
+	if (
+		   offsets[0] == offsets[regionCount]
+		&& offsetsCmp[0] == offsetsCmp[regionCount]
+	) {
+		return false;
+	}
+	for (size_t regionIt = 0u; regionIt < regionCount; ++ regionIt) {
+		size_t const diffCount = offsets[regionIt + 1u] - offsets[regionIt];
+		size_t const diffCountCmp = (
+			offsetsCmp[regionIt + 1u] - offsetsCmp[regionIt]
+		);
+		if (diffCount != diffCountCmp) {
+			return true;
+		}
+		SnortFs::MemoryRegionDiff const * const diffs = (
+			block.diffs.data() + offsets[regionIt]
+		);
+		SnortFs::MemoryRegionDiff const * const diffsCmp = (
+			blockCmp.diffs.data() + offsetsCmp[regionIt]
+		);
+		for (size_t diffIt = 0; diffIt < diffCount; ++ diffIt) {
+			SnortFs::MemoryRegionDiff const & diff = diffs[diffIt];
+			SnortFs::MemoryRegionDiff const & diffCmp = diffsCmp[diffIt];
+			if (
+				   diff.byteOffset != diffCmp.byteOffset
+				|| diff.byteCount != diffCmp.byteCount
+				|| memcmp(diff.data, diffCmp.data, diff.byteCount) != 0
+			) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
 } // namespace
 
 // -----------------------------------------------------------------------------
 // -- snort fs impl ------------------------------------------------------------
 // -----------------------------------------------------------------------------
 
-SnortFs::ReplayFile SnortFs::replay_open(char const * const filepath) {
-	FILE * filePtr = fopen(filepath, "rb");
-	if (filePtr == nullptr) {
+SnortFs::ReplayFile SnortFs::replay_open(
+	char const * const filepath,
+	ReplayOpenMode const mode
+) {
+	FileData * fileDataPtr = new FileData { .filepath = filepath };
+	FileData & fileData = *fileDataPtr;
+	bool const isOpen = (
+		mode == kReplayOpenMode_map
+		? ::mapFile(fileData, filepath)
+		: ::loadFile(fileData, filepath)
+	);
+	if (!isOpen) {
 		printf("failed to open replay file %s\n", filepath);
+		delete fileDataPtr;
 		return SnortFs::ReplayFile { 0 };
 	}
-	// -- read magic number
+
+	FileCursor cursor {
+		.bytes = fileData.bytes,
+		.byteCount = fileData.byteCount,
+		.offset = 0u,
+	};
+
+	auto const fail = [&]() {
+		::unmapFile(fileData);
+		delete fileDataPtr;
+		return SnortFs::ReplayFile { 0 };
+	};
+
+	// -- read magic number, which holds the version, and the flags
 	{
-		std::array<char, 8> magic;
-		fread(magic.data(), 1, 8, filePtr);
-		if (memcmp(magic.data(), "SNORTRPL", 8) != 0) {
+		uint8_t const * const magic = cursor.take(8);
+		if (magic != nullptr && memcmp(magic, format::kMagicV1, 8) == 0) {
+			fileData.version = 1u;
+			fileData.flags = 0u;
+		}
+		else if (magic != nullptr && memcmp(magic, format::kMagicV2, 8) == 0) {
+			fileData.version = 2u;
+			fileData.flags = cursor.u64();
+			if ((fileData.flags & ~format::kHeaderFlagsKnown) != 0u) {
+				printf(
+					"unsupported flags %zx in replay file %s\n",
+					(size_t)fileData.flags, filepath
+				);
+				return fail();
+			}
+			if (fileData.flags & format::kHeaderFlag_blockCodec) {
+				fileData.codecId = (SnortFs::ReplayCodec)cursor.u64();
+				fileData.codec = SnortFs::codec::find(fileData.codecId);
+				if (fileData.codec == nullptr) {
+					printf(
+						"unsupported codec %zu in replay file %s\n",
+						(size_t)fileData.codecId, filepath
+					);
+					return fail();
+				}
+			}
+			if (fileData.flags & format::kHeaderFlag_rngSeed) {
+				fileData.rngSeed = cursor.u64();
+			}
+		}
+		else {
 			printf("failed to read magic number of file %s\n", filepath);
-			printf("'%c' '%c' '%c' '%c' '%c' '%c' '%c' '%c'\n",
-				magic[0], magic[1], magic[2], magic[3],
-				magic[4], magic[5], magic[6], magic[7]
-			);
-			fflush(filePtr);
-			fclose(filePtr);
-			return SnortFs::ReplayFile { 0 };
+			return fail();
 		}
 	}
 
-	FileData fileData {};
-
 	// -- read common interface
-	{
-		uint64_t commonInterface;
-		fread(&commonInterface, 8, 1, filePtr);
-		fileData.commonInterface = (SnortCommonInterface)commonInterface;
-	}
+	fileData.commonInterface = (SnortCommonInterface)cursor.u64();
 
 	// -- read instruction offset, instruction count and region count
-	fread(&fileData.instructionOffset, 8, 1, filePtr);
+	fileData.instructionOffset = cursor.u64();
+	fileData.instructionCount = cursor.u64();
 	{
-		uint64_t instructionCount;
-		uint64_t regionCount;
-		fread(&instructionCount, 8, 1, filePtr);
-		fread(&regionCount, 8, 1, filePtr);
-		fileData.instructions.resize(instructionCount);
+		uint64_t const regionCount = cursor.u64();
+		// each region takes at least 25 bytes of header
+		if (cursor.overrun || regionCount > fileData.byteCount / 25u) {
+			printf("failed to read header of file %s\n", filepath);
+			return fail();
+		}
 		fileData.regionCreateInfo.resize(regionCount);
 		fileData.regionLabels.resize(regionCount);
 	}
@@ -86,69 +830,75 @@ SnortFs::ReplayFile SnortFs::replay_open(char const * const filepath) {
 	// read per-memory region create info
 	for (size_t regIt = 0; regIt < fileData.regionCreateInfo.size(); ++regIt) {
 		auto & regionInfo = fileData.regionCreateInfo[regIt];
-		fread(&regionInfo.dataType, 8, 1, filePtr);
-		fread(&regionInfo.elementCount, 8, 1, filePtr);
-		fread(&regionInfo.elementDisplayRowStride, 8, 1, filePtr);
-		char labelBuffer[256];
-		memset(labelBuffer, 0, 256);
-		for (size_t it = 0; it < 256; ++it) {
-			char c;
-			fread(&c, 1, 1, filePtr);
-			if (c == '\0') { break; }
-			labelBuffer[it] = c;
-		}
-		fileData.regionLabels[regIt] = std::string(labelBuffer);
-		regionInfo.label = fileData.regionLabels[regIt].c_str();
-	}
-
-	// -- read per-instruction diffs
-	for (size_t instrIt = 0; instrIt < fileData.instructions.size(); ++instrIt) {
-		auto & instruction = fileData.instructions[instrIt];
-		auto const regionCount = fileData.regionCreateInfo.size();
-		instruction.regionDiffs.resize(regionCount);
-		instruction.regionDiffRaw.resize(regionCount);
-		// read per-memory region diffs
-		for (size_t regionIt = 0; regionIt < regionCount; ++regionIt) {
-			uint64_t diffCount;
-			fread(&diffCount, 8, 1, filePtr);
-			instruction.regionDiffs[regionIt].resize(diffCount);
-			instruction.regionDiffRaw[regionIt].resize(diffCount);
-			for (size_t diffIt = 0; diffIt < diffCount; ++diffIt) {
-				uint64_t byteOffset;
-				uint64_t byteCount;
-				fread(&byteOffset, 8, 1, filePtr);
-				fread(&byteCount, 8, 1, filePtr);
-				std::vector<uint8_t> data(byteCount);
-				fread(data.data(), 1, byteCount, filePtr);
-				instruction.regionDiffs[regionIt][diffIt] = {
-					.byteOffset = byteOffset,
-					.byteCount = byteCount,
-					.data = std::move(data),
-				};
-				instruction.regionDiffRaw[regionIt][diffIt] = {
-					.byteOffset = byteOffset,
-					.byteCount = byteCount,
-					.data = instruction.regionDiffs[regionIt][diffIt].data.data(),
-				};
-			}
+		regionInfo.dataType = (SnortDt)cursor.u64();
+		regionInfo.elementCount = cursor.u64();
+		regionInfo.elementDisplayRowStride = cursor.u64();
+		std::string & label = fileData.regionLabels[regIt];
+		for (uint8_t const * c = cursor.take(1); c != nullptr && *c != '\0';) {
+			label += (char)*c;
+			c = cursor.take(1);
 		}
 	}
+	if (cursor.overrun) {
+		printf("failed to read region info of file %s\n", filepath);
+		return fail();
+	}
+	for (size_t regIt = 0; regIt < fileData.regionCreateInfo.size(); ++regIt) {
+		fileData.regionCreateInfo[regIt].label = (
+			fileData.regionLabels[regIt].c_str()
+		);
+	}
 
-	// -- read magic number to verify instructions were read correctly
-	{
-		std::array<char, 8> magic;
-		fread(magic.data(), 1, 8, filePtr);
-		if (memcmp(magic.data(), "SNORTRPL", 8) != 0) {
-			printf("failed to readback magic number %s\n", filepath);
-			fclose(filePtr);
-			return SnortFs::ReplayFile { 0 };
+	// -- find the instruction blocks, the diffs themselves are only parsed
+	//    once they're requested
+	bool const hasBlocks = (
+		fileData.version == 1u
+		? ::readBlocksV1(fileData, cursor.offset)
+		: ::readBlocksV2(fileData, cursor.offset)
+	);
+	if (!hasBlocks) {
+		return fail();
+	}
+
+	// -- the chunks are the source of truth for the instruction count, the
+	//    header is only patched once a recording closes
+	if (fileData.version != 1u) {
+		uint64_t instructionCount = 0u;
+		// hash-only files cover the instructions with hash blocks instead
+		auto const countInstructions = [&](auto const & blocks) {
+			for (auto const & block : blocks) {
+				if (block.firstInstruction != instructionCount) {
+					printf(
+						"error: replay file '%s' is missing instructions %zu to %zu\n",
+						filepath, (size_t)instructionCount,
+						(size_t)block.firstInstruction
+					);
+					return false;
+				}
+				instructionCount += block.instructionCount;
+			}
+			return true;
+		};
+		bool const isContiguous = (
+			::isHashOnly(fileData)
+			? countInstructions(fileData.hashBlocks)
+			: countInstructions(fileData.blocks)
+		);
+		if (!isContiguous) {
+			return fail();
+		}
+		if (instructionCount != fileData.instructionCount) {
+			printf(
+				"warning: replay file '%s' header lists %zu instructions but "
+				"%zu were found\n",
+				filepath, (size_t)fileData.instructionCount,
+				(size_t)instructionCount
+			);
+			fileData.instructionCount = instructionCount;
 		}
 	}
 
-	fclose(filePtr);
-	return SnortFs::ReplayFile {
-		(uint64_t)(uintptr_t)(new FileData(std::move(fileData)))
-	};
+	return SnortFs::ReplayFile { (uint64_t)(uintptr_t)(fileDataPtr) };
 }
 
 // --
@@ -156,12 +906,42 @@ SnortFs::ReplayFile SnortFs::replay_open(char const * const filepath) {
 void SnortFs::replay_close(ReplayFile & file) {
 	if (file.handle == 0) { return; }
 	FileData * fileDataPtr = (FileData *)(uintptr_t)(file.handle);
+	::unmapFile(*fileDataPtr);
 	delete fileDataPtr;
 	file.handle = 0;
 }
 
 // --
 
+uint64_t SnortFs::replay_version(ReplayFile const file) {
+	FileData * fileDataPtr = (FileData *)(uintptr_t)(file.handle);
+	return fileDataPtr->version;
+}
+
+// --
+
+bool SnortFs::replay_hasIndex(ReplayFile const file) {
+	FileData * fileDataPtr = (FileData *)(uintptr_t)(file.handle);
+	return fileDataPtr->hasIndex;
+}
+
+// --
+
+SnortFs::ReplayCodec SnortFs::replay_codec(ReplayFile const file) {
+	FileData * fileDataPtr = (FileData *)(uintptr_t)(file.handle);
+	return fileDataPtr->codecId;
+}
+
+// --
+
+bool SnortFs::replay_rngSeed(ReplayFile const file, uint64_t & seed) {
+	FileData * fileDataPtr = (FileData *)(uintptr_t)(file.handle);
+	seed = fileDataPtr->rngSeed;
+	return (fileDataPtr->flags & format::kHeaderFlag_rngSeed) != 0u;
+}
+
+// --
+
 SnortCommonInterface SnortFs::replay_commonInterface(ReplayFile const file) {
 	FileData * fileDataPtr = (FileData *)(uintptr_t)(file.handle);
 	return fileDataPtr->commonInterface;
@@ -178,7 +958,7 @@ uint64_t SnortFs::replay_instructionOffset(ReplayFile const file) {
 
 uint64_t SnortFs::replay_instructionCount(ReplayFile const file) {
 	FileData * fileDataPtr = (FileData *)(uintptr_t)(file.handle);
-	return fileDataPtr->instructions.size();
+	return fileDataPtr->instructionCount;
 }
 
 // --
@@ -204,226 +984,300 @@ size_t SnortFs::replay_instructionDiffCount(
 	size_t const instructionIndex,
 	size_t const regionIndex
 ) {
-	FileData * fileDataPtr = (FileData *)(uintptr_t)(file.handle);
+	FileData & fileData = *(FileData *)(uintptr_t)(file.handle);
+	if (::isHashOnly(fileData)) { return 0u; }
+	InstructionBlock const & block = (
+		::fetchInstructionBlock(fileData, instructionIndex)
+	);
+	size_t const pairIndex = (
+		::regionPairIndex(fileData, block, instructionIndex, regionIndex)
+	);
 	return (
-		fileDataPtr
-		->instructions[instructionIndex].regionDiffs[regionIndex].size()
+		  block.regionDiffOffsets[pairIndex + 1u]
+		- block.regionDiffOffsets[pairIndex]
 	);
 }
 
 // --
 
-SnortFs::MemoryRegionDiff * SnortFs::replay_instructionDiff(
+SnortFs::MemoryRegionDiff const * SnortFs::replay_instructionDiff(
 	ReplayFile const file,
 	size_t const instructionIndex,
 	size_t const regionIndex
 ) {
-	FileData * fileDataPtr = (FileData *)(uintptr_t)(file.handle);
-	auto & diffs = (
-		fileDataPtr
-		->instructions[instructionIndex].regionDiffRaw[regionIndex]
+	FileData & fileData = *(FileData *)(uintptr_t)(file.handle);
+	if (::isHashOnly(fileData)) { return nullptr; }
+	InstructionBlock const & block = (
+		::fetchInstructionBlock(fileData, instructionIndex)
 	);
-	return diffs.data();
+	size_t const pairIndex = (
+		::regionPairIndex(fileData, block, instructionIndex, regionIndex)
+	);
+	return block.diffs.data() + block.regionDiffOffsets[pairIndex];
 }
 
-// -----------------------------------------------------------------------------
-// -- snort fs recording impl --------------------------------------------------
-// -----------------------------------------------------------------------------
+// --
 
-SnortFs::ReplayFileRecorder SnortFs::replayRecorder_open(
-	char const * const filepath,
-	SnortCommonInterface const commonInterface,
-	uint64_t const instructionOffset,
-	uint64_t const regionCount,
-	SnortMemoryRegionCreateInfo const * const regionCreateInfo
-) {
-	FileData fileData {
-		.commonInterface = commonInterface,
-		.instructionOffset = instructionOffset,
-		.regionCreateInfo = std::vector<SnortMemoryRegionCreateInfo>(regionCount),
-		.regionLabels = std::vector<std::string>(regionCount),
-		.instructions = {},
-		.recordingFilepath = filepath,
-	};
-	for (size_t it = 0; it < regionCount; ++it) {
-		fileData.regionCreateInfo[it] = regionCreateInfo[it];
-		fileData.regionLabels[it] = std::string(regionCreateInfo[it].label);
-		fileData.regionCreateInfo[it].label = fileData.regionLabels[it].c_str();
-	}
-	printf("starting recording to file '%s' with instruction offset %zu and region count %zu\n",
-		fileData.recordingFilepath.c_str(),
-		(size_t)fileData.instructionOffset,
-		(size_t)fileData.regionCreateInfo.size()
-	);
-	return SnortFs::ReplayFileRecorder {
-		(uint64_t)(uintptr_t)(new FileData(std::move(fileData)))
-	};
+uint64_t SnortFs::replay_keyframeCount(ReplayFile const file) {
+	FileData * fileDataPtr = (FileData *)(uintptr_t)(file.handle);
+	return fileDataPtr->keyframes.size();
 }
 
 // --
 
-void SnortFs::replayRecorder_close(ReplayFileRecorder & recorder) {
-	if (recorder.handle == 0u) { return; }
-	FileData & fileData = *(FileData *)(uintptr_t)(recorder.handle);
-	if (fileData.recordingRegionOffset != fileData.regionCreateInfo.size()) {
-		printf(
-			"warning: recording ended with incomplete instruction, "
-			"recorded %zu regions out of %zu for instruction %zu\n",
-			(size_t)fileData.recordingRegionOffset,
-			(size_t)fileData.regionCreateInfo.size(),
-			(size_t)fileData.recordingInstructionIndex
-		);
+void SnortFs::replay_materializeState(
+	ReplayFile const file,
+	size_t const instructionIndex,
+	uint8_t * const * const regionData
+) {
+	FileData & fileData = *(FileData *)(uintptr_t)(file.handle);
+	size_t const regionCount = fileData.regionCreateInfo.size();
+	size_t memoryByteCount = 0u;
+	for (auto const & regionInfo : fileData.regionCreateInfo) {
+		memoryByteCount += ::regionByteCount(regionInfo);
 	}
 
-	printf(
-		"closing recording to file '%s', recorded %zu instructions and"
-		" %zu total KiB\n",
-		fileData.recordingFilepath.c_str(),
-		fileData.instructions.size(),
-		(size_t)(fileData.recordingByteCount / 1024ull)
-	);
-
-	FILE * filePtr = fopen(fileData.recordingFilepath.c_str(), "wb");
-
-	if (filePtr == nullptr) {
+	// -- find the closest usable keyframe at or before the instruction
+	Keyframe * keyframe = nullptr;
+	uint8_t const * keyframeBytes = nullptr;
+	std::vector<uint8_t> decodedKeyframeBytes;
+	for (
+		auto keyframeIt = std::upper_bound(
+			fileData.keyframes.begin(), fileData.keyframes.end(), instructionIndex,
+			[](size_t const index, Keyframe const & keyframe) {
+				return index < keyframe.instructionIndex;
+			}
+		);
+		keyframeIt != fileData.keyframes.begin();
+	) {
+		-- keyframeIt;
+		if (keyframeIt->hasChecksum && !keyframeIt->isVerified) {
+			uint64_t const checksum = (
+				SnortFs::hash64(
+					fileData.bytes + keyframeIt->byteOffset,
+					keyframeIt->byteEnd - keyframeIt->byteOffset
+				)
+			);
+			keyframeIt->isVerified = true;
+			keyframeIt->isCorrupt = (checksum != keyframeIt->checksum);
+			if (keyframeIt->isCorrupt) {
+				printf(
+					"error: replay file '%s' checksum mismatch in keyframe at "
+					"instruction %zu, skipping it\n",
+					fileData.filepath.c_str(),
+					(size_t)keyframeIt->instructionIndex
+				);
+			}
+		}
+		if (keyframeIt->isCorrupt) { continue; }
+		if (fileData.codec == nullptr) {
+			keyframe = &(*keyframeIt);
+			keyframeBytes = fileData.bytes + keyframe->byteOffset;
+			break;
+		}
+		bool const isDecoded = (
+			::decodePayload(
+				fileData, keyframeIt->byteOffset, keyframeIt->byteEnd,
+				decodedKeyframeBytes
+			)
+		);
+		if (isDecoded && decodedKeyframeBytes.size() == memoryByteCount) {
+			keyframe = &(*keyframeIt);
+			keyframeBytes = decodedKeyframeBytes.data();
+			break;
+		}
 		printf(
-			"error: failed to open file for writing replay recording at '%s'\n",
-			fileData.recordingFilepath.c_str()
+			"error: replay file '%s' failed to decode keyframe at instruction "
+			"%zu, skipping it\n",
+			fileData.filepath.c_str(), (size_t)keyframeIt->instructionIndex
 		);
-		delete &fileData;
-		recorder.handle = 0;
-		fflush(filePtr);
-		fclose(filePtr);
-		return;
+		keyframeIt->isCorrupt = true;
 	}
 
-	// -- write magic number
-	{
-		std::array<char, 8> magic = { 'S', 'N', 'O', 'R', 'T', 'R', 'P', 'L' };
-		fwrite(magic.data(), 1, 8, filePtr);
+	// -- start from the keyframe memory, or zeroed memory if there is none
+	size_t firstInstruction = 0u;
+	if (keyframe != nullptr) {
+		for (size_t regionIt = 0; regionIt < regionCount; ++ regionIt) {
+			size_t const byteCount = (
+				::regionByteCount(fileData.regionCreateInfo[regionIt])
+			);
+			memcpy(regionData[regionIt], keyframeBytes, byteCount);
+			keyframeBytes += byteCount;
+		}
+		firstInstruction = keyframe->instructionIndex + 1u;
 	}
-
-	// -- write common interface
-	{
-		uint64_t commonInterface = (uint64_t)fileData.commonInterface;
-		fwrite(&commonInterface, 8, 1, filePtr);
+	else {
+		for (size_t regionIt = 0; regionIt < regionCount; ++ regionIt) {
+			memset(
+				regionData[regionIt],
+				0,
+				::regionByteCount(fileData.regionCreateInfo[regionIt])
+			);
+		}
 	}
 
-	// -- write instruction offset, instruction count and region count
-	fwrite(&fileData.instructionOffset, 8, 1, filePtr);
-	{
-		uint64_t instructionCount = fileData.instructions.size();
-		uint64_t regionCount = fileData.regionCreateInfo.size();
-		fwrite(&instructionCount, 8, 1, filePtr);
-		fwrite(&regionCount, 8, 1, filePtr);
+	// -- hash-only files have nothing to apply after the keyframe
+	if (::isHashOnly(fileData)) {
+		if (keyframe == nullptr || keyframe->instructionIndex != instructionIndex) {
+			printf(
+				"warning: replay file '%s' is hash-only, instruction %zu isn't "
+				"a keyframe\n",
+				fileData.filepath.c_str(), instructionIndex
+			);
+		}
+		return;
 	}
 
-	// write per-memory region create info
-	for (size_t regIt = 0; regIt < fileData.regionCreateInfo.size(); ++regIt) {
-		auto const & regionInfo = fileData.regionCreateInfo[regIt];
-		fwrite(&regionInfo.dataType, 8, 1, filePtr);
-		fwrite(&regionInfo.elementCount, 8, 1, filePtr);
-		fwrite(&regionInfo.elementDisplayRowStride, 8, 1, filePtr);
-		for (char const c : fileData.regionLabels[regIt]) {
-			fwrite(&c, 1, 1, filePtr);
-		}
-		fwrite("\0", 1, 1, filePtr);
-	}
-
-	// -- write per-instruction diffs
-	for (size_t instrIt = 0; instrIt < fileData.instructions.size(); ++instrIt) {
-		auto const & instruction = fileData.instructions[instrIt];
-		// write per-memory region diffs
-		for (size_t regIt = 0; regIt < fileData.regionCreateInfo.size(); ++regIt){
-			uint64_t diffCount = instruction.regionDiffs[regIt].size();
-			fwrite(&diffCount, 8, 1, filePtr);
-			for (size_t diffIt = 0; diffIt < diffCount; ++diffIt) {
-				auto const & diff = instruction.regionDiffs[regIt][diffIt];
-				fwrite(&diff.byteOffset, 8, 1, filePtr);
-				fwrite(&diff.byteCount, 8, 1, filePtr);
-				fwrite(diff.data.data(), 1, diff.data.size(), filePtr);
+	// -- apply the diffs up to and including the instruction
+	for (
+		size_t instrIt = firstInstruction;
+		instrIt <= instructionIndex;
+		++ instrIt
+	) {
+		InstructionBlock const & block = (
+			::fetchInstructionBlock(fileData, instrIt)
+		);
+		for (size_t regionIt = 0; regionIt < regionCount; ++ regionIt) {
+			size_t const pairIndex = (
+				::regionPairIndex(fileData, block, instrIt, regionIt)
+			);
+			size_t const byteCount = (
+				::regionByteCount(fileData.regionCreateInfo[regionIt])
+			);
+			for (
+				size_t diffIt = block.regionDiffOffsets[pairIndex];
+				diffIt < block.regionDiffOffsets[pairIndex + 1u];
+				++ diffIt
+			) {
+				SnortFs::MemoryRegionDiff const & diff = block.diffs[diffIt];
+				if (
+					   diff.byteOffset > byteCount
+					|| diff.byteCount > byteCount - diff.byteOffset
+				) {
+					continue;
+				}
+				memcpy(
+					regionData[regionIt] + diff.byteOffset,
+					diff.data,
+					diff.byteCount
+				);
 			}
 		}
 	}
+}
 
-	// -- write magic number to verify instructions were read correctly
-	{
-		std::array<char, 8> magic = { 'S', 'N', 'O', 'R', 'T', 'R', 'P', 'L' };
-		fwrite(magic.data(), 1, 8, filePtr);
-	}
+// --
 
-	delete &fileData;
-	fflush(filePtr);
-	fclose(filePtr);
-	recorder.handle = 0;
+bool SnortFs::replay_hasInputs(ReplayFile const file) {
+	FileData * fileDataPtr = (FileData *)(uintptr_t)(file.handle);
+	return (fileDataPtr->flags & format::kHeaderFlag_inputs) != 0u;
 }
 
 // --
 
-void SnortFs::replayRecorder_recordInstruction(
-	ReplayFileRecorder & recorder,
-	size_t const diffCount,
-	MemoryRegionDiffRecord const * diffs
+uint64_t SnortFs::replay_inputState(
+	ReplayFile const file,
+	size_t const instructionIndex
 ) {
-	if (recorder.handle == 0) {
-		printf(
-			"err: recording replay diff with invalid file recorder\n"
-		);
-		return;
-	}
-	FileData & fileData = *(FileData *)(uintptr_t)(recorder.handle);
-	auto const regionCount = fileData.regionCreateInfo.size();
-	// -- check if need to start a new instruction
-	if (fileData.recordingRegionOffset >= regionCount) {
-		fileData.recordingRegionOffset = 0;
-		fileData.recordingInstructionIndex += 1;
-		fileData.instructions.emplace_back();
-		fileData.instructions.back().regionDiffs.resize(regionCount);
-	}
-	else if (fileData.instructions.size() == 0) {
-		// no instruction started
-		fileData.instructions.emplace_back();
-		fileData.instructions.back().regionDiffs.resize(regionCount);
+	FileData & fileData = *(FileData *)(uintptr_t)(file.handle);
+	if (!fileData.areInputsParsed) {
+		::parseInputs(fileData);
 	}
+	// the last change at or before the instruction
+	auto const changeIt = std::upper_bound(
+		fileData.inputChanges.begin(), fileData.inputChanges.end(),
+		instructionIndex,
+		[](size_t const index, InputChange const & change) {
+			return index < change.instructionIndex;
+		}
+	);
+	if (changeIt == fileData.inputChanges.begin()) { return 0u; }
+	return (changeIt - 1)->inputState;
+}
 
-	// -- track new byte count
-	for (size_t it = 0; it < diffCount; ++ it) {
-		fileData.recordingByteCount += diffs[it].byteCount;
-	}
+// --
 
-	// -- store the diffs for the current instruction and region
-	auto & instruction = (
-		fileData.instructions[fileData.recordingInstructionIndex]
-	);
-	instruction.regionDiffs[fileData.recordingRegionOffset].resize(diffCount);
-	for (size_t it = 0; it < diffCount; ++ it) {
-		std::vector<uint8_t> data;
-		data.resize(diffs[it].byteCount);
-		memcpy(data.data(), diffs[it].data, data.size());
-		instruction.regionDiffs[fileData.recordingRegionOffset][it] = {
-			.byteOffset = diffs[it].byteOffset,
-			.byteCount = diffs[it].byteCount,
-			.data = std::move(data),
-		};
-	}
+bool SnortFs::replay_isHashOnly(ReplayFile const file) {
+	FileData * fileDataPtr = (FileData *)(uintptr_t)(file.handle);
+	return ::isHashOnly(*fileDataPtr);
+}
 
-	fileData.recordingRegionOffset += 1;
+// --
 
-	// for now limit to 64MiB diffs, anything more is probably 
-	if (fileData.recordingRegionOffset == regionCount) {
-		if (fileData.recordingByteCount > 64ull * 1024ull * 1024ull) {
+size_t SnortFs::replay_hashBlockCount(ReplayFile const file) {
+	FileData * fileDataPtr = (FileData *)(uintptr_t)(file.handle);
+	return fileDataPtr->hashBlocks.size();
+}
+
+// --
+
+bool SnortFs::replay_hashBlock(
+	ReplayFile const file,
+	size_t const blockIndex,
+	ReplayHashBlock & block,
+	uint64_t * const regionHashes
+) {
+	FileData & fileData = *(FileData *)(uintptr_t)(file.handle);
+	HashBlock const & hashBlock = fileData.hashBlocks[blockIndex];
+	block = ReplayHashBlock {
+		.firstInstruction = hashBlock.firstInstruction,
+		.instructionCount = hashBlock.instructionCount,
+	};
+	if (hashBlock.hasChecksum) {
+		uint64_t const checksum = (
+			SnortFs::hash64(
+				fileData.bytes + hashBlock.byteOffset,
+				hashBlock.byteEnd - hashBlock.byteOffset
+			)
+		);
+		if (checksum != hashBlock.checksum) {
 			printf(
-				"error: recording instruction %zu with large byte count %zu,\n"
-				"prematurely closing\n",
-				(size_t)fileData.recordingInstructionIndex,
-				(size_t)fileData.recordingByteCount
+				"error: replay file '%s' checksum mismatch in hash block %zu\n",
+				fileData.filepath.c_str(), blockIndex
 			);
-			SnortFs::replayRecorder_close(recorder);
+			return false;
 		}
 	}
+	uint8_t const * payload = fileData.bytes + hashBlock.byteOffset;
+	size_t payloadByteCount = hashBlock.byteEnd - hashBlock.byteOffset;
+	std::vector<uint8_t> decodedBytes;
+	if (fileData.codec != nullptr) {
+		bool const isDecoded = (
+			::decodePayload(
+				fileData, hashBlock.byteOffset, hashBlock.byteEnd, decodedBytes
+			)
+		);
+		if (!isDecoded) {
+			printf(
+				"error: replay file '%s' failed to decode hash block %zu\n",
+				fileData.filepath.c_str(), blockIndex
+			);
+			return false;
+		}
+		payload = decodedBytes.data();
+		payloadByteCount = decodedBytes.size();
+	}
+	size_t const regionCount = fileData.regionCreateInfo.size();
+	if (payloadByteCount != regionCount * sizeof(uint64_t)) {
+		printf(
+			"error: replay file '%s' hash block %zu doesn't match the regions\n",
+			fileData.filepath.c_str(), blockIndex
+		);
+		return false;
+	}
+	memcpy(regionHashes, payload, payloadByteCount);
+	return true;
 }
 
-size_t SnortFs::validateMemory(ReplayFile const & replay, ReplayFile & replayCmp) {
+// -----------------------------------------------------------------------------
+// -- snort fs validation impl -------------------------------------------------
+// -----------------------------------------------------------------------------
+
+size_t SnortFs::validateMemory(
+	ReplayFile const & replay,
+	ReplayFile & replayCmp,
+	size_t const workerCount
+) {
 	size_t const regionCount = SnortFs::replay_regionCount(replay);
 	size_t const instrCount = SnortFs::replay_instructionCount(replay);
 	size_t const cmpRegionCount = SnortFs::replay_regionCount(replayCmp);
@@ -437,34 +1291,174 @@ size_t SnortFs::validateMemory(ReplayFile const & replay, ReplayFile & replayCmp
 		);
 		return 0;
 	}
-	for (size_t instrIt = 0u; instrIt < instrCount; ++ instrIt)
-	for (size_t regionIt = 0u; regionIt < regionCount; ++ regionIt) {
-		size_t const diffCount = (
-			SnortFs::replay_instructionDiffCount(replay, instrIt, regionIt)
-		);
-		size_t const diffCountCmp = (
-			SnortFs::replay_instructionDiffCount(replayCmp, instrIt, regionIt)
-		);
-		if (diffCount != diffCountCmp) {
-			return instrIt;
+	if (
+		   SnortFs::replay_isHashOnly(replay)
+		|| SnortFs::replay_isHashOnly(replayCmp)
+	) {
+		printf("hash-only replays can only be compared with validateHashes\n");
+		return 0;
+	}
+	FileData & fileData = *(FileData *)(uintptr_t)(replay.handle);
+	FileData & fileDataCmp = *(FileData *)(uintptr_t)(replayCmp.handle);
+	std::vector<std::once_flag> parseFlags(fileData.blocks.size());
+	std::vector<std::once_flag> parseFlagsCmp(fileDataCmp.blocks.size());
+
+	// -- chunks are handed out in order, and the earliest divergence so far
+	//    cancels every instruction after it. So the instructions before it
+	//    have all been checked once the workers are done, and the result is
+	//    the same as checking them one by one
+	std::atomic<size_t> nextChunk { 0u };
+	std::atomic<size_t> firstDivergence { instrCount };
+	auto const checkChunks = [&]() {
+		for (;;) {
+			size_t const chunkStart = (
+				  nextChunk.fetch_add(1u, std::memory_order_relaxed)
+				* kValidateChunkInstructionCount
+			);
+			// every chunk after this one starts later still
+			if (chunkStart >= firstDivergence.load(std::memory_order_relaxed)) {
+				return;
+			}
+			size_t const chunkEnd = (
+				std::min(instrCount, chunkStart + kValidateChunkInstructionCount)
+			);
+			for (size_t instrIt = chunkStart; instrIt < chunkEnd; ++ instrIt) {
+				if (instrIt >= firstDivergence.load(std::memory_order_relaxed)) {
+					break;
+				}
+				InstructionBlock const & block = (
+					::fetchInstructionBlockShared(fileData, parseFlags, instrIt)
+				);
+				InstructionBlock const & blockCmp = (
+					::fetchInstructionBlockShared(
+						fileDataCmp, parseFlagsCmp, instrIt
+					)
+				);
+				if (
+					!::isInstructionDiverged(
+						fileData, block, fileDataCmp, blockCmp, instrIt
+					)
+				) {
+					continue;
+				}
+				size_t divergence = firstDivergence.load(std::memory_order_relaxed);
+				while (
+					   instrIt < divergence
+					&& !firstDivergence.compare_exchange_weak(
+						divergence, instrIt, std::memory_order_relaxed
+					)
+				);
+				break;
+			}
 		}
-		SnortFs::MemoryRegionDiff const * diffs = (
-			SnortFs::replay_instructionDiff(replay, instrIt, regionIt)
+	};
+
+	// -- the calling thread is one of the workers
+	size_t const chunkCount = (
+		(instrCount + kValidateChunkInstructionCount - 1u)
+		/ kValidateChunkInstructionCount
+	);
+	size_t threadCount = (
+		workerCount != 0u
+		? workerCount
+		: std::max(1u, std::thread::hardware_concurrency())
+	);
+	if (fileData.version == 1u || fileDataCmp.version == 1u) {
+		threadCount = 1u;
+	}
+	threadCount = std::max<size_t>(1u, std::min(threadCount, chunkCount));
+	std::vector<std::thread> threads;
+	for (size_t it = 1u; it < threadCount; ++ it) {
+		threads.emplace_back(checkChunks);
+	}
+	checkChunks();
+	for (auto & thread : threads) {
+		thread.join();
+	}
+
+	size_t const divergence = firstDivergence.load();
+	return divergence == instrCount ? ~0u : divergence;
+}
+
+// --
+
+SnortFs::HashDivergence SnortFs::validateHashes(
+	ReplayFile const & replay,
+	ReplayFile const & replayCmp
+) {
+	SnortFs::HashDivergence divergence {
+		.isComparable = false,
+		.isDiverged = true,
+		.firstInstruction = 0u,
+		.instructionCount = 0u,
+		.regionIndices = {},
+	};
+	size_t const regionCount = SnortFs::replay_regionCount(replay);
+	if (
+		   regionCount != SnortFs::replay_regionCount(replayCmp)
+		|| (
+			  SnortFs::replay_instructionOffset(replay)
+			!= SnortFs::replay_instructionOffset(replayCmp)
+		)
+		|| !SnortFs::replay_isHashOnly(replay)
+		|| !SnortFs::replay_isHashOnly(replayCmp)
+	) {
+		printf(
+			"replay files must both be hash-only, with the same region count "
+			"and instruction offset\n"
 		);
-		SnortFs::MemoryRegionDiff const * diffsCmp = (
-			SnortFs::replay_instructionDiff(replayCmp, instrIt, regionIt)
+		return divergence;
+	}
+	divergence.isComparable = true;
+
+	// -- compare block by block, blocks are only a few hashes each
+	std::vector<uint64_t> hashes(regionCount);
+	std::vector<uint64_t> hashesCmp(regionCount);
+	size_t const blockCount = SnortFs::replay_hashBlockCount(replay);
+	size_t const blockCountCmp = SnortFs::replay_hashBlockCount(replayCmp);
+	for (size_t it = 0; it < std::min(blockCount, blockCountCmp); ++ it) {
+		SnortFs::ReplayHashBlock block {};
+		SnortFs::ReplayHashBlock blockCmp {};
+		bool const isValid = (
+			   SnortFs::replay_hashBlock(replay, it, block, hashes.data())
+			&& SnortFs::replay_hashBlock(replayCmp, it, blockCmp, hashesCmp.data())
 		);
-		for (size_t diffIt = 0; diffIt < diffCount; ++ diffIt) {
-			SnortFs::MemoryRegionDiff const & diff = diffs[diffIt];
-			SnortFs::MemoryRegionDiff const & diffCmp = diffsCmp[diffIt];
-			if (
-				   diff.byteOffset != diffCmp.byteOffset
-				|| diff.byteCount != diffCmp.byteCount
-				|| memcmp(diff.data, diffCmp.data, diff.byteCount) != 0
-			) {
-				return instrIt;
+		divergence.firstInstruction = block.firstInstruction;
+		divergence.instructionCount = std::max(
+			block.instructionCount, blockCmp.instructionCount
+		);
+		if (
+			   !isValid
+			|| block.firstInstruction != blockCmp.firstInstruction
+			|| block.instructionCount != blockCmp.instructionCount
+		) {
+			return divergence;
+		}
+		for (size_t regionIt = 0; regionIt < regionCount; ++ regionIt) {
+			if (hashes[regionIt] != hashesCmp[regionIt]) {
+				divergence.regionIndices.emplace_back(regionIt);
 			}
 		}
-	};
-	return ~0u;
+		if (!divergence.regionIndices.empty()) {
+			return divergence;
+		}
+	}
+
+	// -- one replay is longer, it diverges where the shorter one ends
+	uint64_t const instructionCount = SnortFs::replay_instructionCount(replay);
+	uint64_t const instructionCountCmp = (
+		SnortFs::replay_instructionCount(replayCmp)
+	);
+	if (instructionCount != instructionCountCmp) {
+		divergence.firstInstruction = std::min(
+			instructionCount, instructionCountCmp
+		);
+		divergence.instructionCount = (
+			std::max(instructionCount, instructionCountCmp)
+			- divergence.firstInstruction
+		);
+		return divergence;
+	}
+	divergence.isDiverged = false;
+	return divergence;
 }
@@ -0,0 +1,857 @@
+#include <snort-replay/fs.hpp>
+
+#include <snort-replay/hash.hpp>
+
+#include "codec.hpp"
+#include "format.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace format = SnortFs::format;
+
+namespace {
+
+// adaptive keyframes are written once the diffs since the last keyframe add
+//   up to a few times the size of the full memory, within these bounds
+constexpr uint64_t kAdaptiveKeyframeMinInterval { 256u };
+constexpr uint64_t kAdaptiveKeyframeMaxInterval { 16384u };
+constexpr uint64_t kAdaptiveKeyframeByteFactor { 4u };
+
+struct WriterRing;
+
+struct FileRecorder {
+	SnortCommonInterface commonInterface;
+	uint64_t instructionOffset;
+	std::vector<SnortMemoryRegionCreateInfo> regionCreateInfo;
+	std::vector<std::string> regionLabels;
+
+	std::string recordingFilepath;
+	FILE * filePtr { nullptr };
+	uint64_t fileByteCount { 0 };
+	long instructionCountByteOffset { 0 };
+
+	// chunk payloads are encoded into this buffer when a codec is used
+	SnortFs::codec::Codec const * codec { nullptr };
+	std::vector<uint8_t> encodeBuffer {};
+	uint64_t encodedByteCount { 0 };
+	uint64_t decodedByteCount { 0 };
+
+	// diffs of the current instruction block, appended to the file as a
+	//   single chunk once the block is full
+	std::vector<uint8_t> blockBuffer {};
+	uint64_t blockFirstInstruction { 0 };
+	uint64_t blockInstructionCount { 0 };
+	// where the changed region mask of the current instruction sits in the
+	//   block, its bits are set as the regions are recorded
+	size_t instructionMaskOffset { 0 };
+	std::vector<format::ChunkIndexEntry> chunkIndex {};
+
+	// memory of every region as of the last recorded instruction, kept up to
+	//   date from the diffs so keyframes can be written
+	SnortFs::ReplayRecorderOptions options {};
+	std::vector<uint8_t> shadowMemory {};
+	std::vector<size_t> shadowRegionOffsets {};
+	uint64_t keyframeInstructionCount { 0 };
+	uint64_t keyframeDiffByteCount { 0 };
+	uint64_t keyframeCount { 0 };
+
+	// hash-only recording, the hash of each region's shadow memory, only
+	//   rehashed when the region changes, and the block's fold of them
+	std::vector<uint64_t> regionHashes {};
+	std::vector<uint64_t> blockRegionHashes {};
+
+	// input state changes within the current block, written as a chunk just
+	//   ahead of it. The state starts at zero, like the reader's
+	std::vector<uint8_t> inputBuffer {};
+	uint64_t inputInstruction { 0 };
+	uint64_t inputState { 0 };
+
+	uint64_t recordingRegionOffset {0};
+	uint64_t recordingInstructionCount {0};
+	uint64_t recordingByteCount {0};
+	// times one of the buffers above had to grow, atomic so the stats can
+	//   be read while the writer thread records
+	std::atomic<uint64_t> allocationCount {0};
+
+	// with the async writer everything above is owned by the writer thread
+	//   until it's joined on close
+	std::unique_ptr<WriterRing> writerRing {};
+	std::thread writerThread {};
+};
+
+// the recorder's buffers are reused between blocks, so once they've grown to
+//   fit the largest block recording doesn't allocate. Growth is counted for
+//   the closing summary
+void countGrowth(
+	FileRecorder & recorder,
+	size_t const capacityBefore,
+	size_t const capacityAfter
+) {
+	if (capacityBefore != capacityAfter) {
+		recorder.allocationCount.fetch_add(1u, std::memory_order_relaxed);
+	}
+}
+
+void fileWrite(
+	FileRecorder & recorder,
+	void const * const data,
+	size_t const byteCount
+) {
+	fwrite(data, 1, byteCount, recorder.filePtr);
+	recorder.fileByteCount += byteCount;
+}
+
+void fileWriteU64(FileRecorder & recorder, uint64_t const value) {
+	fileWrite(recorder, &value, 8);
+}
+
+void blockWrite(
+	FileRecorder & recorder,
+	void const * const data,
+	size_t const byteCount
+) {
+	uint8_t const * const bytes = (uint8_t const *)data;
+	size_t const capacity = recorder.blockBuffer.capacity();
+	recorder.blockBuffer.insert(
+		recorder.blockBuffer.end(), bytes, bytes + byteCount
+	);
+	::countGrowth(recorder, capacity, recorder.blockBuffer.capacity());
+}
+
+void bufferWriteVarint(
+	FileRecorder & recorder,
+	std::vector<uint8_t> & buffer,
+	uint64_t value
+) {
+	uint8_t bytes[format::kVarintMaxByteCount];
+	size_t byteCount = 0u;
+	for (; value >= 0x80u; value >>= 7u) {
+		bytes[byteCount ++] = (uint8_t)(value | 0x80u);
+	}
+	bytes[byteCount ++] = (uint8_t)value;
+	size_t const capacity = buffer.capacity();
+	buffer.insert(buffer.end(), bytes, bytes + byteCount);
+	::countGrowth(recorder, capacity, buffer.capacity());
+}
+
+void blockWriteVarint(FileRecorder & recorder, uint64_t const value) {
+	::bufferWriteVarint(recorder, recorder.blockBuffer, value);
+}
+
+void writeChunk(
+	FileRecorder & recorder,
+	format::ChunkType const type,
+	uint64_t const firstInstruction,
+	uint64_t const instructionCount,
+	uint8_t const * payload,
+	size_t payloadByteCount
+) {
+	// -- encode the payload, prefixed with the decoded byte count
+	if (recorder.codec != nullptr) {
+		size_t const headerByteCount = format::kEncodedPayloadHeaderByteCount;
+		size_t const capacity = recorder.encodeBuffer.capacity();
+		recorder.encodeBuffer.resize(
+			headerByteCount + recorder.codec->encodeBound(payloadByteCount)
+		);
+		::countGrowth(recorder, capacity, recorder.encodeBuffer.capacity());
+		uint64_t const decodedByteCount = payloadByteCount;
+		memcpy(recorder.encodeBuffer.data(), &decodedByteCount, 8);
+		size_t const encodedByteCount = recorder.codec->encode(
+			payload, payloadByteCount,
+			recorder.encodeBuffer.data() + headerByteCount
+		);
+		recorder.decodedByteCount += payloadByteCount;
+		recorder.encodedByteCount += headerByteCount + encodedByteCount;
+		payload = recorder.encodeBuffer.data();
+		payloadByteCount = headerByteCount + encodedByteCount;
+	}
+	format::ChunkIndexEntry const entry = {
+		.type = type,
+		.firstInstruction = firstInstruction,
+		.instructionCount = instructionCount,
+		.byteOffset = recorder.fileByteCount,
+		.payloadByteCount = payloadByteCount,
+		.checksum = SnortFs::hash64(payload, payloadByteCount),
+	};
+	fileWriteU64(recorder, entry.type);
+	fileWriteU64(recorder, entry.firstInstruction);
+	fileWriteU64(recorder, entry.instructionCount);
+	fileWriteU64(recorder, entry.payloadByteCount);
+	fileWrite(recorder, payload, payloadByteCount);
+	size_t const capacity = recorder.chunkIndex.capacity();
+	recorder.chunkIndex.emplace_back(entry);
+	::countGrowth(recorder, capacity, recorder.chunkIndex.capacity());
+}
+
+// writes the input changes of the current block as a chunk, ahead of the
+//   block's own chunk
+void flushInputs(FileRecorder & recorder) {
+	if (recorder.inputBuffer.empty()) { return; }
+	writeChunk(
+		recorder,
+		format::kChunkType_inputs,
+		recorder.blockFirstInstruction,
+		recorder.blockInstructionCount,
+		recorder.inputBuffer.data(),
+		recorder.inputBuffer.size()
+	);
+	recorder.inputBuffer.clear();
+}
+
+// writes the current instruction block as a chunk and starts a new block
+void flushBlock(FileRecorder & recorder) {
+	if (recorder.blockInstructionCount == 0u) { return; }
+	::flushInputs(recorder);
+	writeChunk(
+		recorder,
+		format::kChunkType_instructions,
+		recorder.blockFirstInstruction,
+		recorder.blockInstructionCount,
+		recorder.blockBuffer.data(),
+		recorder.blockBuffer.size()
+	);
+	recorder.blockFirstInstruction += recorder.blockInstructionCount;
+	recorder.blockInstructionCount = 0u;
+	recorder.blockBuffer.clear();
+}
+
+// writes the block's region hashes as a chunk and starts a new block
+void flushHashBlock(FileRecorder & recorder) {
+	if (recorder.blockInstructionCount == 0u) { return; }
+	::flushInputs(recorder);
+	writeChunk(
+		recorder,
+		format::kChunkType_hashes,
+		recorder.blockFirstInstruction,
+		recorder.blockInstructionCount,
+		(uint8_t const *)recorder.blockRegionHashes.data(),
+		recorder.blockRegionHashes.size() * sizeof(uint64_t)
+	);
+	recorder.blockFirstInstruction += recorder.blockInstructionCount;
+	recorder.blockInstructionCount = 0u;
+	std::fill(
+		recorder.blockRegionHashes.begin(), recorder.blockRegionHashes.end(), 0u
+	);
+}
+
+// keyframes split blocks, so seeking only ever applies the diffs of the
+//   blocks that follow a keyframe. Hash blocks aren't split, their
+//   boundaries have to line up between recordings to be compared
+void writeKeyframe(FileRecorder & recorder) {
+	if (!recorder.options.hashOnly) {
+		flushBlock(recorder);
+	}
+	writeChunk(
+		recorder,
+		format::kChunkType_keyframe,
+		recorder.recordingInstructionCount - 1u,
+		0u,
+		recorder.shadowMemory.data(),
+		recorder.shadowMemory.size()
+	);
+	recorder.keyframeInstructionCount = 0u;
+	recorder.keyframeDiffByteCount = 0u;
+	recorder.keyframeCount += 1u;
+}
+
+bool shouldWriteKeyframe(FileRecorder const & recorder) {
+	if (!recorder.options.keyframes) { return false; }
+	uint64_t const interval = recorder.options.keyframeInterval;
+	if (interval != 0u) {
+		return recorder.keyframeInstructionCount >= interval;
+	}
+	if (recorder.options.hashOnly) {
+		return (
+			recorder.keyframeInstructionCount >= SnortFs::kHashOnlyKeyframeInterval
+		);
+	}
+	if (recorder.keyframeInstructionCount >= kAdaptiveKeyframeMaxInterval) {
+		return true;
+	}
+	return (
+		   recorder.keyframeInstructionCount >= kAdaptiveKeyframeMinInterval
+		&& (
+			  recorder.keyframeDiffByteCount
+			>= recorder.shadowMemory.size() * kAdaptiveKeyframeByteFactor
+		)
+	);
+}
+
+// appends the diffs of the next region of the current instruction
+void recordRegion(
+	FileRecorder & recorder,
+	size_t const diffCount,
+	SnortFs::MemoryRegionDiffRecord const * const diffs
+) {
+	// -- check if need to start a new instruction, which starts with an empty
+	//    changed region mask
+	bool const isHashOnly = recorder.options.hashOnly;
+	if (recorder.recordingRegionOffset == 0u) {
+		recorder.recordingInstructionCount += 1;
+	}
+	if (recorder.recordingRegionOffset == 0u && !isHashOnly) {
+		recorder.instructionMaskOffset = recorder.blockBuffer.size();
+		size_t const capacity = recorder.blockBuffer.capacity();
+		recorder.blockBuffer.resize(
+			  recorder.blockBuffer.size()
+			+ format::regionMaskByteCount(recorder.regionCreateInfo.size())
+		);
+		::countGrowth(recorder, capacity, recorder.blockBuffer.capacity());
+	}
+
+	// -- append the diffs for the current instruction and region
+	size_t const regionIndex = recorder.recordingRegionOffset;
+	uint8_t * const shadowRegion = (
+		recorder.shadowMemory.data() + recorder.shadowRegionOffsets[regionIndex]
+	);
+	size_t const shadowRegionByteCount = (
+		  recorder.shadowRegionOffsets[regionIndex + 1u]
+		- recorder.shadowRegionOffsets[regionIndex]
+	);
+	if (diffCount > 0u && !isHashOnly) {
+		recorder.blockBuffer[recorder.instructionMaskOffset + regionIndex / 8u] |= (
+			(uint8_t)(1u << (regionIndex % 8u))
+		);
+		::blockWriteVarint(recorder, diffCount);
+	}
+	for (size_t it = 0; it < diffCount; ++ it) {
+		if (!isHashOnly) {
+			::blockWriteVarint(recorder, diffs[it].byteOffset);
+			::blockWriteVarint(recorder, diffs[it].byteCount);
+			::blockWrite(recorder, diffs[it].data, diffs[it].byteCount);
+		}
+		recorder.recordingByteCount += diffs[it].byteCount;
+		recorder.keyframeDiffByteCount += diffs[it].byteCount;
+		if (
+			   diffs[it].byteOffset > shadowRegionByteCount
+			|| diffs[it].byteCount > shadowRegionByteCount - diffs[it].byteOffset
+		) {
+			printf(
+				"warning: recorded diff [%zu, +%zu] is outside of region %zu\n",
+				(size_t)diffs[it].byteOffset, (size_t)diffs[it].byteCount,
+				regionIndex
+			);
+			continue;
+		}
+		memcpy(
+			shadowRegion + diffs[it].byteOffset,
+			diffs[it].data,
+			diffs[it].byteCount
+		);
+	}
+
+	// -- hash-only, fold the region's hash, which only has to be recomputed
+	//    if it changed
+	if (isHashOnly) {
+		if (diffCount > 0u) {
+			recorder.regionHashes[regionIndex] = (
+				SnortFs::hash64(shadowRegion, shadowRegionByteCount)
+			);
+		}
+		recorder.blockRegionHashes[regionIndex] = SnortFs::hash64_fold(
+			recorder.blockRegionHashes[regionIndex],
+			recorder.regionHashes[regionIndex]
+		);
+	}
+
+	// -- once the instruction is complete, check if a keyframe is due or the
+	//    block is full
+	recorder.recordingRegionOffset += 1;
+	if (recorder.recordingRegionOffset == recorder.regionCreateInfo.size()) {
+		recorder.recordingRegionOffset = 0;
+		recorder.blockInstructionCount += 1u;
+		recorder.keyframeInstructionCount += 1u;
+		if (::shouldWriteKeyframe(recorder)) {
+			::writeKeyframe(recorder);
+		}
+		else if (
+			   !isHashOnly
+			&& (
+				   recorder.blockInstructionCount >= format::kBlockInstructionCount
+				|| recorder.blockBuffer.size() >= format::kBlockFlushByteCount
+			)
+		) {
+			::flushBlock(recorder);
+		}
+		if (
+			   isHashOnly
+			&& recorder.blockInstructionCount >= recorder.options.hashInterval
+		) {
+			::flushHashBlock(recorder);
+		}
+	}
+}
+
+// stores the change of input state ahead of the next instruction, the index
+//   is relative to the previous change or the block's first instruction
+void recordInput(FileRecorder & recorder, uint64_t const inputState) {
+	if (recorder.inputState == inputState) { return; }
+	uint64_t const instruction = recorder.recordingInstructionCount;
+	::bufferWriteVarint(
+		recorder,
+		recorder.inputBuffer,
+		instruction - (
+			recorder.inputBuffer.empty()
+			? recorder.blockFirstInstruction
+			: recorder.inputInstruction
+		)
+	);
+	::bufferWriteVarint(recorder, recorder.inputBuffer, inputState);
+	recorder.inputInstruction = instruction;
+	recorder.inputState = inputState;
+}
+
+// -- async writer --------------------------------------------------------------
+
+// single producer, single consumer byte ring between the recording thread and
+//   the writer thread. Each region is a message of its diff count followed
+//   by each diff's byte offset, byte count and data. Messages larger than the
+//   ring are streamed through it as the writer drains it
+struct WriterRing {
+	std::vector<uint8_t> bytes;
+	uint64_t mask;
+	alignas(64) std::atomic<uint64_t> writePosition { 0 };
+	alignas(64) std::atomic<uint64_t> readPosition { 0 };
+	// producer side
+	alignas(64) uint64_t producerPosition { 0 };
+	uint64_t producerReadPosition { 0 };
+	uint64_t stallCount { 0 };
+	uint64_t stallNanoseconds { 0 };
+	// consumer side
+	alignas(64) uint64_t consumerPosition { 0 };
+	uint64_t consumerWritePosition { 0 };
+	std::vector<uint8_t> consumerData {};
+	std::vector<SnortFs::MemoryRegionDiffRecord> consumerDiffs {};
+};
+
+// diff count that tells the writer thread the recording is closing
+constexpr uint64_t kRingCloseMessage { ~0ull };
+// diff count that's followed by an input state instead of diffs
+constexpr uint64_t kRingInputMessage { ~0ull - 1u };
+
+void ringPublish(WriterRing & ring) {
+	ring.writePosition.store(ring.producerPosition, std::memory_order_release);
+	ring.writePosition.notify_one();
+}
+
+void ringPush(WriterRing & ring, void const * const data, size_t byteCount) {
+	uint8_t const * src = (uint8_t const *)data;
+	uint64_t const capacity = ring.bytes.size();
+	while (byteCount > 0u) {
+		uint64_t freeByteCount = (
+			capacity - (ring.producerPosition - ring.producerReadPosition)
+		);
+		if (freeByteCount == 0u) {
+			ring.producerReadPosition = (
+				ring.readPosition.load(std::memory_order_acquire)
+			);
+			freeByteCount = (
+				capacity - (ring.producerPosition - ring.producerReadPosition)
+			);
+		}
+		// -- backpressure, hand over what's written so far and wait for the
+		//    writer thread to make room
+		if (freeByteCount == 0u) {
+			ringPublish(ring);
+			auto const stallStart = std::chrono::steady_clock::now();
+			while (freeByteCount == 0u) {
+				ring.readPosition.wait(
+					ring.producerReadPosition, std::memory_order_acquire
+				);
+				ring.producerReadPosition = (
+					ring.readPosition.load(std::memory_order_acquire)
+				);
+				freeByteCount = (
+					capacity - (ring.producerPosition - ring.producerReadPosition)
+				);
+			}
+			ring.stallCount += 1u;
+			ring.stallNanoseconds += (uint64_t)(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now() - stallStart
+				).count()
+			);
+		}
+		size_t const count = (size_t)std::min<uint64_t>(byteCount, freeByteCount);
+		size_t const offset = (size_t)(ring.producerPosition & ring.mask);
+		size_t const firstCount = std::min<size_t>(count, capacity - offset);
+		memcpy(ring.bytes.data() + offset, src, firstCount);
+		memcpy(ring.bytes.data(), src + firstCount, count - firstCount);
+		ring.producerPosition += count;
+		src += count;
+		byteCount -= count;
+	}
+}
+
+void ringPushU64(WriterRing & ring, uint64_t const value) {
+	ringPush(ring, &value, 8);
+}
+
+void ringPushRegion(
+	WriterRing & ring,
+	size_t const diffCount,
+	SnortFs::MemoryRegionDiffRecord const * const diffs
+) {
+	ringPushU64(ring, diffCount);
+	for (size_t it = 0; it < diffCount; ++ it) {
+		ringPushU64(ring, diffs[it].byteOffset);
+		ringPushU64(ring, diffs[it].byteCount);
+		ringPush(ring, diffs[it].data, diffs[it].byteCount);
+	}
+	ringPublish(ring);
+}
+
+void ringPop(WriterRing & ring, void * const data, size_t byteCount) {
+	uint8_t * dst = (uint8_t *)data;
+	uint64_t const capacity = ring.bytes.size();
+	while (byteCount > 0u) {
+		if (ring.consumerWritePosition == ring.consumerPosition) {
+			// hand back the consumed bytes before waiting for more
+			ring.readPosition.store(
+				ring.consumerPosition, std::memory_order_release
+			);
+			ring.readPosition.notify_one();
+			ring.writePosition.wait(
+				ring.consumerPosition, std::memory_order_acquire
+			);
+			ring.consumerWritePosition = (
+				ring.writePosition.load(std::memory_order_acquire)
+			);
+			continue;
+		}
+		size_t const count = (size_t)std::min<uint64_t>(
+			byteCount, ring.consumerWritePosition - ring.consumerPosition
+		);
+		size_t const offset = (size_t)(ring.consumerPosition & ring.mask);
+		size_t const firstCount = std::min<size_t>(count, capacity - offset);
+		memcpy(dst, ring.bytes.data() + offset, firstCount);
+		memcpy(dst + firstCount, ring.bytes.data(), count - firstCount);
+		ring.consumerPosition += count;
+		dst += count;
+		byteCount -= count;
+	}
+}
+
+uint64_t ringPopU64(WriterRing & ring) {
+	uint64_t value;
+	ringPop(ring, &value, 8);
+	return value;
+}
+
+// runs on the writer thread until the close message
+void writerThreadMain(FileRecorder & recorder) {
+	WriterRing & ring = *recorder.writerRing;
+	while (true) {
+		uint64_t const diffCount = ::ringPopU64(ring);
+		if (diffCount == kRingCloseMessage) { break; }
+		if (diffCount == kRingInputMessage) {
+			::recordInput(recorder, ::ringPopU64(ring));
+			continue;
+		}
+		ring.consumerData.clear();
+		ring.consumerDiffs.clear();
+		size_t const dataCapacity = ring.consumerData.capacity();
+		size_t const diffCapacity = ring.consumerDiffs.capacity();
+		for (size_t it = 0; it < diffCount; ++ it) {
+			uint64_t const byteOffset = ::ringPopU64(ring);
+			uint64_t const byteCount = ::ringPopU64(ring);
+			size_t const dataOffset = ring.consumerData.size();
+			ring.consumerData.resize(dataOffset + byteCount);
+			::ringPop(ring, ring.consumerData.data() + dataOffset, byteCount);
+			// data holds the offset until every diff is read, as the data
+			//   buffer may still move
+			ring.consumerDiffs.emplace_back(SnortFs::MemoryRegionDiffRecord {
+				.byteOffset = byteOffset,
+				.byteCount = byteCount,
+				.data = (uint8_t const *)(uintptr_t)dataOffset,
+			});
+		}
+		for (auto & diff : ring.consumerDiffs) {
+			diff.data = ring.consumerData.data() + (uintptr_t)diff.data;
+		}
+		::countGrowth(recorder, dataCapacity, ring.consumerData.capacity());
+		::countGrowth(recorder, diffCapacity, ring.consumerDiffs.capacity());
+		::recordRegion(recorder, diffCount, ring.consumerDiffs.data());
+		ring.readPosition.store(ring.consumerPosition, std::memory_order_release);
+		ring.readPosition.notify_one();
+	}
+}
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// -- snort fs recording impl --------------------------------------------------
+// -----------------------------------------------------------------------------
+
+SnortFs::ReplayFileRecorder SnortFs::replayRecorder_open(
+	char const * const filepath,
+	SnortCommonInterface const commonInterface,
+	uint64_t const instructionOffset,
+	uint64_t const regionCount,
+	SnortMemoryRegionCreateInfo const * const regionCreateInfo,
+	ReplayRecorderOptions const & options
+) {
+	FILE * filePtr = fopen(filepath, "wb");
+	if (filePtr == nullptr) {
+		printf(
+			"error: failed to open file for writing replay recording at '%s'\n",
+			filepath
+		);
+		return SnortFs::ReplayFileRecorder { 0 };
+	}
+
+	FileRecorder * recorderPtr = new FileRecorder {
+		.commonInterface = commonInterface,
+		.instructionOffset = instructionOffset,
+		.regionCreateInfo = std::vector<SnortMemoryRegionCreateInfo>(regionCount),
+		.regionLabels = std::vector<std::string>(regionCount),
+		.recordingFilepath = filepath,
+		.filePtr = filePtr,
+		.options = options,
+	};
+	if (options.codec != SnortFs::kReplayCodec_none) {
+		recorderPtr->codec = SnortFs::codec::find(options.codec);
+		if (recorderPtr->codec == nullptr) {
+			printf(
+				"warning: unknown replay codec %zu, recording uncompressed\n",
+				(size_t)options.codec
+			);
+		}
+	}
+	FileRecorder & recorder = *recorderPtr;
+	recorder.blockBuffer.reserve(format::kBlockFlushByteCount);
+	for (size_t it = 0; it < regionCount; ++it) {
+		recorder.regionCreateInfo[it] = regionCreateInfo[it];
+		recorder.regionLabels[it] = std::string(regionCreateInfo[it].label);
+		recorder.regionCreateInfo[it].label = recorder.regionLabels[it].c_str();
+		recorder.shadowRegionOffsets.emplace_back(recorder.shadowMemory.size());
+		recorder.shadowMemory.resize(
+			  recorder.shadowMemory.size()
+			+ regionCreateInfo[it].elementCount
+			* snort_dtByteCount(regionCreateInfo[it].dataType)
+		);
+	}
+	recorder.shadowRegionOffsets.emplace_back(recorder.shadowMemory.size());
+	if (options.hashOnly) {
+		recorder.options.hashInterval = std::max<uint64_t>(options.hashInterval, 1u);
+		recorder.regionHashes.resize(regionCount);
+		recorder.blockRegionHashes.resize(regionCount);
+	}
+	printf("starting recording to file '%s' with instruction offset %zu and region count %zu\n",
+		recorder.recordingFilepath.c_str(),
+		(size_t)recorder.instructionOffset,
+		(size_t)recorder.regionCreateInfo.size()
+	);
+
+	// -- write magic number, flags and the codec if there is one
+	fileWrite(recorder, format::kMagicV2, 8);
+	uint64_t flags = (
+		format::kHeaderFlag_varintDiffs | format::kHeaderFlag_regionMask
+	);
+	if (recorder.codec != nullptr) {
+		flags |= format::kHeaderFlag_blockCodec;
+	}
+	if (options.hashOnly) {
+		flags |= format::kHeaderFlag_hashOnly;
+	}
+	if (options.hasRngSeed) {
+		flags |= format::kHeaderFlag_rngSeed;
+	}
+	if (options.recordInputs) {
+		flags |= format::kHeaderFlag_inputs;
+	}
+	fileWriteU64(recorder, flags);
+	if (recorder.codec != nullptr) {
+		fileWriteU64(recorder, (uint64_t)options.codec);
+	}
+	if (options.hasRngSeed) {
+		fileWriteU64(recorder, options.rngSeed);
+	}
+
+	// -- write common interface
+	fileWriteU64(recorder, (uint64_t)recorder.commonInterface);
+
+	// -- write instruction offset, instruction count and region count
+	//    the instruction count isn't known yet, it's patched in on close
+	fileWriteU64(recorder, recorder.instructionOffset);
+	recorder.instructionCountByteOffset = (long)recorder.fileByteCount;
+	fileWriteU64(recorder, 0u);
+	fileWriteU64(recorder, recorder.regionCreateInfo.size());
+
+	// write per-memory region create info
+	for (size_t regIt = 0; regIt < recorder.regionCreateInfo.size(); ++regIt) {
+		auto const & regionInfo = recorder.regionCreateInfo[regIt];
+		fileWriteU64(recorder, (uint64_t)regionInfo.dataType);
+		fileWriteU64(recorder, regionInfo.elementCount);
+		fileWriteU64(recorder, regionInfo.elementDisplayRowStride);
+		fileWrite(
+			recorder,
+			recorder.regionLabels[regIt].c_str(),
+			recorder.regionLabels[regIt].size() + 1
+		);
+	}
+
+	// -- start the writer thread, the ring is rounded up to a power of two
+	if (options.asyncWriter) {
+		size_t ringByteCount = 64u;
+		while (ringByteCount < options.asyncRingByteCount) {
+			ringByteCount *= 2u;
+		}
+		recorder.writerRing = std::make_unique<WriterRing>();
+		recorder.writerRing->bytes.resize(ringByteCount);
+		recorder.writerRing->mask = ringByteCount - 1u;
+		recorder.writerThread = std::thread(::writerThreadMain, std::ref(recorder));
+	}
+
+	return SnortFs::ReplayFileRecorder {
+		(uint64_t)(uintptr_t)(recorderPtr)
+	};
+}
+
+// --
+
+void SnortFs::replayRecorder_close(ReplayFileRecorder & recorderHandle) {
+	if (recorderHandle.handle == 0u) { return; }
+	FileRecorder & recorder = *(FileRecorder *)(uintptr_t)(recorderHandle.handle);
+	// -- let the writer thread drain the ring
+	if (recorder.writerRing != nullptr) {
+		::ringPushU64(*recorder.writerRing, kRingCloseMessage);
+		::ringPublish(*recorder.writerRing);
+		recorder.writerThread.join();
+	}
+
+	// -- complete an unfinished instruction so the file stays well-formed,
+	//    the remaining regions are left out of its mask
+	if (recorder.recordingRegionOffset != 0u) {
+		printf(
+			"warning: recording ended with incomplete instruction, "
+			"recorded %zu regions out of %zu for instruction %zu\n",
+			(size_t)recorder.recordingRegionOffset,
+			(size_t)recorder.regionCreateInfo.size(),
+			(size_t)(recorder.recordingInstructionCount - 1u)
+		);
+		recorder.recordingRegionOffset = 0u;
+		recorder.blockInstructionCount += 1u;
+	}
+	if (recorder.options.hashOnly) {
+		::flushHashBlock(recorder);
+	}
+	else {
+		::flushBlock(recorder);
+	}
+
+	printf(
+		"closing recording to file '%s', recorded %zu instructions,"
+		" %zu keyframes and %zu total KiB with %zu buffer allocations\n",
+		recorder.recordingFilepath.c_str(),
+		(size_t)recorder.recordingInstructionCount,
+		(size_t)recorder.keyframeCount,
+		(size_t)(recorder.recordingByteCount / 1024ull),
+		(size_t)recorder.allocationCount.load()
+	);
+	if (recorder.codec != nullptr) {
+		printf(
+			"compressed chunks with '%s' from %zu KiB to %zu KiB\n",
+			recorder.codec->name,
+			(size_t)(recorder.decodedByteCount / 1024ull),
+			(size_t)(recorder.encodedByteCount / 1024ull)
+		);
+	}
+	if (recorder.writerRing != nullptr) {
+		printf(
+			"async writer stalled recording %zu times for %.3f ms\n",
+			(size_t)recorder.writerRing->stallCount,
+			(double)recorder.writerRing->stallNanoseconds / 1e6
+		);
+	}
+
+	// -- write magic number to mark the end of the chunks
+	::fileWrite(recorder, format::kMagicV2, 8);
+
+	// -- write the index footer
+	for (auto const & entry : recorder.chunkIndex) {
+		::fileWriteU64(recorder, entry.type);
+		::fileWriteU64(recorder, entry.firstInstruction);
+		::fileWriteU64(recorder, entry.instructionCount);
+		::fileWriteU64(recorder, entry.byteOffset);
+		::fileWriteU64(recorder, entry.payloadByteCount);
+		::fileWriteU64(recorder, entry.checksum);
+	}
+	::fileWriteU64(recorder, recorder.chunkIndex.size());
+	::fileWrite(recorder, format::kMagicIndex, 8);
+
+	// -- patch the instruction count into the header
+	fseek(recorder.filePtr, recorder.instructionCountByteOffset, SEEK_SET);
+	fwrite(&recorder.recordingInstructionCount, 8, 1, recorder.filePtr);
+
+	fflush(recorder.filePtr);
+	fclose(recorder.filePtr);
+	delete &recorder;
+	recorderHandle.handle = 0;
+}
+
+// --
+
+SnortFs::ReplayRecorderStats SnortFs::replayRecorder_stats(
+	ReplayFileRecorder const recorderHandle
+) {
+	if (recorderHandle.handle == 0) { return {}; }
+	FileRecorder & recorder = *(FileRecorder *)(uintptr_t)(recorderHandle.handle);
+	SnortFs::ReplayRecorderStats stats {
+		.writerStallCount = 0u,
+		.writerStallNanoseconds = 0u,
+		.allocationCount = recorder.allocationCount.load(),
+	};
+	if (recorder.writerRing != nullptr) {
+		stats.writerStallCount = recorder.writerRing->stallCount;
+		stats.writerStallNanoseconds = recorder.writerRing->stallNanoseconds;
+	}
+	return stats;
+}
+
+// --
+
+void SnortFs::replayRecorder_recordInstruction(
+	ReplayFileRecorder & recorderHandle,
+	size_t const diffCount,
+	MemoryRegionDiffRecord const * diffs
+) {
+	if (recorderHandle.handle == 0) {
+		printf(
+			"err: recording replay diff with invalid file recorder\n"
+		);
+		return;
+	}
+	FileRecorder & recorder = *(FileRecorder *)(uintptr_t)(recorderHandle.handle);
+	if (recorder.writerRing != nullptr) {
+		::ringPushRegion(*recorder.writerRing, diffCount, diffs);
+		return;
+	}
+	::recordRegion(recorder, diffCount, diffs);
+}
+
+// --
+
+void SnortFs::replayRecorder_recordInput(
+	ReplayFileRecorder & recorderHandle,
+	uint64_t const inputState
+) {
+	if (recorderHandle.handle == 0) { return; }
+	FileRecorder & recorder = *(FileRecorder *)(uintptr_t)(recorderHandle.handle);
+	if (!recorder.options.recordInputs) { return; }
+	if (recorder.writerRing != nullptr) {
+		::ringPushU64(*recorder.writerRing, kRingInputMessage);
+		::ringPushU64(*recorder.writerRing, inputState);
+		::ringPublish(*recorder.writerRing);
+		return;
+	}
+	::recordInput(recorder, inputState);
+}
@@ -12,6 +12,9 @@ void snort_displayInitialize();
 void snort_displayDestroy();
 void snort_displayFrameBegin();
 void snort_displayFrameEnd();
+// while idle, e.g. paused, the frame end waits for input events instead of
+//   redrawing at the target fps
+void snort_displaySetIdle(bool idle);
 
 void snort_displayMemory(
 	SnortCommonInterface commonInterface,
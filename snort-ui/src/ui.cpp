@@ -5,6 +5,7 @@
 #include <raylib.h>
 #include <imgui.h>
 
+#include <algorithm>
 #include <cmath>
 #include <string>
 #include <unordered_map>
@@ -60,6 +61,20 @@ void snort_displayDestroy() {
 
 // --
 
+void snort_displaySetIdle(bool const idle) {
+	static bool isIdle = false;
+	if (idle == isIdle) { return; }
+	isIdle = idle;
+	// the frame end blocks until there's input instead of redrawing at 60 fps
+	if (idle) {
+		EnableEventWaiting();
+	} else {
+		DisableEventWaiting();
+	}
+}
+
+// --
+
 void snort_displayFrameBegin() {
 	BeginDrawing();
 	ClearBackground(DARKGRAY);
@@ -135,62 +150,79 @@ void gui::displayMemoryRegion(
 
 	size_t const byteStride = snort_dtByteCount(regionInfo.dataType);
 
-	if (regionInfo.elementDisplayRowStride != 0) {
-		ImGui::Text("[0]");
-		ImGui::SameLine();
-	}
-
-	// display memory region based on data type for the specified row
-	for (size_t it = 0; it < regionInfo.elementCount; ++it) {
-		uint8_t const * const regionPtr = (
-			(uint8_t const *)regionData + it * byteStride
-		);
-		ImColor textColor = ImGui::GetStyleColorVec4(ImGuiCol_Text);
-		// compare memory, if mismatch then color red
-		if (optRegionDataCmp != nullptr) {
-			uint8_t const * const cmpPtr = (
-				(uint8_t const *)optRegionDataCmp + it * byteStride
+	// only the visible rows are submitted, regions can have thousands of
+	//   elements. Without a row stride every element is its own row
+	size_t const rowStride = (
+		regionInfo.elementDisplayRowStride != 0
+		? regionInfo.elementDisplayRowStride
+		: 1u
+	);
+	size_t const rowCount = (
+		(regionInfo.elementCount + rowStride - 1u) / rowStride
+	);
+	ImGuiListClipper clipper;
+	clipper.Begin((int)rowCount);
+	while (clipper.Step()) {
+		for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++ row) {
+			size_t const rowBegin = (size_t)row * rowStride;
+			size_t const rowEnd = std::min(
+				rowBegin + rowStride, regionInfo.elementCount
 			);
-			if (memcmp(regionPtr, cmpPtr, byteStride) != 0) {
-				textColor = ImVec4(1.0f, 0.0f, 0.0f, 1.0f);
+			// print the element index at the start of the row
+			if (row != 0) {
+				ImGui::Text("[%04x]", (u32)rowBegin);
+				ImGui::SameLine();
 			}
-		}
-		// look for it in frame history, rolling back the data
-		#define DtDisplay(type, formatStr) \
-			case kSnortDt_##type: { \
-				type const * const dataPtr = (type const *)regionPtr; \
-				ImGui::TextColored(textColor, formatStr, (type)*dataPtr); \
-				break; \
+			else if (regionInfo.elementDisplayRowStride != 0) {
+				ImGui::Text("[0]");
+				ImGui::SameLine();
 			}
-		switch (regionInfo.dataType) {
-			DtDisplay(u8, "0x%02X")
-			DtDisplay(u16, "0x%03x")
-			DtDisplay(u32, "0x%08X")
-			DtDisplay(u64, "0x%016lX")
-			DtDisplay(i8, "0x%02X")
-			DtDisplay(i16, "0x%03x")
-			DtDisplay(i32, "0x%08X")
-			DtDisplay(i64, "0x%016lX")
-			DtDisplay(f32, "%.3f")
-			default: {
-				ImGui::Text("Incompatible data type");
-				break;
+
+			// display memory region based on data type for the specified row
+			for (size_t it = rowBegin; it < rowEnd; ++it) {
+				uint8_t const * const regionPtr = (
+					(uint8_t const *)regionData + it * byteStride
+				);
+				ImColor textColor = ImGui::GetStyleColorVec4(ImGuiCol_Text);
+				// compare memory, if mismatch then color red
+				if (optRegionDataCmp != nullptr) {
+					uint8_t const * const cmpPtr = (
+						(uint8_t const *)optRegionDataCmp + it * byteStride
+					);
+					if (memcmp(regionPtr, cmpPtr, byteStride) != 0) {
+						textColor = ImVec4(1.0f, 0.0f, 0.0f, 1.0f);
+					}
+				}
+				// look for it in frame history, rolling back the data
+				#define DtDisplay(type, formatStr) \
+					case kSnortDt_##type: { \
+						type const * const dataPtr = (type const *)regionPtr; \
+						ImGui::TextColored(textColor, formatStr, (type)*dataPtr); \
+						break; \
+					}
+				switch (regionInfo.dataType) {
+					DtDisplay(u8, "0x%02X")
+					DtDisplay(u16, "0x%03x")
+					DtDisplay(u32, "0x%08X")
+					DtDisplay(u64, "0x%016lX")
+					DtDisplay(i8, "0x%02X")
+					DtDisplay(i16, "0x%03x")
+					DtDisplay(i32, "0x%08X")
+					DtDisplay(i64, "0x%016lX")
+					DtDisplay(f32, "%.3f")
+					default: {
+						ImGui::Text("Incompatible data type");
+						break;
+					}
+				}
+				// check for same line
+				if (it + 1 != rowEnd) {
+					ImGui::SameLine();
+				}
 			}
 		}
-		// check for same line
-		if (
-			   regionInfo.elementDisplayRowStride != 0
-			&& (it + 1) % regionInfo.elementDisplayRowStride != 0
-		) {
-			ImGui::SameLine();
-		}
-		// print element index unless it's the last element
-		else if (it != regionInfo.elementCount - 1) {
-			// new line, print the element index for the next line
-			ImGui::Text("[%04x]", (u32)(it + 1));
-			ImGui::SameLine();
-		}
 	}
+	clipper.End();
 }
 
 // --
@@ -250,8 +282,46 @@ void gui::displayMemoryTexture(
 		ImGui::Separator();
 	}
 	gui::ImageTexture const image = gui::findOrCreateImageTexture(regionInfo);
+	// skip the conversion and upload if the texture already holds this data,
+	//   e.g. while paused. Keyed by texture since regions of the same size
+	//   share one
+	struct TextureContents {
+		std::vector<u8> data;
+		std::vector<u8> cmpData;
+		bool compareMode;
+	};
+	static std::unordered_map<u32, TextureContents> textureContentsMap;
+	bool isTextureCurrent = false;
+	{
+		auto & contents = textureContentsMap[image.texture.id];
+		size_t const byteCount = (
+			snort_dtByteCount(regionInfo.dataType) * regionInfo.elementCount
+		);
+		bool const useCmp = imageInfo.compareMode && optRegionDataCmp != nullptr;
+		isTextureCurrent = (
+			   contents.data.size() == byteCount
+			&& memcmp(contents.data.data(), regionData, byteCount) == 0
+			&& contents.compareMode == useCmp
+			&& (
+				!useCmp
+				|| memcmp(contents.cmpData.data(), optRegionDataCmp, byteCount) == 0
+			)
+		);
+		if (!isTextureCurrent) {
+			contents.data.assign(regionData, regionData + byteCount);
+			contents.compareMode = useCmp;
+			if (useCmp) {
+				contents.cmpData.assign(
+					optRegionDataCmp, optRegionDataCmp + byteCount
+				);
+			}
+		}
+	}
 	// display as texture, but first update the image data
-	if (regionInfo.dataType == kSnortDt_r1) {
+	if (isTextureCurrent) {
+		// already uploaded
+	}
+	else if (regionInfo.dataType == kSnortDt_r1) {
 		// binary image
 		for (int y = 0; y < image.image.height; ++ y)
 		for (int x = 0; x < image.image.width; ++ x) {
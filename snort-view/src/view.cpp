@@ -20,6 +20,17 @@ static ReplayFile sOpenReplayCmp { .file = {.handle = 0} };
 static bool sIsComparisonFlip { false };
 static size_t sReplayInstructionIndex { 0 };
 
+// memory of every region at an instruction, only rebuilt once the replay or
+//   the instruction changes
+struct ReplayState {
+	u64 handle { 0 };
+	size_t instructionIndex { 0 };
+	std::vector<std::vector<uint8_t>> regionData;
+};
+
+static ReplayState sReplayState;
+static ReplayState sReplayStateCmp;
+
 
 // -----------------------------------------------------------------------------
 
@@ -27,11 +38,25 @@ void openReplayFile(ReplayFile & rf, std::string const & filepath) {
 	if (rf.file.handle != 0) {
 		SnortFs::replay_close(rf.file);
 	}
-	SnortFs::ReplayFile file = SnortFs::replay_open(filepath.c_str());
+	// handles can be reused, so drop any memory built from the old file
+	sReplayState = {};
+	sReplayStateCmp = {};
+	SnortFs::ReplayFile file = (
+		SnortFs::replay_open(filepath.c_str(), SnortFs::kReplayOpenMode_map)
+	);
 	if (file.handle == 0) {
 		printf("failed to open replay file %s\n", filepath.c_str());
 		return;
 	}
+	if (SnortFs::replay_isHashOnly(file)) {
+		printf(
+			"replay file %s is hash-only, there's nothing to view, compare it "
+			"with snort-compare\n",
+			filepath.c_str()
+		);
+		SnortFs::replay_close(file);
+		return;
+	}
 	rf = {
 		.filepath = filepath,
 		.file = file,
@@ -84,37 +109,34 @@ bool verifyReplayFilesCompatible(
 	return true;
 }
 
-std::vector<std::vector<uint8_t>>
-regionBuildUpToInstructionIndex(
+void regionBuildUpToInstructionIndex(
+	ReplayState & state,
 	ReplayFile const & replay,
 	size_t instructionIndex
 )
 {
-	std::vector<std::vector<uint8_t>> regionData(
-		SnortFs::replay_regionCount(replay.file)
-	);
-	for (size_t regIt = 0; regIt < regionData.size(); ++regIt) {
+	if (
+		   state.handle == replay.file.handle
+		&& state.instructionIndex == instructionIndex
+	) {
+		return;
+	}
+	state.handle = replay.file.handle;
+	state.instructionIndex = instructionIndex;
+	state.regionData.resize(SnortFs::replay_regionCount(replay.file));
+	std::vector<uint8_t *> regionDataPtr(state.regionData.size());
+	for (size_t regIt = 0; regIt < state.regionData.size(); ++regIt) {
 		auto const & regionInfo = SnortFs::replay_regionInfo(replay.file)[regIt];
-		regionData[regIt].resize(
+		state.regionData[regIt].resize(
 			regionInfo.elementCount * snort_dtByteCount(regionInfo.dataType)
 		);
-		// for each instruction apply the diffs to the current region
-		for (size_t instrIt = 0; instrIt <= sReplayInstructionIndex; ++instrIt) {
-			auto const diffCount = (
-				SnortFs::replay_instructionDiffCount(replay.file, instrIt, regIt)
-			);
-			auto const & diffs = (
-				SnortFs::replay_instructionDiff(replay.file, instrIt, regIt)
-			);
-			for (size_t diffIt = 0; diffIt < diffCount; ++diffIt) {
-				auto const & diff = diffs[diffIt];
-				for (size_t byteIt = 0; byteIt < diff.byteCount; ++byteIt) {
-					regionData[regIt][diff.byteOffset + byteIt] = diff.data[byteIt];
-				}
-			}
-		}
+		regionDataPtr[regIt] = state.regionData[regIt].data();
 	}
-	return regionData;
+	// starts from the closest keyframe, so this is bounded by the keyframe
+	//   interval rather than the instruction index
+	SnortFs::replay_materializeState(
+		replay.file, instructionIndex, regionDataPtr.data()
+	);
 }
 
 // -----------------------------------------------------------------------------
@@ -122,6 +144,11 @@ regionBuildUpToInstructionIndex(
 void displayReplayFile(ReplayFile const & replay, ReplayFile & replayCmp) {
 	// -- display replay file info
 	ImGui::Begin("replay file info");
+	ImGui::Text(
+		"format version: %zu%s",
+		(size_t)SnortFs::replay_version(replay.file),
+		SnortFs::replay_hasIndex(replay.file) ? " (indexed)" : ""
+	);
 	ImGui::Text(
 		"instruction offset: %zu",
 		(size_t)SnortFs::replay_instructionOffset(replay.file)
@@ -134,6 +161,17 @@ void displayReplayFile(ReplayFile const & replay, ReplayFile & replayCmp) {
 		"region count: %zu",
 		(size_t)SnortFs::replay_regionCount(replay.file)
 	);
+	ImGui::Text(
+		"keyframe count: %zu",
+		(size_t)SnortFs::replay_keyframeCount(replay.file)
+	);
+	if (u64 rngSeed; SnortFs::replay_rngSeed(replay.file, rngSeed)) {
+		ImGui::Text("rng seed: %zu", (size_t)rngSeed);
+	}
+	ImGui::Text(
+		"block codec: %s",
+		SnortFs::replayCodec_name(SnortFs::replay_codec(replay.file))
+	);
 	ImGui::End();
 
 	// -- display memory regions
@@ -153,6 +191,14 @@ void displayReplayFile(ReplayFile const & replay, ReplayFile & replayCmp) {
 	if (ImGui::Button(">") && sReplayInstructionIndex+1 < instrCount) {
 		++ sReplayInstructionIndex;
 	}
+	if (SnortFs::replay_hasInputs(replay.file)) {
+		ImGui::Text(
+			"input state: 0x%zx",
+			(size_t)SnortFs::replay_inputState(
+				replay.file, sReplayInstructionIndex
+			)
+		);
+	}
 
 	// validate all memory
 	static size_t invalidFrame = ~0u;
@@ -217,16 +263,20 @@ void displayReplayFile(ReplayFile const & replay, ReplayFile & replayCmp) {
 	}
 	ImGui::End();
 
-	// TODO this can be optimized
 	// build up the current memory region data by applying diffs
-	std::vector<std::vector<uint8_t>> const regionData = (
-		regionBuildUpToInstructionIndex(replay, sReplayInstructionIndex)
-	);
-	std::vector<std::vector<uint8_t>> const regionDataCmp = (
-		replayCmp.file.handle != 0
-		? regionBuildUpToInstructionIndex(replayCmp, sReplayInstructionIndex)
-		: std::vector<std::vector<uint8_t>>{}
+	regionBuildUpToInstructionIndex(
+		sReplayState, replay, sReplayInstructionIndex
 	);
+	if (replayCmp.file.handle != 0) {
+		regionBuildUpToInstructionIndex(
+			sReplayStateCmp, replayCmp, sReplayInstructionIndex
+		);
+	}
+	else {
+		sReplayStateCmp = {};
+	}
+	auto const & regionData = sReplayState.regionData;
+	auto const & regionDataCmp = sReplayStateCmp.regionData;
 
 	// transform into array of pointers
 	std::vector<u8 const *> regionDataPtr(regionData.size());
@@ -259,6 +309,9 @@ void displayReplayFile(ReplayFile const & replay, ReplayFile & replayCmp) {
 int32_t main(int32_t const argc, char const * const argv[]) {
 	snort_displayInitialize();
 	ImGui::GetIO().IniFilename = "imgui-view.ini";
+	// the viewer only changes on input, so there's no need to redraw between
+	//   events
+	snort_displaySetIdle(true);
 
 	if (argc > 1) {
 		openReplayFile(sOpenReplay, argv[1]);
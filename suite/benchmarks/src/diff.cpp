@@ -0,0 +1,118 @@
+#include <snort-replay/diff.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// times the diff kernels against the byte at a time scan they replaced, on a
+//   region the size of chip8's memory at a few change densities
+
+namespace {
+
+constexpr size_t kRegionByteCount { 4096u };
+constexpr size_t kIterationCount { 20000u };
+
+// the scan storeFrameDelta used before the kernels, kept as the baseline
+void bytewiseFindSpans(
+	uint8_t const * const data,
+	uint8_t const * const reference,
+	size_t const byteCount,
+	std::vector<SnortFs::MemoryRegionDiffRecord> & records
+) {
+	size_t startByteDiff = -1u;
+	for (size_t byteIt = 0; byteIt < byteCount; ++ byteIt) {
+		bool const isDiff = (data[byteIt] != reference[byteIt]);
+		bool const hasStartedDiff = (startByteDiff != -1u);
+		if (!isDiff && !hasStartedDiff) {
+			continue;
+		}
+		else if (!isDiff && hasStartedDiff) {
+			records.emplace_back(SnortFs::MemoryRegionDiffRecord {
+				.byteOffset = startByteDiff,
+				.byteCount = byteIt - startByteDiff,
+				.data = data + startByteDiff,
+			});
+			startByteDiff = -1u;
+		}
+		else if (isDiff && !hasStartedDiff) {
+			startByteDiff = byteIt;
+		}
+	}
+	if (startByteDiff != -1u) {
+		records.emplace_back(SnortFs::MemoryRegionDiffRecord {
+			.byteOffset = startByteDiff,
+			.byteCount = byteCount - startByteDiff,
+			.data = data + startByteDiff,
+		});
+	}
+}
+
+template <typename Fn>
+double nanosecondsPerCall(Fn && fn) {
+	auto const start = std::chrono::steady_clock::now();
+	for (size_t it = 0; it < kIterationCount; ++ it) {
+		fn();
+	}
+	auto const duration = std::chrono::steady_clock::now() - start;
+	return (
+		  (double)std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()
+		/ (double)kIterationCount
+	);
+}
+
+} // namespace
+
+int32_t main() {
+	std::vector<uint8_t> reference(kRegionByteCount);
+	std::vector<uint8_t> data(kRegionByteCount);
+	std::vector<SnortFs::MemoryRegionDiffRecord> records;
+	records.reserve(kRegionByteCount);
+	uint64_t state = 0x9E3779B97F4A7C15ull;
+	auto const random = [&state]() {
+		state ^= state << 13u; state ^= state >> 7u; state ^= state << 17u;
+		return state;
+	};
+
+	printf("best kernel: %s\n", SnortFs::diffKernel_name(SnortFs::kDiffKernel_best));
+	printf("%-10s %10s %10s %10s %10s\n", "changed", "bytewise", "scalar", "sse2", "avx2");
+	// fraction of bytes changed, in parts per million
+	for (uint64_t const density : { 0u, 500u, 2000u, 10000u, 100000u, 500000u }) {
+		for (size_t it = 0; it < kRegionByteCount; ++ it) {
+			reference[it] = (uint8_t)random();
+			data[it] = (
+				random() % 1000000u < density ? (uint8_t)(reference[it] + 1u)
+				: reference[it]
+			);
+		}
+		size_t checkCount = 0u;
+		double const bytewise = nanosecondsPerCall([&]() {
+			records.clear();
+			::bytewiseFindSpans(data.data(), reference.data(), kRegionByteCount, records);
+			checkCount += records.size();
+		});
+		printf("%9.2f%% %8.0fns", (double)density / 1e4, bytewise);
+		for (
+			SnortFs::DiffKernel const kernel : {
+				SnortFs::kDiffKernel_scalar,
+				SnortFs::kDiffKernel_sse2,
+				SnortFs::kDiffKernel_avx2,
+			}
+		) {
+			if (!SnortFs::diffKernel_isSupported(kernel)) {
+				printf(" %10s", "-");
+				continue;
+			}
+			double const kernelTime = nanosecondsPerCall([&]() {
+				records.clear();
+				SnortFs::diff_findSpans(
+					data.data(), reference.data(), kRegionByteCount, records, kernel
+				);
+				checkCount += records.size();
+			});
+			printf(" %7.0fns %4.1fx", kernelTime, bytewise / kernelTime);
+		}
+		// keeps the span counts observable so the loops aren't optimized out
+		printf("  (%zu spans)\n", checkCount / (kIterationCount * 4u));
+	}
+	return 0;
+}
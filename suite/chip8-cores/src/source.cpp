@@ -0,0 +1,214 @@
+#include "device.hpp"
+#include "chip8.h"
+
+#include <snort-harness/snort-harness.h>
+#include <snort/snort.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// hosts chip8 cores side by side and runs them through snort_runCores, e.g.
+//   chip8-cores rom.ch8 --cores snort-chip8,griffin
+//     --target-instruction-count 1000000
+// Every other argument goes to the cores' devices, e.g. --rng-seed,
+//   --input-replay, --restore-replay or --flight-recorder
+
+namespace {
+
+// -- adapters, one per emulator. Each owns its emulator and lists its memory
+//    in the chip8 common interface's region order
+
+struct Core {
+	virtual ~Core() = default;
+	SnortDevice device { 0 };
+	std::vector<SnortMemoryRegion> memoryRegions {};
+	SnortStepFn step { nullptr };
+	void * userData { nullptr };
+
+	// the regions are also where states are restored into, which applies
+	//   --restore-replay
+	void setWritableRegions() {
+		std::vector<SnortWritableMemoryRegion> writableRegions;
+		for (auto const & region : memoryRegions) {
+			writableRegions.push_back({ (u8 *)region.data });
+		}
+		snort_setWritableRegions(device, writableRegions.data());
+	}
+};
+
+struct SnortChip8Core : Core {
+	Device chip8 {};
+
+	SnortChip8Core(char const * const romPath, SnortDevice const snortDevice) {
+		device = snortDevice;
+		chip8 = device_initialize(romPath, snortDevice);
+		memoryRegions = {
+			{ chip8.memory },
+			{ (u8 *)chip8.stack },
+			{ chip8.registers },
+			{ (u8 *)&chip8.registerIndex },
+			{ (u8 *)&chip8.programCounter },
+			{ (u8 *)&chip8.stackPointer },
+			{ chip8.display },
+		};
+		step = [](void * userData) {
+			device_cpuStep(((SnortChip8Core *)userData)->chip8);
+		};
+		userData = this;
+		setWritableRegions();
+	}
+	~SnortChip8Core() override { device_destroy(chip8); }
+};
+
+struct GriffinCore : Core {
+	Chip8 chip8 {};
+
+	GriffinCore(char const * const romPath, SnortDevice const snortDevice) {
+		device = snortDevice;
+		chip8.load(romPath);
+		// its stack pointer is 16 bits, the region is its low byte
+		memoryRegions = {
+			{ chip8.memory },
+			{ (u8 *)chip8.stack },
+			{ chip8.V },
+			{ (u8 *)&chip8.I },
+			{ (u8 *)&chip8.pc },
+			{ (u8 *)&chip8.sp },
+			{ chip8.gfx },
+		};
+		step = [](void * userData) {
+			GriffinCore & core = *(GriffinCore *)userData;
+			// the keypad comes from the harness
+			u64 const keys = snort_inputState(core.device);
+			for (int it = 0; it < 16; ++ it) {
+				core.chip8.key[it] = (keys >> it) & 1u;
+			}
+			u16 const opcode = (
+				(u16)(core.chip8.memory[core.chip8.pc] << 8u)
+				| core.chip8.memory[core.chip8.pc + 1u]
+			);
+			core.chip8.emulate_cycle();
+			// CXNN draws from rand(), seeded with the time. The register is
+			//   redrawn from the harness rng the way snort-chip8 draws it, so
+			//   the cores agree
+			if ((opcode & 0xF000u) == 0xC000u) {
+				u8 const randByte = (u8)(snort_rngU64(core.device) & 0xFFu);
+				u8 const reg = (u8)((opcode & 0x0F00u) >> 8u);
+				core.chip8.V[reg] = randByte & (u8)(opcode & 0xFFu);
+			}
+		};
+		userData = this;
+		setWritableRegions();
+	}
+};
+
+// --
+
+std::unique_ptr<Core> createCore(
+	std::string const & name,
+	std::string const & label,
+	char const * const romPath,
+	i32 const argc,
+	char const * const * const argv
+) {
+	SnortDevice const device = (
+		snort_coreDeviceCreateFromCommon(
+			kSnortCommonInterface_chip8, label.c_str(), romPath, argc, argv
+		)
+	);
+	if (name == "snort-chip8") {
+		return std::make_unique<SnortChip8Core>(romPath, device);
+	}
+	if (name == "griffin") {
+		return std::make_unique<GriffinCore>(romPath, device);
+	}
+	printf("unknown core '%s', expected snort-chip8 or griffin\n", name.c_str());
+	SnortDevice destroyed = device;
+	snort_deviceDestroy(&destroyed);
+	return nullptr;
+}
+
+} // namespace
+
+int32_t main(int32_t const argc, char const * const argv[]) {
+	if (argc < 2) {
+		printf("usage: %s <rom path> [--cores snort-chip8,griffin]\n", argv[0]);
+		return 1;
+	}
+	char const * const romPath = argv[1];
+	std::string coreNames = "snort-chip8,griffin";
+	for (int32_t it = 2; it + 1 < argc; ++ it) {
+		if (strcmp(argv[it], "--cores") == 0) {
+			coreNames = argv[it + 1];
+		}
+	}
+
+	std::vector<std::string> names;
+	for (size_t start = 0; start <= coreNames.size(); ) {
+		size_t end = coreNames.find(',', start);
+		if (end == std::string::npos) { end = coreNames.size(); }
+		names.emplace_back(coreNames.substr(start, end - start));
+		start = end + 1u;
+	}
+
+	// -- a core that's listed twice gets its index in its label, so their
+	//    flight recorder dumps don't overwrite each other
+	std::vector<std::unique_ptr<Core>> cores;
+	for (size_t it = 0; it < names.size(); ++ it) {
+		std::string label = names[it];
+		if (std::count(names.begin(), names.end(), names[it]) > 1) {
+			label += "-" + std::to_string(it);
+		}
+		cores.emplace_back(::createCore(names[it], label, romPath, argc, argv));
+		if (cores.back() == nullptr) {
+			cores.pop_back();
+			break;
+		}
+	}
+	if (cores.size() != names.size()) {
+		for (auto & core : cores) {
+			SnortDevice device = core->device;
+			core.reset();
+			snort_deviceDestroy(&device);
+		}
+		return 1;
+	}
+
+	std::vector<SnortCore> snortCores;
+	for (auto const & core : cores) {
+		snortCores.emplace_back(SnortCore {
+			.device = core->device,
+			.memoryRegions = core->memoryRegions.data(),
+			.step = core->step,
+			.userData = core->userData,
+		});
+	}
+
+	auto const start = std::chrono::steady_clock::now();
+	SnortCoreRunResult const result = (
+		snort_runCores(snortCores.data(), snortCores.size())
+	);
+	f64 const seconds = std::chrono::duration<f64>(
+		std::chrono::steady_clock::now() - start
+	).count();
+	printf(
+		"->%s: %s after %zu instructions on %zu cores, %.2f M instructions/s\n",
+		romPath,
+		result.isDiverged ? "FAIL" : "PASS",
+		(size_t)result.instructionCount,
+		cores.size(),
+		seconds > 0.0 ? (f64)result.instructionCount / seconds / 1e6 : 0.0
+	);
+
+	for (auto & core : cores) {
+		SnortDevice device = core->device;
+		core.reset();
+		snort_deviceDestroy(&device);
+	}
+	return result.isDiverged ? 1 : 0;
+}
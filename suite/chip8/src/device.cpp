@@ -6,13 +6,42 @@
 
 // -----------------------------------------------------------------------------
 
+// every write to a registered region is reported, so the harness only diffs
+//   the bytes that could have changed
+static void markDirty(
+	Device & device,
+	DeviceRegion const region,
+	u64 const byteOffset,
+	u64 const byteCount
+) {
+	snort_markDirty(device.snortDevice, region, byteOffset, byteCount);
+}
+
+static void markRegister(Device & device, u8 const reg) {
+	markDirty(device, kDeviceRegion_registers, reg, 1u);
+}
+
+// the keypad comes from the harness, so recordings can replay it
+static bool isKeyPressed(Device & device, u8 const key) {
+	return ((snort_inputState(device.snortDevice) >> (key & 0xFu)) & 1u) != 0u;
+}
+
+// -----------------------------------------------------------------------------
+
 namespace instr {
 	u16 iClear(Device & device) {
 		memset(device.display, 0, sizeof(device.display));
+		markDirty(device, kDeviceRegion_display, 0u, sizeof(device.display));
 		return 2u;
 	}
 	u16 iReturn(Device & device) {
+		// skipped rather than reading outside of the stack
+		if (device.stackPointer == 0u) {
+			snort_flightRecorderTrigger(device.snortDevice, "stack underflow");
+			return 2u;
+		}
 		device.programCounter = device.stack[--device.stackPointer];
+		markDirty(device, kDeviceRegion_stackPointer, 0u, 1u);
 		return 2u;
 	}
 	u16 iJump(Device & device, u16 const address) {
@@ -20,8 +49,18 @@ namespace instr {
 		return 0u;
 	}
 	u16 iCall(Device & device, u16 const address) {
+		// skipped rather than writing past the stack into the registers
+		if (device.stackPointer >= sizeof(device.stack) / sizeof(u16)) {
+			snort_flightRecorderTrigger(device.snortDevice, "stack overflow");
+			return 2u;
+		}
 		device.stack[device.stackPointer] = device.programCounter;
+		markDirty(
+			device, kDeviceRegion_stack, device.stackPointer * sizeof(u16),
+			sizeof(u16)
+		);
 		++device.stackPointer;
+		markDirty(device, kDeviceRegion_stackPointer, 0u, 1u);
 		device.programCounter = address;
 		return 0u;
 	}
@@ -45,26 +84,32 @@ namespace instr {
 	}
 	u16 iRegLoadNN(Device & device, u8 const reg, u8 const value) {
 		device.registers[reg] = value;
+		markRegister(device, reg);
 		return 2u;
 	}
 	u16 iRegAddNN(Device & device, u8 const reg, u8 const value) {
 		device.registers[reg] += value;
+		markRegister(device, reg);
 		return 2u;
 	}
 	u16 iRegLoadReg(Device & device, u8 const regX, u8 const regY) {
 		device.registers[regX] = device.registers[regY];
+		markRegister(device, regX);
 		return 2u;
 	}
 	u16 iRegOrReg(Device & device, u8 const regX, u8 const regY) {
 		device.registers[regX] |= device.registers[regY];
+		markRegister(device, regX);
 		return 2u;
 	}
 	u16 iRegAndReg(Device & device, u8 const regX, u8 const regY) {
 		device.registers[regX] &= device.registers[regY];
+		markRegister(device, regX);
 		return 2u;
 	}
 	u16 iRegXorReg(Device & device, u8 const regX, u8 const regY) {
 		device.registers[regX] ^= device.registers[regY];
+		markRegister(device, regX);
 		return 2u;
 	}
 	u16 iRegAddRegWithCarry(Device & device, u8 const regX, u8 const regY) {
@@ -72,24 +117,32 @@ namespace instr {
 		u16 const reg1 = (u16)(device.registers[regY]);
 		u16 const sum = reg0 + reg1;
 		device.registers[0xFu] = (sum > 0xFFu) ? 1u : 0u;
+		markRegister(device, 0xFu);
 		device.registers[regX] = (u8)(sum & 0xFFu);
+		markRegister(device, regX);
 		return 2u;
 	}
 	u16 iRegSubRegWithBorrow(Device & device, u8 const regX, u8 const regY) {
 		u8 const reg0 = device.registers[regX];
 		u8 const reg1 = device.registers[regY];
 		device.registers[0xFu] = (reg0 > reg1) ? 1u : 0u;
+		markRegister(device, 0xFu);
 		device.registers[regX] = reg0 - reg1;
+		markRegister(device, regX);
 		return 2u;
 	}
 	u16 iRegShiftLeft(Device & device, u8 const reg) {
 		device.registers[0xFu] = (device.registers[reg] & 0x80u) >> 7u;
+		markRegister(device, 0xFu);
 		device.registers[reg] <<= 1u;
+		markRegister(device, reg);
 		return 2u;
 	}
 	u16 iRegShiftRight(Device & device, u8 const reg) {
 		device.registers[0xFu] = device.registers[reg] & 0x1u;
+		markRegister(device, 0xFu);
 		device.registers[reg] >>= 1u;
+		markRegister(device, reg);
 		return 2u;
 	}
 	u16 ifRegEqReg(Device & device, u8 const regX, u8 const regY) {
@@ -100,6 +153,7 @@ namespace instr {
 	}
 	u16 iIndexLoad(Device & device, u16 const address) {
 		device.registerIndex = address;
+		markDirty(device, kDeviceRegion_registerIndex, 0u, sizeof(u16));
 		return 2u;
 	}
 	u16 iJumpWithRegOffset(Device & device, u16 const address) {
@@ -110,6 +164,7 @@ namespace instr {
 		u64 const rand = snort_rngU64(device.snortDevice);
 		u8 const randByte = (u8)(rand & 0xFFu);
 		device.registers[reg] = randByte & value;
+		markRegister(device, reg);
 		return 2u;
 	}
 	u16 iDrawSprite(
@@ -119,6 +174,7 @@ namespace instr {
 		u8 const offsetY = device.registers[regY];
 		// reset collision flag
 		device.registers[0xFu] = 0u;
+		markRegister(device, 0xFu);
 		for (u16 it = 0u; it < height*8u; ++ it) {
 			u16 const col = it % 8u;
 			u16 const row = it / 8u;
@@ -136,15 +192,32 @@ namespace instr {
 			}
 			// xor pixel
 			device.display[displayIndex] ^= 1u;
+			markDirty(device, kDeviceRegion_display, displayIndex, 1u);
 		}
 		return 2u;
 	}
 	u16 iSkipIfKeyPressed(Device & device, u8 const reg) {
-		// TODO
+		if (isKeyPressed(device, device.registers[reg])) {
+			return 4u;
+		}
 		return 2u;
 	}
 	u16 iSkipIfKeyNotPressed(Device & device, u8 const reg) {
-		// TODO
+		if (!isKeyPressed(device, device.registers[reg])) {
+			return 4u;
+		}
+		return 2u;
+	}
+	u16 iWaitForKey(Device & device, u8 const reg) {
+		// runs the instruction again until a key is held
+		u64 const keys = snort_inputState(device.snortDevice) & 0xFFFFu;
+		if (keys == 0u) {
+			return 0u;
+		}
+		u8 key = 0u;
+		while ((keys & (1u << key)) == 0u) { ++ key; }
+		device.registers[reg] = key;
+		markRegister(device, reg);
 		return 2u;
 	}
 	u16 iSoundDelayTimerLoad(Device & device, u8 const reg) {
@@ -157,6 +230,7 @@ namespace instr {
 	}
 	u16 iIndexAddReg(Device & device, u8 const reg) {
 		device.registerIndex += device.registers[reg];
+		markDirty(device, kDeviceRegion_registerIndex, 0u, sizeof(u16));
 		return 2u;
 	}
 	u16 iIndexLoadSpriteAddr(Device & device, u8 const reg) {
@@ -168,14 +242,17 @@ namespace instr {
 		device.memory[device.registerIndex + 0u] = value / 100u;
 		device.memory[device.registerIndex + 1u] = (value / 10u) % 10u;
 		device.memory[device.registerIndex + 2u] = value % 10u;
+		markDirty(device, kDeviceRegion_memory, device.registerIndex, 3u);
 		return 2u;
 	}
 	u16 iLoadMemoryFromRegs(Device & device, u8 const reg) {
 		for (u16 it = 0u; it <= reg; ++it) {
 			device.memory[device.registerIndex + it] = device.registers[it];
 		}
+		markDirty(device, kDeviceRegion_memory, device.registerIndex, reg + 1u);
 		if constexpr (SnortChip8Config::indexIncrementsOnRegLoadReg) {
 			device.registerIndex += reg + 1u;
+			markDirty(device, kDeviceRegion_registerIndex, 0u, sizeof(u16));
 		}
 		return 2u;
 	}
@@ -183,8 +260,10 @@ namespace instr {
 		for (u16 it = 0u; it <= reg; ++it) {
 			device.registers[it] = device.memory[device.registerIndex + it];
 		}
+		markDirty(device, kDeviceRegion_registers, 0u, reg + 1u);
 		if constexpr (SnortChip8Config::indexIncrementsOnRegLoadReg) {
 			device.registerIndex += reg + 1u;
+			markDirty(device, kDeviceRegion_registerIndex, 0u, sizeof(u16));
 		}
 		return 2u;
 	}
@@ -214,6 +293,7 @@ Device device_initialize(
 	Device device {};
 	memset(device.memory, 0, sizeof(device.memory));
 	device.snortDevice = snortDevice;
+	snort_enableDirtyTracking(snortDevice);
 	device.programCounter = 0x200u;
 
 	// set the initial font data
@@ -345,6 +425,9 @@ static u8 device_processInstr(Device & device){
 			if (msb2 == 0x0u && msb3 == 0x7u) { // 07
 				return instr::iSoundDelayTimerLoad(device, msb1);
 			}
+			if (msb2 == 0x0u && msb3 == 0xAu) { // 0A
+				return instr::iWaitForKey(device, msb1);
+			}
 			if (msb2 == 0x1u && msb3 == 0x5u) { // 15
 				return instr::iSoundDelayTimerStore(device, msb1);
 			}
@@ -372,4 +455,5 @@ static u8 device_processInstr(Device & device){
 
 void device_cpuStep(Device & device) {
 	device.programCounter += device_processInstr(device);
+	markDirty(device, kDeviceRegion_programCounter, 0u, sizeof(u16));
 }
@@ -13,6 +13,18 @@ namespace SnortChip8Config {
 	constexpr bool indexIncrementsOnRegLoadReg { true };
 }
 
+// indices of the memory regions registered with the harness, in the order
+//   source.cpp lists them
+enum DeviceRegion : u64 {
+	kDeviceRegion_memory,
+	kDeviceRegion_stack,
+	kDeviceRegion_registers,
+	kDeviceRegion_registerIndex,
+	kDeviceRegion_programCounter,
+	kDeviceRegion_stackPointer,
+	kDeviceRegion_display,
+};
+
 struct Device {
 	u8 memory[4096u];
 	u16 stack[16u];
@@ -25,7 +25,9 @@ int32_t main(int32_t const argc, char const * const argv[]) {
 			argv
 		)
 	);
-	ImGui::GetIO().IniFilename = "imgui-chip8.ini";
+	if (!snort_isHeadless(snortDevice)) {
+		ImGui::GetIO().IniFilename = "imgui-chip8.ini";
+	}
 
 	Device device = device_initialize(argv[1], snortDevice);
 
@@ -40,18 +42,25 @@ int32_t main(int32_t const argc, char const * const argv[]) {
 		{ device.display },
 	};
 
-	while (!snort_shouldQuit(snortDevice)) {
-		u64 const framesToRun = (
-			snort_startFrame(snortDevice, memoryRegions.data())
-		);
-
-		for (u64 it = 0; it < framesToRun; ++ it) {
-			snort_updateFrame(snortDevice, memoryRegions.data());
-			device_cpuStep(device);
-		}
+	// so states can be restored into the device, e.g. --restore-replay
+	auto const writableRegions = std::vector<SnortWritableMemoryRegion> {
+		{ device.memory },
+		{ (u8 *)device.stack },
+		{ device.registers },
+		{ (u8 *)&device.registerIndex },
+		{ (u8 *)&device.programCounter },
+		{ (u8 *)&device.stackPointer },
+		{ device.display },
+	};
+	snort_setWritableRegions(snortDevice, writableRegions.data());
 
-		snort_endFrame(snortDevice);
-	}
+	// emulates on the harness' thread, the window only shows snapshots
+	snort_run(
+		snortDevice,
+		memoryRegions.data(),
+		[](void * userData) { device_cpuStep(*(Device *)userData); },
+		&device
+	);
 
 	device_destroy(device);
 	snort_deviceDestroy(&snortDevice);
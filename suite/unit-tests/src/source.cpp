@@ -1,10 +1,15 @@
 #include <snort/snort.h>
 
 #include <snort-harness/snort-harness.h>
+#include <snort-replay/diff.hpp>
 #include <snort-replay/fs.hpp>
+#include <snort-replay/lockstep.hpp>
+#include <snort-replay/validation.hpp>
 
 #include "imgui.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <string>
 #include <vector>
@@ -86,38 +91,38 @@ void replayTest1() {
 	Assert(regionInfo1.elementDisplayRowStride == 1u);
 	Assert(std::string(regionInfo1.label) == "region-ram");
 	{
-		SnortFs::MemoryRegionDiff * diffs = SnortFs::replay_instructionDiff(replayFile, 0, 0);
+		SnortFs::MemoryRegionDiff const * diffs = SnortFs::replay_instructionDiff(replayFile, 0, 0);
 		Assert(diffs[0].byteOffset == 0);
 		Assert(diffs[0].byteCount == 4);
 		Assert(memcmp(diffs[0].data, "test", 4) == 0);
 	}
 	{
-		SnortFs::MemoryRegionDiff * diffs = SnortFs::replay_instructionDiff(replayFile, 0, 1);
+		SnortFs::MemoryRegionDiff const * diffs = SnortFs::replay_instructionDiff(replayFile, 0, 1);
 		Assert(diffs[0].byteOffset == 4);
 		Assert(diffs[0].byteCount == 4);
 		Assert(memcmp(diffs[0].data, "data", 4) == 0);
 	}
 
 	{
-		SnortFs::MemoryRegionDiff * diffs = SnortFs::replay_instructionDiff(replayFile, 1, 0);
+		SnortFs::MemoryRegionDiff const * diffs = SnortFs::replay_instructionDiff(replayFile, 1, 0);
 		Assert(diffs[0].byteOffset == 2);
 		Assert(diffs[0].byteCount == 2);
 		Assert(memcmp(diffs[0].data, "he", 2) == 0);
 	}
 	{
-		SnortFs::MemoryRegionDiff * diffs = SnortFs::replay_instructionDiff(replayFile, 1, 1);
+		SnortFs::MemoryRegionDiff const * diffs = SnortFs::replay_instructionDiff(replayFile, 1, 1);
 		Assert(diffs[0].byteOffset == 2);
 		Assert(diffs[0].byteCount == 2);
 		Assert(memcmp(diffs[0].data, "lo", 2) == 0);
 	}
 	{
-		SnortFs::MemoryRegionDiff * diffs = SnortFs::replay_instructionDiff(replayFile, 2, 0);
+		SnortFs::MemoryRegionDiff const * diffs = SnortFs::replay_instructionDiff(replayFile, 2, 0);
 		Assert(diffs[0].byteOffset == 0);
 		Assert(diffs[0].byteCount == 2);
 		Assert(memcmp(diffs[0].data, "wo", 2) == 0);
 	}
 	{
-		SnortFs::MemoryRegionDiff * diffs = SnortFs::replay_instructionDiff(replayFile, 2, 1);
+		SnortFs::MemoryRegionDiff const * diffs = SnortFs::replay_instructionDiff(replayFile, 2, 1);
 		Assert(diffs[0].byteOffset == 0);
 		Assert(diffs[0].byteCount == 2);
 		Assert(memcmp(diffs[0].data, "rl", 2) == 0);
@@ -184,9 +189,1510 @@ void replayTest2() {
 	Assert(file.handle == 0);
 }
 
+void replayMappedTest() {
+	// records enough instructions to span several lazily-parsed blocks, then
+	//   checks every diff through a memory-mapped reader
+	std::vector<SnortMemoryRegionCreateInfo> regionCreateInfo = {
+		{
+			.dataType = kSnortDt_u8,
+			.elementCount = 16,
+			.elementDisplayRowStride = 4u,
+			.label = "region-memory",
+		},
+		{
+			.dataType = kSnortDt_u16,
+			.elementCount = 1,
+			.elementDisplayRowStride = 1u,
+			.label = "region-pc",
+		},
+	};
+	size_t const instructionCount = 3000u;
+	SnortFs::ReplayFileRecorder file = (
+		SnortFs::replayRecorder_open(
+			"test-replay-mapped.rpl",
+			/*commonInterface=*/ kSnortCommonInterface_custom,
+			/*instructionOffset=*/ 5,
+			/*regionCount=*/ 2,
+			/*regionCreateInfo=*/ regionCreateInfo.data()
+		)
+	);
+	Assert(file.handle != 0);
+	for (size_t it = 0; it < instructionCount; ++ it) {
+		uint8_t const memory[2] = { (uint8_t)it, (uint8_t)(it >> 8) };
+		uint16_t const pc = (uint16_t)(it * 2u);
+		SnortFs::MemoryRegionDiffRecord const memoryDiff = {
+			.byteOffset = it % 15u, .byteCount = 2, .data = memory,
+		};
+		SnortFs::MemoryRegionDiffRecord const pcDiff = {
+			.byteOffset = 0, .byteCount = 2, .data = (uint8_t const *)&pc,
+		};
+		// every third instruction leaves memory untouched
+		SnortFs::replayRecorder_recordInstruction(
+			file, (it % 3u == 0u) ? 0u : 1u, &memoryDiff
+		);
+		SnortFs::replayRecorder_recordInstruction(file, 1, &pcDiff);
+	}
+	SnortFs::replayRecorder_close(file);
+
+	SnortFs::ReplayFile replayFile = (
+		SnortFs::replay_open(
+			"test-replay-mapped.rpl", SnortFs::kReplayOpenMode_map
+		)
+	);
+	Assert(replayFile.handle != 0);
+	Assert(SnortFs::replay_instructionOffset(replayFile) == 5);
+	Assert(SnortFs::replay_instructionCount(replayFile) == instructionCount);
+	Assert(SnortFs::replay_regionCount(replayFile) == 2);
+	// read the back half first, the reader must parse the blocks before it
+	for (size_t pass = 0; pass < 2; ++ pass)
+	for (
+		size_t it = (pass == 0 ? instructionCount/2 : 0);
+		it < instructionCount;
+		++ it
+	) {
+		size_t const memoryDiffCount = (
+			SnortFs::replay_instructionDiffCount(replayFile, it, 0)
+		);
+		Assert(memoryDiffCount == ((it % 3u == 0u) ? 0u : 1u));
+		if (memoryDiffCount == 1u) {
+			auto const * const diffs = (
+				SnortFs::replay_instructionDiff(replayFile, it, 0)
+			);
+			uint8_t const memory[2] = { (uint8_t)it, (uint8_t)(it >> 8) };
+			Assert(diffs[0].byteOffset == it % 15u);
+			Assert(diffs[0].byteCount == 2);
+			Assert(memcmp(diffs[0].data, memory, 2) == 0);
+		}
+		Assert(SnortFs::replay_instructionDiffCount(replayFile, it, 1) == 1);
+		auto const * const pcDiffs = (
+			SnortFs::replay_instructionDiff(replayFile, it, 1)
+		);
+		uint16_t const pc = (uint16_t)(it * 2u);
+		Assert(pcDiffs[0].byteCount == 2);
+		Assert(memcmp(pcDiffs[0].data, &pc, 2) == 0);
+	}
+	SnortFs::replay_close(replayFile);
+	Assert(replayFile.handle == 0);
+}
+
+void replayVersion1Test() {
+	// version 1 files are no longer written, but must still be readable
+	FILE * const filePtr = fopen("test-replay-v1.rpl", "wb");
+	Assert(filePtr != nullptr);
+	auto const writeU64 = [&](uint64_t const value) {
+		fwrite(&value, 8, 1, filePtr);
+	};
+	fwrite("SNORTRPL", 1, 8, filePtr);
+	writeU64(kSnortCommonInterface_custom);
+	writeU64(/*instructionOffset=*/ 7);
+	writeU64(/*instructionCount=*/ 2);
+	writeU64(/*regionCount=*/ 1);
+	writeU64(kSnortDt_u8);
+	writeU64(/*elementCount=*/ 4);
+	writeU64(/*elementDisplayRowStride=*/ 4);
+	fwrite("region-v1", 1, 10, filePtr);
+	// instruction 0, one diff
+	writeU64(1); writeU64(0); writeU64(4); fwrite("abcd", 1, 4, filePtr);
+	// instruction 1, no diffs
+	writeU64(0);
+	fwrite("SNORTRPL", 1, 8, filePtr);
+	fclose(filePtr);
+
+	SnortFs::ReplayFile replayFile = SnortFs::replay_open("test-replay-v1.rpl");
+	Assert(replayFile.handle != 0);
+	Assert(SnortFs::replay_version(replayFile) == 1);
+	Assert(!SnortFs::replay_hasIndex(replayFile));
+	Assert(SnortFs::replay_instructionOffset(replayFile) == 7);
+	Assert(SnortFs::replay_instructionCount(replayFile) == 2);
+	Assert(std::string(SnortFs::replay_regionInfo(replayFile)[0].label) == "region-v1");
+	Assert(SnortFs::replay_instructionDiffCount(replayFile, 0, 0) == 1);
+	Assert(SnortFs::replay_instructionDiffCount(replayFile, 1, 0) == 0);
+	auto const * const diffs = SnortFs::replay_instructionDiff(replayFile, 0, 0);
+	Assert(diffs[0].byteCount == 4);
+	Assert(memcmp(diffs[0].data, "abcd", 4) == 0);
+	SnortFs::replay_close(replayFile);
+}
+
+void replayFixedWidthTest() {
+	// version 2 files written before diffs were varint encoded use 8-byte
+	//   fields, like version 1, and have no footer
+	FILE * const filePtr = fopen("test-replay-fixed-width.rpl", "wb");
+	Assert(filePtr != nullptr);
+	auto const writeU64 = [&](uint64_t const value) {
+		fwrite(&value, 8, 1, filePtr);
+	};
+	fwrite("SNORTRP2", 1, 8, filePtr);
+	writeU64(/*flags=*/ 0);
+	writeU64(kSnortCommonInterface_custom);
+	writeU64(/*instructionOffset=*/ 3);
+	writeU64(/*instructionCount=*/ 2);
+	writeU64(/*regionCount=*/ 1);
+	writeU64(kSnortDt_u8);
+	writeU64(/*elementCount=*/ 300);
+	writeU64(/*elementDisplayRowStride=*/ 10);
+	fwrite("region-v2", 1, 10, filePtr);
+	// one instruction chunk, with a diff past the first varint byte range
+	writeU64(/*type=*/ 1);
+	writeU64(/*firstInstruction=*/ 0);
+	writeU64(/*instructionCount=*/ 2);
+	writeU64(/*payloadByteCount=*/ 8 + 8 + 8 + 4 + 8);
+	writeU64(1); writeU64(296); writeU64(4); fwrite("wxyz", 1, 4, filePtr);
+	writeU64(0);
+	fwrite("SNORTRP2", 1, 8, filePtr);
+	fclose(filePtr);
+
+	SnortFs::ReplayFile replayFile = (
+		SnortFs::replay_open("test-replay-fixed-width.rpl")
+	);
+	Assert(replayFile.handle != 0);
+	Assert(SnortFs::replay_version(replayFile) == 2);
+	Assert(!SnortFs::replay_hasIndex(replayFile));
+	Assert(SnortFs::replay_instructionCount(replayFile) == 2);
+	Assert(SnortFs::replay_instructionDiffCount(replayFile, 0, 0) == 1);
+	Assert(SnortFs::replay_instructionDiffCount(replayFile, 1, 0) == 0);
+	auto const * const diffs = SnortFs::replay_instructionDiff(replayFile, 0, 0);
+	Assert(diffs[0].byteOffset == 296);
+	Assert(diffs[0].byteCount == 4);
+	Assert(memcmp(diffs[0].data, "wxyz", 4) == 0);
+
+	// -- recording the same instructions varint encodes the fields, and the
+	//    offset takes two bytes
+	SnortMemoryRegionCreateInfo const regionCreateInfo = (
+		SnortFs::replay_regionInfo(replayFile)[0]
+	);
+	SnortFs::ReplayFileRecorder recorder = (
+		SnortFs::replayRecorder_open(
+			"test-replay-varint.rpl",
+			/*commonInterface=*/ kSnortCommonInterface_custom,
+			/*instructionOffset=*/ 3,
+			/*regionCount=*/ 1,
+			/*regionCreateInfo=*/ &regionCreateInfo,
+			{ .keyframes = false }
+		)
+	);
+	SnortFs::MemoryRegionDiffRecord const diff = {
+		.byteOffset = 296, .byteCount = 4, .data = (uint8_t const *)"wxyz",
+	};
+	SnortFs::replayRecorder_recordInstruction(recorder, 1, &diff);
+	SnortFs::replayRecorder_recordInstruction(recorder, 0, nullptr);
+	SnortFs::replayRecorder_close(recorder);
+	SnortFs::replay_close(replayFile);
+
+	replayFile = SnortFs::replay_open("test-replay-varint.rpl");
+	Assert(replayFile.handle != 0);
+	Assert(SnortFs::replay_instructionCount(replayFile) == 2);
+	Assert(SnortFs::replay_instructionDiffCount(replayFile, 0, 0) == 1);
+	Assert(SnortFs::replay_instructionDiffCount(replayFile, 1, 0) == 0);
+	auto const * const varintDiffs = (
+		SnortFs::replay_instructionDiff(replayFile, 0, 0)
+	);
+	Assert(varintDiffs[0].byteOffset == 296);
+	Assert(varintDiffs[0].byteCount == 4);
+	Assert(memcmp(varintDiffs[0].data, "wxyz", 4) == 0);
+	SnortFs::replay_close(replayFile);
+}
+
+void replayIndexTest() {
+	// uses the recording from replayMappedTest, which spans several blocks
+	std::vector<uint8_t> bytes;
+	{
+		FILE * const filePtr = fopen("test-replay-mapped.rpl", "rb");
+		Assert(filePtr != nullptr);
+		fseek(filePtr, 0, SEEK_END);
+		bytes.resize(ftell(filePtr));
+		fseek(filePtr, 0, SEEK_SET);
+		Assert(fread(bytes.data(), 1, bytes.size(), filePtr) == bytes.size());
+		fclose(filePtr);
+	}
+	auto const writeBytes = [](char const * path, uint8_t const * data, size_t n) {
+		FILE * const filePtr = fopen(path, "wb");
+		Assert(filePtr != nullptr);
+		fwrite(data, 1, n, filePtr);
+		fclose(filePtr);
+	};
+	auto const checkInstruction = [](SnortFs::ReplayFile file, size_t it) {
+		Assert(SnortFs::replay_instructionDiffCount(file, it, 1) == 1);
+		uint16_t const pc = (uint16_t)(it * 2u);
+		auto const * const diffs = SnortFs::replay_instructionDiff(file, it, 1);
+		Assert(memcmp(diffs[0].data, &pc, 2) == 0);
+	};
+
+	// -- indexed, random access lands straight on the block
+	{
+		SnortFs::ReplayFile file = SnortFs::replay_open("test-replay-mapped.rpl");
+		Assert(file.handle != 0);
+		Assert(SnortFs::replay_version(file) == 2);
+		Assert(SnortFs::replay_hasIndex(file));
+		checkInstruction(file, 2999);
+		checkInstruction(file, 1024);
+		checkInstruction(file, 0);
+		SnortFs::replay_close(file);
+	}
+
+	// -- footer stripped, the chunk headers are walked instead
+	uint64_t chunkCount;
+	memcpy(&chunkCount, bytes.data() + bytes.size() - 16u, 8);
+	size_t const chunksEnd = bytes.size() - 16u - chunkCount * 48u;
+	{
+		writeBytes("test-replay-no-index.rpl", bytes.data(), chunksEnd);
+		SnortFs::ReplayFile file = SnortFs::replay_open("test-replay-no-index.rpl");
+		Assert(file.handle != 0);
+		Assert(!SnortFs::replay_hasIndex(file));
+		Assert(SnortFs::replay_instructionCount(file) == 3000);
+		checkInstruction(file, 2999);
+		SnortFs::replay_close(file);
+	}
+
+	// -- recording that never closed, keeps every complete block
+	{
+		writeBytes("test-replay-unclosed.rpl", bytes.data(), chunksEnd - 100u);
+		SnortFs::ReplayFile file = SnortFs::replay_open("test-replay-unclosed.rpl");
+		Assert(file.handle != 0);
+		size_t const instructionCount = SnortFs::replay_instructionCount(file);
+		Assert(instructionCount > 0 && instructionCount < 3000);
+		checkInstruction(file, instructionCount - 1);
+		SnortFs::replay_close(file);
+	}
+
+	// -- one payload byte flipped in the instruction block from 1024, the
+	//    block is rejected rather than served and the others are untouched
+	{
+		std::vector<uint8_t> corruptBytes = bytes;
+		uint64_t blockInstructionCount = 0u;
+		for (size_t it = 0; it < chunkCount; ++ it) {
+			uint64_t entry[6];
+			memcpy(entry, bytes.data() + chunksEnd + it * 48u, 48u);
+			// type, first instruction, count, byte offset, payload size
+			if (entry[0] != 1u || entry[1] != 1024u) { continue; }
+			blockInstructionCount = entry[2];
+			corruptBytes[entry[3] + 32u + entry[4] / 2u] ^= 0xFFu;
+		}
+		Assert(blockInstructionCount > 0u);
+		size_t const blockEnd = 1024u + blockInstructionCount;
+		writeBytes(
+			"test-replay-corrupt.rpl", corruptBytes.data(), corruptBytes.size()
+		);
+		SnortFs::ReplayFile file = SnortFs::replay_open("test-replay-corrupt.rpl");
+		SnortFs::ReplayFile original = (
+			SnortFs::replay_open("test-replay-mapped.rpl")
+		);
+		Assert(file.handle != 0);
+		checkInstruction(file, 1023);
+		checkInstruction(file, blockEnd);
+		Assert(SnortFs::replay_instructionDiffCount(file, 1024, 1) == 0);
+		Assert(SnortFs::replay_instructionDiffCount(file, blockEnd - 1u, 1) == 0);
+		Assert(SnortFs::validateMemory(original, file) == 1024u);
+		Assert(SnortFs::validateMemory(file, original, 1u) == 1024u);
+		SnortFs::replay_close(file);
+		SnortFs::replay_close(original);
+	}
+}
+
+void replayKeyframeTest() {
+	// a region that every instruction writes a byte of, materializing any
+	//   instruction must match replaying every diff from the start
+	std::vector<SnortMemoryRegionCreateInfo> regionCreateInfo = {
+		{
+			.dataType = kSnortDt_u8,
+			.elementCount = 64,
+			.elementDisplayRowStride = 8u,
+			.label = "region-memory",
+		},
+		{
+			.dataType = kSnortDt_u32,
+			.elementCount = 1,
+			.elementDisplayRowStride = 1u,
+			.label = "region-counter",
+		},
+	};
+	size_t const instructionCount = 5000u;
+	auto const memoryAt = [](size_t const instructionIndex) {
+		std::vector<uint8_t> memory(64u, 0u);
+		for (size_t it = 0; it <= instructionIndex; ++ it) {
+			memory[(it * 7u) % 64u] = (uint8_t)(it * 13u);
+		}
+		return memory;
+	};
+	for (uint64_t const keyframeInterval : { 0u, 1000u }) {
+		SnortFs::ReplayFileRecorder file = (
+			SnortFs::replayRecorder_open(
+				"test-replay-keyframes.rpl",
+				/*commonInterface=*/ kSnortCommonInterface_custom,
+				/*instructionOffset=*/ 0,
+				/*regionCount=*/ 2,
+				/*regionCreateInfo=*/ regionCreateInfo.data(),
+				{ .keyframeInterval = keyframeInterval }
+			)
+		);
+		Assert(file.handle != 0);
+		for (size_t it = 0; it < instructionCount; ++ it) {
+			uint8_t const value = (uint8_t)(it * 13u);
+			uint32_t const counter = (uint32_t)it;
+			SnortFs::MemoryRegionDiffRecord const memoryDiff = {
+				.byteOffset = (it * 7u) % 64u, .byteCount = 1, .data = &value,
+			};
+			SnortFs::MemoryRegionDiffRecord const counterDiff = {
+				.byteOffset = 0, .byteCount = 4,
+				.data = (uint8_t const *)&counter,
+			};
+			SnortFs::replayRecorder_recordInstruction(file, 1, &memoryDiff);
+			SnortFs::replayRecorder_recordInstruction(file, 1, &counterDiff);
+		}
+		SnortFs::replayRecorder_close(file);
+
+		SnortFs::ReplayFile replayFile = (
+			SnortFs::replay_open(
+				"test-replay-keyframes.rpl", SnortFs::kReplayOpenMode_map
+			)
+		);
+		Assert(replayFile.handle != 0);
+		Assert(SnortFs::replay_instructionCount(replayFile) == instructionCount);
+		if (keyframeInterval != 0u) {
+			Assert(SnortFs::replay_keyframeCount(replayFile) == 5);
+		}
+		else {
+			Assert(SnortFs::replay_keyframeCount(replayFile) > 0);
+		}
+		for (size_t const it : { 0u, 998u, 999u, 1000u, 2500u, 4999u }) {
+			std::vector<uint8_t> memory(64u);
+			uint32_t counter;
+			uint8_t * const regionData[2] = { memory.data(), (uint8_t *)&counter };
+			SnortFs::replay_materializeState(replayFile, it, regionData);
+			Assert(memory == memoryAt(it));
+			Assert(counter == it);
+		}
+		SnortFs::replay_close(replayFile);
+	}
+}
+
+void replayCodecTest() {
+	// records mostly-constant memory with every codec, with the occasional
+	//   incompressible diff, and checks the diffs and materialized state
+	//   survive the round trip and that compression shrinks the file
+	std::vector<SnortMemoryRegionCreateInfo> regionCreateInfo = {
+		{
+			.dataType = kSnortDt_u8,
+			.elementCount = 256,
+			.elementDisplayRowStride = 16u,
+			.label = "region-memory",
+		},
+	};
+	size_t const instructionCount = 3000u;
+	auto const diffAt = [](size_t const instructionIndex) {
+		// a full, mostly zero frame first, then short runs with a noisy block
+		//   every hundred instructions
+		uint64_t state = instructionIndex * 0x9E3779B97F4A7C15ull + 1u;
+		size_t const byteCount = (
+			  instructionIndex == 0u ? 256u
+			: instructionIndex % 100u == 0u ? 200u
+			: 1u + instructionIndex % 8u
+		);
+		std::vector<uint8_t> data(byteCount, (uint8_t)(instructionIndex / 10u));
+		if (instructionIndex == 0u) { std::fill(data.begin(), data.end(), 0u); }
+		if (instructionIndex % 100u == 0u) {
+			for (auto & byte : data) {
+				state ^= state << 13u; state ^= state >> 7u; state ^= state << 17u;
+				byte = (uint8_t)state;
+			}
+		}
+		size_t const byteOffset = (
+			instructionIndex == 0u ? 0u : (instructionIndex * 31u) % 56u
+		);
+		return std::make_pair(byteOffset, data);
+	};
+	auto const fileByteCount = [](char const * const filepath) {
+		FILE * const filePtr = fopen(filepath, "rb");
+		fseek(filePtr, 0, SEEK_END);
+		long const byteCount = ftell(filePtr);
+		fclose(filePtr);
+		return byteCount;
+	};
+	long uncompressedByteCount = 0;
+	for (
+		SnortFs::ReplayCodec const codec : {
+			SnortFs::kReplayCodec_none,
+			SnortFs::kReplayCodec_rle,
+			SnortFs::kReplayCodec_lz,
+		}
+	) {
+		SnortFs::ReplayCodec codecFromName;
+		Assert(
+			SnortFs::replayCodec_fromName(
+				SnortFs::replayCodec_name(codec), codecFromName
+			)
+		);
+		Assert(codecFromName == codec);
+		SnortFs::ReplayFileRecorder file = (
+			SnortFs::replayRecorder_open(
+				"test-replay-codec.rpl",
+				/*commonInterface=*/ kSnortCommonInterface_custom,
+				/*instructionOffset=*/ 0,
+				/*regionCount=*/ 1,
+				/*regionCreateInfo=*/ regionCreateInfo.data(),
+				{ .keyframeInterval = 500u, .codec = codec }
+			)
+		);
+		Assert(file.handle != 0);
+		for (size_t it = 0; it < instructionCount; ++ it) {
+			auto const [byteOffset, data] = diffAt(it);
+			SnortFs::MemoryRegionDiffRecord const diff = {
+				.byteOffset = byteOffset, .byteCount = data.size(),
+				.data = data.data(),
+			};
+			SnortFs::replayRecorder_recordInstruction(file, 1, &diff);
+		}
+		SnortFs::replayRecorder_close(file);
+
+		long const byteCount = fileByteCount("test-replay-codec.rpl");
+		if (codec == SnortFs::kReplayCodec_none) {
+			uncompressedByteCount = byteCount;
+		}
+		else {
+			Assert(byteCount < uncompressedByteCount);
+		}
+
+		SnortFs::ReplayFile replayFile = (
+			SnortFs::replay_open("test-replay-codec.rpl")
+		);
+		Assert(replayFile.handle != 0);
+		Assert(SnortFs::replay_codec(replayFile) == codec);
+		Assert(SnortFs::replay_instructionCount(replayFile) == instructionCount);
+		Assert(SnortFs::replay_keyframeCount(replayFile) == 6);
+		std::vector<uint8_t> expectedMemory(256u, 0u);
+		for (size_t it = 0; it < instructionCount; ++ it) {
+			auto const [byteOffset, data] = diffAt(it);
+			Assert(SnortFs::replay_instructionDiffCount(replayFile, it, 0) == 1);
+			auto const * const diffs = (
+				SnortFs::replay_instructionDiff(replayFile, it, 0)
+			);
+			Assert(diffs[0].byteOffset == byteOffset);
+			Assert(diffs[0].byteCount == data.size());
+			Assert(memcmp(diffs[0].data, data.data(), data.size()) == 0);
+			std::copy(data.begin(), data.end(), expectedMemory.begin() + byteOffset);
+			if (it % 700u == 0u || it == instructionCount - 1u) {
+				std::vector<uint8_t> memory(256u);
+				uint8_t * const regionData[1] = { memory.data() };
+				SnortFs::replay_materializeState(replayFile, it, regionData);
+				Assert(memory == expectedMemory);
+			}
+		}
+		SnortFs::replay_close(replayFile);
+	}
+}
+
+void replayRegionMaskTest() {
+	// nine regions so the changed region mask takes two bytes, each
+	//   instruction only touches a couple of them
+	size_t const regionCount = 9u;
+	std::vector<std::string> labels;
+	std::vector<SnortMemoryRegionCreateInfo> regionCreateInfo;
+	for (size_t it = 0; it < regionCount; ++ it) {
+		labels.emplace_back("region-" + std::to_string(it));
+	}
+	for (size_t it = 0; it < regionCount; ++ it) {
+		regionCreateInfo.emplace_back(SnortMemoryRegionCreateInfo {
+			.dataType = kSnortDt_u8,
+			.elementCount = 4,
+			.elementDisplayRowStride = 4u,
+			.label = labels[it].c_str(),
+		});
+	}
+	size_t const instructionCount = 2000u;
+	auto const isRegionTouched = [](size_t const instr, size_t const region) {
+		return region == instr % 9u || region == 8u;
+	};
+	auto const record = [&](char const * const filepath, size_t const divergence) {
+		SnortFs::ReplayFileRecorder file = (
+			SnortFs::replayRecorder_open(
+				filepath,
+				/*commonInterface=*/ kSnortCommonInterface_custom,
+				/*instructionOffset=*/ 0,
+				/*regionCount=*/ regionCount,
+				/*regionCreateInfo=*/ regionCreateInfo.data()
+			)
+		);
+		Assert(file.handle != 0);
+		for (size_t instrIt = 0; instrIt < instructionCount; ++ instrIt)
+		for (size_t regionIt = 0; regionIt < regionCount; ++ regionIt) {
+			uint8_t const value = (
+				(uint8_t)(instrIt + regionIt + (instrIt == divergence ? 1u : 0u))
+			);
+			SnortFs::MemoryRegionDiffRecord const diff = {
+				.byteOffset = regionIt % 4u, .byteCount = 1, .data = &value,
+			};
+			SnortFs::replayRecorder_recordInstruction(
+				file, isRegionTouched(instrIt, regionIt) ? 1u : 0u, &diff
+			);
+		}
+		SnortFs::replayRecorder_close(file);
+	};
+	record("test-replay-mask.rpl", ~0u);
+	record("test-replay-mask-same.rpl", ~0u);
+	record("test-replay-mask-diverged.rpl", 1234u);
+
+	SnortFs::ReplayFile replayFile = SnortFs::replay_open("test-replay-mask.rpl");
+	Assert(replayFile.handle != 0);
+	Assert(SnortFs::replay_instructionCount(replayFile) == instructionCount);
+	for (size_t instrIt = 0; instrIt < instructionCount; ++ instrIt)
+	for (size_t regionIt = 0; regionIt < regionCount; ++ regionIt) {
+		size_t const diffCount = (
+			SnortFs::replay_instructionDiffCount(replayFile, instrIt, regionIt)
+		);
+		Assert(diffCount == (isRegionTouched(instrIt, regionIt) ? 1u : 0u));
+		if (diffCount == 0u) { continue; }
+		auto const * const diffs = (
+			SnortFs::replay_instructionDiff(replayFile, instrIt, regionIt)
+		);
+		Assert(diffs[0].byteOffset == regionIt % 4u);
+		Assert(diffs[0].data[0] == (uint8_t)(instrIt + regionIt));
+	}
+
+	SnortFs::ReplayFile replaySame = (
+		SnortFs::replay_open("test-replay-mask-same.rpl")
+	);
+	SnortFs::ReplayFile replayDiverged = (
+		SnortFs::replay_open("test-replay-mask-diverged.rpl")
+	);
+	Assert(SnortFs::validateMemory(replayFile, replaySame) == (size_t)~0u);
+	Assert(SnortFs::validateMemory(replayFile, replayDiverged) == 1234u);
+	SnortFs::replay_close(replayFile);
+	SnortFs::replay_close(replaySame);
+	SnortFs::replay_close(replayDiverged);
+}
+
+void validateMemoryParallelTest() {
+	// many blocks, so the workers split them up. The first divergence has to
+	//   win over a later one another worker may find first
+	SnortMemoryRegionCreateInfo const regionCreateInfo = {
+		.dataType = kSnortDt_u8,
+		.elementCount = 4,
+		.elementDisplayRowStride = 4u,
+		.label = "region-memory",
+	};
+	size_t const instructionCount = 20000u;
+	auto const record = [&](
+		char const * const filepath,
+		std::vector<size_t> const & divergences
+	) {
+		SnortFs::ReplayFileRecorder file = (
+			SnortFs::replayRecorder_open(
+				filepath,
+				/*commonInterface=*/ kSnortCommonInterface_custom,
+				/*instructionOffset=*/ 0,
+				/*regionCount=*/ 1u,
+				/*regionCreateInfo=*/ &regionCreateInfo
+			)
+		);
+		Assert(file.handle != 0);
+		for (size_t instrIt = 0; instrIt < instructionCount; ++ instrIt) {
+			bool const isDiverged = (
+				std::count(divergences.begin(), divergences.end(), instrIt) > 0
+			);
+			uint8_t const value = (uint8_t)(instrIt + (isDiverged ? 1u : 0u));
+			SnortFs::MemoryRegionDiffRecord const diff = {
+				.byteOffset = instrIt % 4u, .byteCount = 1, .data = &value,
+			};
+			SnortFs::replayRecorder_recordInstruction(file, 1u, &diff);
+		}
+		SnortFs::replayRecorder_close(file);
+	};
+	record("test-replay-validate.rpl", {});
+	record("test-replay-validate-early.rpl", { 3000u, 15000u, 16001u });
+	record("test-replay-validate-late.rpl", { instructionCount - 1u });
+
+	SnortFs::ReplayFile replayFile = (
+		SnortFs::replay_open("test-replay-validate.rpl")
+	);
+	char const * const comparisons[3] = {
+		"test-replay-validate.rpl",
+		"test-replay-validate-early.rpl",
+		"test-replay-validate-late.rpl",
+	};
+	size_t const expected[3] = { (size_t)~0u, 3000u, instructionCount - 1u };
+	for (size_t const workerCount : { 1u, 3u, 0u })
+	for (size_t it = 0; it < 3u; ++ it) {
+		// freshly opened, so the workers parse every block themselves
+		SnortFs::ReplayFile replayCmp = SnortFs::replay_open(comparisons[it]);
+		Assert(replayCmp.handle != 0);
+		Assert(
+			   SnortFs::validateMemory(replayFile, replayCmp, workerCount)
+			== expected[it]
+		);
+		SnortFs::replay_close(replayCmp);
+	}
+	SnortFs::replay_close(replayFile);
+}
+
+void replayAsyncWriterTest() {
+	// the writer thread must produce the same file as recording inline, a
+	//   tiny ring forces stalls and regions that are larger than the ring
+	std::vector<SnortMemoryRegionCreateInfo> regionCreateInfo = {
+		{
+			.dataType = kSnortDt_u8,
+			.elementCount = 1000,
+			.elementDisplayRowStride = 10u,
+			.label = "region-memory",
+		},
+		{
+			.dataType = kSnortDt_u16,
+			.elementCount = 1,
+			.elementDisplayRowStride = 1u,
+			.label = "region-pc",
+		},
+	};
+	auto const readFile = [](char const * const filepath) {
+		FILE * const filePtr = fopen(filepath, "rb");
+		std::vector<uint8_t> bytes;
+		for (int byte; (byte = fgetc(filePtr)) != EOF;) {
+			bytes.emplace_back((uint8_t)byte);
+		}
+		fclose(filePtr);
+		return bytes;
+	};
+	for (bool const asyncWriter : { false, true }) {
+		std::vector<uint8_t> memory(1000u, 0u);
+		char const * const filepath = (
+			asyncWriter ? "test-replay-async.rpl" : "test-replay-sync.rpl"
+		);
+		SnortFs::ReplayFileRecorder file = (
+			SnortFs::replayRecorder_open(
+				filepath,
+				/*commonInterface=*/ kSnortCommonInterface_custom,
+				/*instructionOffset=*/ 0,
+				/*regionCount=*/ 2,
+				/*regionCreateInfo=*/ regionCreateInfo.data(),
+				{
+					.codec = SnortFs::kReplayCodec_lz,
+					.asyncWriter = asyncWriter,
+					.asyncRingByteCount = 256u,
+				}
+			)
+		);
+		Assert(file.handle != 0);
+		for (size_t it = 0; it < 4000u; ++ it) {
+			for (size_t byteIt = 0; byteIt < memory.size(); byteIt += 97u) {
+				memory[(byteIt + it) % memory.size()] = (uint8_t)(it + byteIt);
+			}
+			uint16_t const pc = (uint16_t)(it * 2u);
+			SnortFs::MemoryRegionDiffRecord const memoryDiffs[2] = {
+				{ .byteOffset = 0, .byteCount = 1000, .data = memory.data() },
+				{ .byteOffset = it % 1000u, .byteCount = 1, .data = memory.data() },
+			};
+			SnortFs::MemoryRegionDiffRecord const pcDiff = {
+				.byteOffset = 0, .byteCount = 2, .data = (uint8_t const *)&pc,
+			};
+			// a full region every hundred instructions, else a single byte
+			SnortFs::replayRecorder_recordInstruction(
+				file, 1, memoryDiffs + (it % 100u == 0u ? 0u : 1u)
+			);
+			SnortFs::replayRecorder_recordInstruction(file, 1, &pcDiff);
+		}
+		SnortFs::ReplayRecorderStats const stats = (
+			SnortFs::replayRecorder_stats(file)
+		);
+		if (!asyncWriter) {
+			Assert(stats.writerStallCount == 0u);
+		}
+		SnortFs::replayRecorder_close(file);
+	}
+	Assert(readFile("test-replay-sync.rpl") == readFile("test-replay-async.rpl"));
+}
+
+void replayRecorderAllocationTest() {
+	// once the recorder's buffers have grown to fit a block, recording more
+	//   instructions only grows the chunk index, so tens of thousands of
+	//   instructions take a few dozen allocations at most
+	SnortMemoryRegionCreateInfo const regionCreateInfo = {
+		.dataType = kSnortDt_u8,
+		.elementCount = 256,
+		.elementDisplayRowStride = 16u,
+		.label = "region-memory",
+	};
+	for (bool const asyncWriter : { false, true }) {
+		SnortFs::ReplayFileRecorder file = (
+			SnortFs::replayRecorder_open(
+				"test-replay-allocations.rpl",
+				/*commonInterface=*/ kSnortCommonInterface_custom,
+				/*instructionOffset=*/ 0,
+				/*regionCount=*/ 1,
+				/*regionCreateInfo=*/ &regionCreateInfo,
+				{
+					.codec = SnortFs::kReplayCodec_lz,
+					.asyncWriter = asyncWriter,
+				}
+			)
+		);
+		Assert(file.handle != 0);
+		uint8_t memory[256] = {};
+		for (size_t it = 0; it < 50000u; ++ it) {
+			memory[it % 256u] = (uint8_t)it;
+			SnortFs::MemoryRegionDiffRecord const diffs[2] = {
+				{ .byteOffset = it % 256u, .byteCount = 1, .data = memory + it % 256u },
+				{ .byteOffset = 0, .byteCount = 256, .data = memory },
+			};
+			SnortFs::replayRecorder_recordInstruction(
+				file, (it % 50u == 0u) ? 2u : 1u, diffs
+			);
+		}
+		// the writer thread may still be catching up until the recording closes
+		if (!asyncWriter) {
+			Assert(SnortFs::replayRecorder_stats(file).allocationCount < 32u);
+		}
+		SnortFs::replayRecorder_close(file);
+	}
+}
+
+void diffKernelTest() {
+	// every kernel has to find the same spans as a byte at a time scan, over
+	//   lengths that cover the vector tails and spans that cross lanes
+	auto const referenceSpans = [](
+		uint8_t const * const data, uint8_t const * const reference,
+		size_t const byteCount
+	) {
+		std::vector<std::pair<size_t, size_t>> spans;
+		for (size_t it = 0; it < byteCount;) {
+			if (data[it] == reference[it]) { ++ it; continue; }
+			size_t end = it;
+			while (end < byteCount && data[end] != reference[end]) { ++ end; }
+			spans.emplace_back(it, end - it);
+			it = end;
+		}
+		return spans;
+	};
+	uint64_t state = 0x2545F4914F6CDD1Dull;
+	auto const random = [&state]() {
+		state ^= state << 13u; state ^= state >> 7u; state ^= state << 17u;
+		return state;
+	};
+	std::vector<SnortFs::MemoryRegionDiffRecord> records;
+	for (size_t trial = 0; trial < 2000u; ++ trial) {
+		size_t const byteCount = (size_t)(random() % 300u);
+		std::vector<uint8_t> reference(byteCount), data(byteCount);
+		uint64_t const changeChance = 1u + random() % 64u;
+		for (size_t it = 0; it < byteCount; ++ it) {
+			reference[it] = (uint8_t)random();
+			data[it] = (
+				random() % 64u < changeChance ? (uint8_t)(reference[it] + 1u)
+				: reference[it]
+			);
+		}
+		auto const spans = referenceSpans(data.data(), reference.data(), byteCount);
+		for (
+			SnortFs::DiffKernel const kernel : {
+				SnortFs::kDiffKernel_best,
+				SnortFs::kDiffKernel_scalar,
+				SnortFs::kDiffKernel_sse2,
+				SnortFs::kDiffKernel_avx2,
+			}
+		) {
+			if (!SnortFs::diffKernel_isSupported(kernel)) { continue; }
+			records.clear();
+			SnortFs::diff_findSpans(
+				data.data(), reference.data(), byteCount, records, kernel
+			);
+			Assert(records.size() == spans.size());
+			for (size_t it = 0; it < spans.size(); ++ it) {
+				Assert(records[it].byteOffset == spans[it].first);
+				Assert(records[it].byteCount == spans[it].second);
+				Assert(records[it].data == data.data() + spans[it].first);
+			}
+		}
+	}
+}
+
+void replayHashOnlyTest() {
+	// the same run recorded twice agrees, a single byte changed at one
+	//   instruction is narrowed down to its hash block and region
+	std::vector<SnortMemoryRegionCreateInfo> regionCreateInfo = {
+		{
+			.dataType = kSnortDt_u8,
+			.elementCount = 1000,
+			.elementDisplayRowStride = 10u,
+			.label = "region-memory",
+		},
+		{
+			.dataType = kSnortDt_u16,
+			.elementCount = 1,
+			.elementDisplayRowStride = 1u,
+			.label = "region-pc",
+		},
+	};
+	constexpr size_t kInstructionCount { 10000u };
+	auto const record = [&](char const * const filepath, size_t const flipAt) {
+		SnortFs::ReplayFileRecorder file = (
+			SnortFs::replayRecorder_open(
+				filepath,
+				/*commonInterface=*/ kSnortCommonInterface_custom,
+				/*instructionOffset=*/ 7,
+				/*regionCount=*/ 2,
+				/*regionCreateInfo=*/ regionCreateInfo.data(),
+				{
+					.codec = SnortFs::kReplayCodec_lz,
+					.hashOnly = true,
+					.hashInterval = 1024u,
+				}
+			)
+		);
+		Assert(file.handle != 0);
+		std::vector<uint8_t> memory(1000u, 0u);
+		for (size_t it = 0; it < kInstructionCount; ++ it) {
+			size_t const byteOffset = (it * 7u) % memory.size();
+			memory[byteOffset] = (uint8_t)(it + (it == flipAt ? 1u : 0u));
+			uint16_t const pc = (uint16_t)(it * 2u);
+			SnortFs::MemoryRegionDiffRecord const memoryDiff = {
+				.byteOffset = byteOffset,
+				.byteCount = 1,
+				.data = memory.data() + byteOffset,
+			};
+			SnortFs::MemoryRegionDiffRecord const pcDiff = {
+				.byteOffset = 0, .byteCount = 2, .data = (uint8_t const *)&pc,
+			};
+			SnortFs::replayRecorder_recordInstruction(file, 1, &memoryDiff);
+			SnortFs::replayRecorder_recordInstruction(file, 1, &pcDiff);
+		}
+		SnortFs::replayRecorder_close(file);
+	};
+	record("test-replay-hash.rpl", ~0ull);
+	record("test-replay-hash-same.rpl", ~0ull);
+	record("test-replay-hash-diverged.rpl", 5000u);
+
+	SnortFs::ReplayFile replay = SnortFs::replay_open("test-replay-hash.rpl");
+	SnortFs::ReplayFile replaySame = (
+		SnortFs::replay_open("test-replay-hash-same.rpl")
+	);
+	SnortFs::ReplayFile replayDiverged = (
+		SnortFs::replay_open("test-replay-hash-diverged.rpl")
+	);
+	Assert(replay.handle != 0);
+	Assert(SnortFs::replay_isHashOnly(replay));
+	Assert(SnortFs::replay_instructionOffset(replay) == 7);
+	Assert(SnortFs::replay_instructionCount(replay) == kInstructionCount);
+	Assert(SnortFs::replay_hashBlockCount(replay) == 10u);
+	Assert(SnortFs::replay_instructionDiffCount(replay, 5, 0) == 0u);
+
+	SnortFs::HashDivergence const same = (
+		SnortFs::validateHashes(replay, replaySame)
+	);
+	Assert(same.isComparable);
+	Assert(!same.isDiverged);
+
+	SnortFs::HashDivergence const diverged = (
+		SnortFs::validateHashes(replay, replayDiverged)
+	);
+	Assert(diverged.isComparable);
+	Assert(diverged.isDiverged);
+	Assert(diverged.firstInstruction == 4096u);
+	Assert(diverged.instructionCount == 1024u);
+	Assert(diverged.regionIndices.size() == 1u);
+	Assert(diverged.regionIndices[0] == 0u);
+
+	// -- a full replay against a hash-only one isn't a divergence
+	SnortFs::ReplayFile replayFull = (
+		SnortFs::replay_open("test-replay-mapped.rpl")
+	);
+	Assert(replayFull.handle != 0);
+	Assert(!SnortFs::validateHashes(replay, replayFull).isComparable);
+	Assert(!SnortFs::validateHashes(replayFull, replay).isComparable);
+
+	SnortFs::replay_close(replay);
+	SnortFs::replay_close(replaySame);
+	SnortFs::replay_close(replayDiverged);
+	SnortFs::replay_close(replayFull);
+}
+
+void replayRngSeedTest() {
+	// the seed round-trips through the header, and files without it say so
+	SnortMemoryRegionCreateInfo const regionCreateInfo = {
+		.dataType = kSnortDt_u8,
+		.elementCount = 16,
+		.elementDisplayRowStride = 16u,
+		.label = "region-memory",
+	};
+	for (bool const hasRngSeed : { false, true }) {
+		SnortFs::ReplayFileRecorder file = (
+			SnortFs::replayRecorder_open(
+				"test-replay-rng.rpl",
+				/*commonInterface=*/ kSnortCommonInterface_custom,
+				/*instructionOffset=*/ 0,
+				/*regionCount=*/ 1,
+				/*regionCreateInfo=*/ &regionCreateInfo,
+				{
+					.codec = SnortFs::kReplayCodec_rle,
+					.hasRngSeed = hasRngSeed,
+					.rngSeed = 0xDEADBEEFCAFEull,
+				}
+			)
+		);
+		Assert(file.handle != 0);
+		uint8_t memory[16] = { 1, 2, 3 };
+		SnortFs::MemoryRegionDiffRecord const diff = {
+			.byteOffset = 0, .byteCount = 16, .data = memory,
+		};
+		SnortFs::replayRecorder_recordInstruction(file, 1, &diff);
+		SnortFs::replayRecorder_close(file);
+
+		SnortFs::ReplayFile replayFile = (
+			SnortFs::replay_open("test-replay-rng.rpl")
+		);
+		Assert(replayFile.handle != 0);
+		uint64_t rngSeed = 0u;
+		Assert(SnortFs::replay_rngSeed(replayFile, rngSeed) == hasRngSeed);
+		if (hasRngSeed) {
+			Assert(rngSeed == 0xDEADBEEFCAFEull);
+		}
+		// the seed sits between the codec and the rest of the header
+		Assert(SnortFs::replay_codec(replayFile) == SnortFs::kReplayCodec_rle);
+		Assert(SnortFs::replay_instructionCount(replayFile) == 1u);
+		Assert(SnortFs::replay_instructionDiff(replayFile, 0, 0)->data[2] == 3u);
+		SnortFs::replay_close(replayFile);
+	}
+}
+
+void replayInputTest() {
+	// input changes span several blocks, and read back the same with and
+	//   without the async writer
+	SnortMemoryRegionCreateInfo const regionCreateInfo = {
+		.dataType = kSnortDt_u8,
+		.elementCount = 16,
+		.elementDisplayRowStride = 16u,
+		.label = "region-memory",
+	};
+	// the state the emulator polls at an instruction
+	auto const inputAt = [](size_t const instruction) -> uint64_t {
+		if (instruction < 10u) { return 0u; }
+		return (instruction / 300u) % 3u == 0u ? 0x8001u : instruction / 300u;
+	};
+	for (bool const asyncWriter : { false, true }) {
+		SnortFs::ReplayFileRecorder file = (
+			SnortFs::replayRecorder_open(
+				"test-replay-input.rpl",
+				/*commonInterface=*/ kSnortCommonInterface_custom,
+				/*instructionOffset=*/ 0,
+				/*regionCount=*/ 1,
+				/*regionCreateInfo=*/ &regionCreateInfo,
+				{
+					.codec = SnortFs::kReplayCodec_lz,
+					.asyncWriter = asyncWriter,
+					.asyncRingByteCount = 256u,
+					.recordInputs = true,
+				}
+			)
+		);
+		Assert(file.handle != 0);
+		uint8_t memory[16] = {};
+		for (size_t it = 0; it < 3000u; ++ it) {
+			SnortFs::replayRecorder_recordInput(file, inputAt(it));
+			memory[it % 16u] += 1u;
+			SnortFs::MemoryRegionDiffRecord const diff = {
+				.byteOffset = it % 16u, .byteCount = 1, .data = &memory[it % 16u],
+			};
+			SnortFs::replayRecorder_recordInstruction(file, 1, &diff);
+		}
+		SnortFs::replayRecorder_close(file);
+
+		SnortFs::ReplayFile replayFile = (
+			SnortFs::replay_open("test-replay-input.rpl")
+		);
+		Assert(replayFile.handle != 0);
+		Assert(SnortFs::replay_hasInputs(replayFile));
+		for (size_t it = 0; it < 3000u; ++ it) {
+			Assert(SnortFs::replay_inputState(replayFile, it) == inputAt(it));
+		}
+		// the inputs don't get in the way of the diffs
+		Assert(SnortFs::replay_instructionCount(replayFile) == 3000u);
+		Assert(SnortFs::replay_instructionDiff(replayFile, 2999, 0)->data[0] == 188u);
+		SnortFs::replay_close(replayFile);
+	}
+
+	// without recordInputs the state is never stored
+	SnortFs::ReplayFileRecorder file = (
+		SnortFs::replayRecorder_open(
+			"test-replay-input.rpl",
+			/*commonInterface=*/ kSnortCommonInterface_custom,
+			/*instructionOffset=*/ 0,
+			/*regionCount=*/ 1,
+			/*regionCreateInfo=*/ &regionCreateInfo
+		)
+	);
+	uint8_t memory[16] = {};
+	SnortFs::MemoryRegionDiffRecord const diff = {
+		.byteOffset = 0, .byteCount = 16, .data = memory,
+	};
+	SnortFs::replayRecorder_recordInput(file, 0x5u);
+	SnortFs::replayRecorder_recordInstruction(file, 1, &diff);
+	SnortFs::replayRecorder_close(file);
+	SnortFs::ReplayFile replayFile = SnortFs::replay_open("test-replay-input.rpl");
+	Assert(!SnortFs::replay_hasInputs(replayFile));
+	Assert(SnortFs::replay_inputState(replayFile, 0) == 0u);
+	SnortFs::replay_close(replayFile);
+}
+
+void flightRecorderTest() {
+	// a dump has to materialize to the memory every kept instruction had,
+	//   whether the ring wrapped, folded a too big instruction into its base
+	//   or dropped instructions that were stepped back over
+	auto const createDevice = [](
+		std::vector<char const *> const & args,
+		SnortMemoryRegionCreateInfo const & regionCreateInfo
+	) {
+		static std::vector<char const *> argv;
+		argv = { "unit-tests", "--headless", "--flight-recorder-mib", "1" };
+		argv.insert(argv.end(), args.begin(), args.end());
+		SnortDeviceCreateInfo const createInfo = {
+			.name = "flight",
+			.argc = (i32)argv.size(),
+			.argv = argv.data(),
+			.recordingFilepath = "test-flight.rpl",
+			.commonInterface = kSnortCommonInterface_custom,
+			.memoryRegionCount = 1u,
+			.memoryRegions = &regionCreateInfo,
+		};
+		SnortDevice const device = snort_deviceCreate(&createInfo);
+		Assert(device.handle != 0);
+		return device;
+	};
+	// history[it] is the memory before instruction it ran, returns the
+	//   dump's first instruction and instruction count
+	auto const checkDump = [](
+		SnortDevice const device,
+		size_t const lastInstruction,
+		std::vector<std::vector<u8>> const & history
+	) {
+		snort_flightRecorderTrigger(device, "unit test");
+		std::string const filepath = (
+			"test-flight-flight-" + std::to_string(lastInstruction) + ".rpl"
+		);
+		SnortFs::ReplayFile file = SnortFs::replay_open(filepath.c_str());
+		Assert(file.handle != 0);
+		size_t const firstInstruction = SnortFs::replay_instructionOffset(file);
+		size_t const instructionCount = SnortFs::replay_instructionCount(file);
+		Assert(firstInstruction + instructionCount - 1u == lastInstruction);
+		std::vector<u8> memory(history[lastInstruction].size());
+		uint8_t * const regionData[1] = { memory.data() };
+		for (size_t it = 0; it < instructionCount; ++ it) {
+			SnortFs::replay_materializeState(file, it, regionData);
+			Assert(memory == history[firstInstruction + it]);
+		}
+		SnortFs::replay_close(file);
+		return std::pair<size_t, size_t> { firstInstruction, instructionCount };
+	};
+	auto const writeInstruction = [](std::vector<u8> & memory, size_t instrIt) {
+		size_t const offset = (instrIt * 1031u) % (16u * 1024u - 4096u);
+		size_t const count = (instrIt % 7u + 1u) * 512u;
+		for (size_t it = 0; it < count; ++ it) {
+			memory[offset + it] = (u8)(instrIt + it);
+		}
+	};
+	SnortMemoryRegionCreateInfo const regionCreateInfo = {
+		.dataType = kSnortDt_u8,
+		.elementCount = 16u * 1024u,
+		.elementDisplayRowStride = 64u,
+		.label = "region-memory",
+	};
+
+	// -- held back by bytes, then by instructions
+	for (auto const capacity : { "1000", "50" }) {
+		SnortDevice device = createDevice(
+			{ "--flight-recorder", capacity }, regionCreateInfo
+		);
+		std::vector<u8> memory(16u * 1024u);
+		SnortMemoryRegion const region = { memory.data() };
+		std::vector<std::vector<u8>> history;
+		for (size_t instrIt = 0; instrIt < 1500u; ++ instrIt) {
+			history.emplace_back(memory);
+			snort_updateFrame(device, &region);
+			writeInstruction(memory, instrIt);
+		}
+		auto const [firstInstruction, instructionCount] = (
+			checkDump(device, 1499u, history)
+		);
+		Assert(firstInstruction > 0u);
+		if (strcmp(capacity, "50") == 0) {
+			Assert(instructionCount == 51u);
+		} else {
+			Assert(instructionCount > 300u && instructionCount < 600u);
+		}
+		snort_deviceDestroy(&device);
+	}
+
+	// -- an instruction larger than the ring, it and everything before it
+	//    end up in the base
+	{
+		SnortMemoryRegionCreateInfo const largeRegionCreateInfo = {
+			.dataType = kSnortDt_u8,
+			.elementCount = 1280u * 1024u,
+			.elementDisplayRowStride = 64u,
+			.label = "region-memory",
+		};
+		SnortDevice device = createDevice(
+			{ "--flight-recorder", "100" }, largeRegionCreateInfo
+		);
+		std::vector<u8> memory(1280u * 1024u);
+		SnortMemoryRegion const region = { memory.data() };
+		// only the instructions from the large one onwards are kept around
+		std::vector<std::vector<u8>> history(30u);
+		for (size_t instrIt = 0; instrIt < 30u; ++ instrIt) {
+			if (instrIt >= 20u) { history[instrIt] = memory; }
+			snort_updateFrame(device, &region);
+			if (instrIt == 20u) {
+				std::fill(memory.begin(), memory.end(), (u8)0xA5u);
+			} else {
+				writeInstruction(memory, instrIt);
+			}
+		}
+		auto const [firstInstruction, instructionCount] = (
+			checkDump(device, 29u, history)
+		);
+		Assert(firstInstruction == 21u && instructionCount == 9u);
+		snort_deviceDestroy(&device);
+	}
+
+	// -- stepping back drops the newest instructions, and starts the base
+	//    over once the ring is empty
+	{
+		SnortDevice device = createDevice(
+			{ "--flight-recorder", "10", "--step-back", "50" }, regionCreateInfo
+		);
+		std::vector<u8> memory(16u * 1024u);
+		SnortWritableMemoryRegion const writableRegion = { memory.data() };
+		snort_setWritableRegions(device, &writableRegion);
+		SnortMemoryRegion const region = { memory.data() };
+		std::vector<std::vector<u8>> history;
+		for (size_t instrIt = 0; instrIt < 200u; ++ instrIt) {
+			history.emplace_back(memory);
+			snort_updateFrame(device, &region);
+			writeInstruction(memory, instrIt);
+		}
+		for (size_t it = 0; it < 5u; ++ it) { Assert(snort_stepBack(device)); }
+		Assert(checkDump(device, 194u, history).second == 6u);
+		for (size_t it = 0; it < 10u; ++ it) { Assert(snort_stepBack(device)); }
+		Assert(checkDump(device, 184u, history).second == 1u);
+		snort_deviceDestroy(&device);
+	}
+}
+
+void stepBackTest() {
+	// instructions of varying size in a 1 MiB log, so the log wraps and
+	//   evicts by bytes long before it holds --step-back instructions. Every
+	//   step back has to land on the memory from before the instruction
+	size_t const byteCount = 16u * 1024u;
+	SnortMemoryRegionCreateInfo const regionCreateInfo = {
+		.dataType = kSnortDt_u8,
+		.elementCount = byteCount,
+		.elementDisplayRowStride = 64u,
+		.label = "region-memory",
+	};
+	auto const run = [&](
+		char const * const instructionCapacity,
+		size_t const instructionCount
+	) {
+		char const * const argv[] = {
+			"unit-tests", "--headless",
+			"--step-back", instructionCapacity, "--step-back-mib", "1",
+		};
+		SnortDeviceCreateInfo const createInfo = {
+			.name = "step-back",
+			.argc = 6,
+			.argv = argv,
+			.recordingFilepath = "test-step-back.rpl",
+			.commonInterface = kSnortCommonInterface_custom,
+			.memoryRegionCount = 1u,
+			.memoryRegions = &regionCreateInfo,
+		};
+		SnortDevice device = snort_deviceCreate(&createInfo);
+		Assert(device.handle != 0);
+		std::vector<u8> memory(byteCount);
+		SnortWritableMemoryRegion const writableRegion = { memory.data() };
+		snort_setWritableRegions(device, &writableRegion);
+		SnortMemoryRegion const region = { memory.data() };
+
+		// memory[it] is the memory before instruction it ran
+		std::vector<std::vector<u8>> history;
+		for (size_t instrIt = 0; instrIt < instructionCount; ++ instrIt) {
+			history.emplace_back(memory);
+			snort_updateFrame(device, &region);
+			size_t const offset = (instrIt * 1031u) % (byteCount - 4096u);
+			size_t const count = (instrIt % 7u + 1u) * 512u;
+			for (size_t it = 0; it < count; ++ it) {
+				memory[offset + it] = (u8)(instrIt + it);
+			}
+		}
+		size_t stepBackCount = 0u;
+		while (snort_stepBack(device)) {
+			++ stepBackCount;
+			Assert(memory == history[instructionCount - stepBackCount]);
+		}
+		snort_deviceDestroy(&device);
+		return stepBackCount;
+	};
+	// held back by bytes, instructions average 2 KiB
+	size_t const byteBound = run("1000", 1500u);
+	Assert(byteBound > 300u && byteBound < 600u);
+	// held back by instructions
+	Assert(run("50", 200u) == 50u);
+}
+
+void stepBackRunTest() {
+	// headless snort_run steps back from inside the step callback and has to
+	//   carry on to the target, there's no ui to resume it
+	SnortMemoryRegionCreateInfo const regionCreateInfo[2] = {
+		{
+			.dataType = kSnortDt_u8,
+			.elementCount = 8,
+			.elementDisplayRowStride = 8u,
+			.label = "region-counter",
+		},
+		{
+			.dataType = kSnortDt_u8,
+			.elementCount = 64,
+			.elementDisplayRowStride = 8u,
+			.label = "region-memory",
+		},
+	};
+	struct TestEmulator {
+		SnortDevice device { 0 };
+		u64 counter { 0u };
+		u8 memory[64] {};
+		size_t stepBackCount { 0u };
+		bool hasSteppedBack { false };
+	};
+	char const * const argv[] = {
+		"unit-tests", "--headless", "--step-back", "50",
+		"--target-instruction-count", "300",
+	};
+	SnortDeviceCreateInfo const createInfo = {
+		.name = "step-back-run",
+		.argc = 6,
+		.argv = argv,
+		.recordingFilepath = "test-step-back-run.rpl",
+		.commonInterface = kSnortCommonInterface_custom,
+		.memoryRegionCount = 2u,
+		.memoryRegions = regionCreateInfo,
+	};
+	TestEmulator emulator {};
+	emulator.device = snort_deviceCreate(&createInfo);
+	Assert(emulator.device.handle != 0);
+	SnortWritableMemoryRegion const writableRegions[2] = {
+		{ (u8 *)&emulator.counter }, { emulator.memory },
+	};
+	snort_setWritableRegions(emulator.device, writableRegions);
+	SnortMemoryRegion const regions[2] = {
+		{ (u8 const *)&emulator.counter }, { emulator.memory },
+	};
+	snort_run(
+		emulator.device,
+		regions,
+		[](void * userData) {
+			TestEmulator & emulator = *(TestEmulator *)userData;
+			// returns without stepping, like after a restore
+			if (emulator.counter == 100u && !emulator.hasSteppedBack) {
+				emulator.hasSteppedBack = true;
+				for (size_t it = 0; it < 10u; ++ it) {
+					if (snort_stepBack(emulator.device)) {
+						++ emulator.stepBackCount;
+					}
+				}
+				return;
+			}
+			emulator.memory[emulator.counter % 64u] = (u8)(emulator.counter * 3u);
+			++ emulator.counter;
+		},
+		&emulator
+	);
+	snort_deviceDestroy(&emulator.device);
+
+	Assert(emulator.stepBackCount == 10u);
+	Assert(emulator.counter == 300u);
+	u8 expected[64] {};
+	for (u64 it = 0; it < 300u; ++ it) {
+		expected[it % 64u] = (u8)(it * 3u);
+	}
+	Assert(memcmp(emulator.memory, expected, sizeof(expected)) == 0);
+}
+
+void runCoresTest() {
+	// three cores counting up, the last one writes a different byte at
+	//   instruction 40. The memory after instruction 40 is the first that
+	//   differs, so every core ran 41 instructions
+	SnortMemoryRegionCreateInfo const regionCreateInfo[2] = {
+		{
+			.dataType = kSnortDt_u8,
+			.elementCount = 8,
+			.elementDisplayRowStride = 8u,
+			.label = "region-counter",
+		},
+		{
+			.dataType = kSnortDt_u8,
+			.elementCount = 64,
+			.elementDisplayRowStride = 8u,
+			.label = "region-memory",
+		},
+	};
+	struct TestCore {
+		u64 counter { 0u };
+		u8 memory[64] {};
+		u64 divergence { ~0ull };
+		SnortMemoryRegion regions[2] {};
+	};
+	SnortStepFn const step = [](void * userData) {
+		TestCore & core = *(TestCore *)userData;
+		core.memory[core.counter % 64u] = (u8)(
+			core.counter + (core.counter == core.divergence ? 1u : 0u)
+		);
+		++ core.counter;
+	};
+	char const * const argv[] = {
+		"unit-tests", "--target-instruction-count", "100",
+	};
+	auto const run = [&](u64 const divergence) {
+		TestCore testCores[3];
+		SnortCore cores[3];
+		for (size_t it = 0; it < 3u; ++ it) {
+			SnortDeviceCreateInfo const createInfo = {
+				.name = "core",
+				.argc = 3,
+				.argv = argv,
+				.recordingFilepath = "test-cores.rpl",
+				.commonInterface = kSnortCommonInterface_custom,
+				.memoryRegionCount = 2u,
+				.memoryRegions = regionCreateInfo,
+			};
+			testCores[it].regions[0] = { (u8 const *)&testCores[it].counter };
+			testCores[it].regions[1] = { testCores[it].memory };
+			cores[it] = SnortCore {
+				.device = snort_coreDeviceCreate(&createInfo),
+				.memoryRegions = testCores[it].regions,
+				.step = step,
+				.userData = &testCores[it],
+			};
+			Assert(cores[it].device.handle != 0);
+		}
+		testCores[2].divergence = divergence;
+		SnortCoreRunResult const result = snort_runCores(cores, 3u);
+		for (auto & core : cores) {
+			snort_deviceDestroy(&core.device);
+		}
+		return result;
+	};
+
+	SnortCoreRunResult const same = run(~0ull);
+	Assert(!same.isDiverged);
+	Assert(same.instructionCount == 100u);
+
+	SnortCoreRunResult const diverged = run(40u);
+	Assert(diverged.isDiverged);
+	Assert(diverged.instructionCount == 41u);
+	Assert(diverged.coreIndex == 2u);
+	Assert(diverged.regionIndex == 1u);
+}
+
+void lockstepTest() {
+	// both sides in this process, publishing ahead of the comparator
+	SnortMemoryRegionCreateInfo const regionCreateInfo[2] = {
+		{
+			.dataType = kSnortDt_u8,
+			.elementCount = 16,
+			.elementDisplayRowStride = 16u,
+			.label = "region-registers",
+		},
+		{
+			.dataType = kSnortDt_u16,
+			.elementCount = 64,
+			.elementDisplayRowStride = 8u,
+			.label = "region-memory",
+		},
+	};
+	std::atomic<bool> const cancel { false };
+	for (bool const isDiverging : { false, true }) {
+		SnortFs::LockstepChannel channel = (
+			SnortFs::lockstep_create(
+				"unit-test", { .ringCapacity = 64u, .interval = 4u }
+			)
+		);
+		Assert(channel.handle != 0);
+		SnortFs::LockstepChannel side0 = (
+			SnortFs::lockstep_attach("unit-test", 2, regionCreateInfo)
+		);
+		SnortFs::LockstepChannel side1 = (
+			SnortFs::lockstep_attach("unit-test", 2, regionCreateInfo)
+		);
+		Assert(side0.handle != 0 && side1.handle != 0);
+		Assert(SnortFs::lockstep_side(side0) == 0u);
+		Assert(SnortFs::lockstep_side(side1) == 1u);
+		Assert(SnortFs::lockstep_interval(side1) == 4u);
+		// no third side
+		Assert(SnortFs::lockstep_attach("unit-test", 2, regionCreateInfo).handle == 0);
+
+		for (uint64_t it = 0; it < 40u; ++ it) {
+			uint64_t hashes[2] = { it * 3u, it * 7u };
+			Assert(SnortFs::lockstep_publish(side0, it * 4u, hashes));
+			if (isDiverging && it == 25u) { hashes[1] += 1u; }
+			Assert(SnortFs::lockstep_publish(side1, it * 4u, hashes));
+		}
+		SnortFs::lockstep_detach(side0);
+		SnortFs::lockstep_detach(side1);
+
+		SnortFs::LockstepResult const result = (
+			SnortFs::lockstep_compare(channel, cancel)
+		);
+		if (isDiverging) {
+			Assert(result.haltReason == SnortFs::kLockstepHalt_diverged);
+			Assert(result.instruction == 100u);
+			Assert(result.comparedRecordCount == 25u);
+			Assert(result.regionIndices.size() == 1u);
+			Assert(result.regionIndices[0] == 1u);
+			Assert(
+				   strcmp(SnortFs::lockstep_regionLabel(channel, 0u, 1u), "region-memory")
+				== 0
+			);
+		}
+		else {
+			Assert(result.haltReason == SnortFs::kLockstepHalt_none);
+			Assert(result.comparedRecordCount == 40u);
+		}
+		SnortFs::lockstep_destroy(channel);
+	}
+
+	// once halted, publishing fails and nothing new can attach
+	SnortFs::LockstepChannel channel = SnortFs::lockstep_create("unit-test");
+	SnortFs::LockstepChannel side = (
+		SnortFs::lockstep_attach("unit-test", 2, regionCreateInfo)
+	);
+	uint64_t const hashes[2] = { 1u, 2u };
+	Assert(SnortFs::lockstep_publish(side, 0u, hashes));
+	SnortFs::lockstep_destroy(channel);
+	Assert(!SnortFs::lockstep_publish(side, 1u, hashes));
+	uint64_t haltInstruction = 0u;
+	Assert(
+		   SnortFs::lockstep_haltReason(side, haltInstruction)
+		== SnortFs::kLockstepHalt_comparatorExited
+	);
+	SnortFs::lockstep_detach(side);
+	Assert(SnortFs::lockstep_attach("unit-test", 2, regionCreateInfo).handle == 0);
+}
+
 int32_t main() {
 	// replay tests
 	replayTest1();
 	replayTest2();
+	replayMappedTest();
+	replayVersion1Test();
+	replayFixedWidthTest();
+	replayIndexTest();
+	replayKeyframeTest();
+	replayCodecTest();
+	replayRegionMaskTest();
+	validateMemoryParallelTest();
+	replayAsyncWriterTest();
+	replayRecorderAllocationTest();
+	replayHashOnlyTest();
+	replayRngSeedTest();
+	replayInputTest();
+	flightRecorderTest();
+	stepBackTest();
+	stepBackRunTest();
+	runCoresTest();
+	lockstepTest();
+	diffKernelTest();
 	return 0;
 }
@@ -47,7 +47,9 @@ int main(int argc, char **argv) {
 			(char const * const *)argv
 		)
 	);
-	ImGui::GetIO().IniFilename = "imgui-chip8.ini";
+	if (!snort_isHeadless(snortDevice)) {
+		ImGui::GetIO().IniFilename = "imgui-chip8.ini";
+	}
 #endif
 
     // Command usage
@@ -109,21 +111,23 @@ int main(int argc, char **argv) {
 	while (true) {
 #endif
 #if SnortInsert
-		bool const shouldRunFrame = (
-			snort_startFrame(
-				snortDevice,
-				(SnortMemoryRegion const []) {
-					{ chip8.memory },
-					{ (u8 *)chip8.stack },
-					{ chip8.V },
-					{ (u8 *)&chip8.I },
-					{ (u8 *)&chip8.pc },
-					{ (u8 *)&chip8.stack },
-					{ chip8.gfx },
-				}
-			)
-		);
-		if (shouldRunFrame) {
+		SnortMemoryRegion const memoryRegions[] = {
+			{ chip8.memory },
+			{ (u8 *)chip8.stack },
+			{ chip8.V },
+			{ (u8 *)&chip8.I },
+			{ (u8 *)&chip8.pc },
+			{ (u8 *)&chip8.sp },
+			{ chip8.gfx },
+		};
+		u64 const framesToRun = snort_startFrame(snortDevice, memoryRegions);
+		for (u64 it = 0; it < framesToRun; ++ it) {
+			snort_updateFrame(snortDevice, memoryRegions);
+			// the keypad comes from the harness instead of SDL
+			u64 const keys = snort_inputState(snortDevice);
+			for (int i = 0; i < 16; ++i) {
+				chip8.key[i] = (keys >> i) & 1u;
+			}
 #endif
         chip8.emulate_cycle();
 #if SnortInsert